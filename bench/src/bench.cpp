@@ -0,0 +1,424 @@
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <new>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fmt/core.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+#include "environment.h"
+#include "eval.h"
+#include "heap.h"
+#include "interpreter.h"
+#include "optimizer.h"
+#include "parser.h"
+
+/*
+ * inky-bench, runs a corpus of workloads and reports the time, allocations and Values made per op
+ * along with the peak resident set size of the process.
+ *
+ *   inky-bench [--json] [--vm] [--optimize] [--min-time seconds] [--threads n] [--list] [filter ...]
+ *
+ * --vm evaluates with the bytecode VM instead of the tree walker, --optimize optimizes each form
+ * before it is evaluated (see optimizer.h), a filter selects the workloads
+ * whose names contain it. Each workload runs in a new interpreter: its setup forms are evaluated
+ * once, then its form is evaluated (or parsed) in batches until at least min-time has elapsed.
+ *
+ * --threads n measures how throughput scales instead: each workload is run by 1, 2, 4 ... n threads
+ * at once, each with its own interpreter, for min-time.
+ */
+
+namespace {
+    /*
+     * Every call to operator new made by the process, including those of the pool's threads. The
+     * count is striped over cache lines so that threads allocating at once don't contend for it.
+     */
+    struct alignas(64) Stripe { std::atomic<size_t> count { 0 }; };
+    constexpr size_t stripes = 64;
+    Stripe allocationCounts[stripes];
+    std::atomic<size_t> threadCount { 0 };
+
+    void* allocate(std::size_t n) {
+        thread_local size_t stripe = threadCount.fetch_add(1, std::memory_order_relaxed) % stripes;
+        allocationCounts[stripe].count.fetch_add(1, std::memory_order_relaxed);
+        if ( void* p = std::malloc(n ? n : 1) ) return p;
+        throw std::bad_alloc();
+    }
+
+    size_t allocations() {
+        size_t n = 0;
+        for (const auto& s: allocationCounts) n += s.count.load(std::memory_order_relaxed);
+        return n;
+    }
+}
+
+void* operator new(std::size_t n) { return allocate(n); }
+void* operator new[](std::size_t n) { return allocate(n); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+
+
+namespace Inky::Lisp {
+
+    struct Workload {
+        std::string                 name;
+        std::vector<std::string>    setup;              /* forms evaluated once, before timing.           */
+        std::string                 form;               /* the form evaluated by each op.                 */
+        bool                        parseOnly = false;  /* ops parse the form rather than evaluate it.    */
+    };
+
+    struct Result {
+        std::string name;
+        size_t      ops;
+        double      seconds;
+        size_t      allocations;
+        size_t      values;
+        size_t      peakRss;    /* kilobytes, of the process so far. */
+    };
+
+    /* Definitions shared by the workloads, the prelude's and the lisp versions of its list functions. */
+    const std::vector<std::string> prelude = {
+            "def (nil) []",
+            "def (true) 1",
+            "def (false) 0",
+            "defun (add x y) (+ x y)",
+            "defun (odd x) (== (- x (* 2 (/ x 2))) 1)",
+            "defun (range n acc) (if (== n 0) (acc) (range (- n 1) (join (list n) acc)))",
+            "defun (lfst xs) ( eval (head xs) )",
+            "defun (lfoldl f z xs) (if (== xs nil) [z] (lfoldl f (f z (lfst xs)) (tail xs)))",
+            "defun (lmap f xs) ( (if (== xs nil) (nil) (join (list (f (lfst xs))) (lmap f (tail xs)))))",
+            "defun (lfilter f xs) (if (== xs nil) (nil) (join (if (f (lfst xs)) (head xs) (nil)) (lfilter f (tail xs))))"
+    };
+
+    /* A large source, a list of n mixed forms: symbols, numbers, strings and nested expressions. */
+    std::string source(size_t n) {
+        std::string s = "[";
+        for (size_t k = 0; k < n; k++) {
+            s += fmt::format("(defun (f{0} x y) (+ x (* y {0}) 2.5)) \"string {0}\" [a b (c {0})] ", k);
+        }
+        return s + "]";
+    }
+
+    std::vector<Workload> corpus() {
+        std::vector<Workload> workloads = {
+                { "fib/20",
+                  { "defun (fib n) (if (< n 2) (n) (+ (fib (- n 1)) (fib (- n 2))))" },
+                  "fib 20" },
+                { "closures/depth-200",
+                  { "defun (compose f g x) (f (g x))",
+                    "def (fs) (foldl (\\ (f n) (compose f (add n))) (add 0) (range 200 nil))" },
+                  "fs 1" },
+                { "closures/partial",
+                  { "defun (add3 x y z) (+ x y z)" },
+                  "foldl (\\ (n x) (((add3 x) n) 1)) 0 (range 1000 nil)" },
+                { "strings/filter",
+                  { "def (words) (map (\\ (n) (if (odd n) (\"odd\") (\"even\"))) (range 1000 nil))" },
+                  "len (filter (\\ (s) (== s \"odd\")) words)" },
+                { "strings/build",
+                  {},
+                  "foldl (\\ (xs n) (join xs [\"lorem\" \"ipsum\" \"dolor\"])) [] (range 300 nil)" }
+        };
+
+        for (size_t n: { 100, 1000, 10000 }) {
+            std::string xs = fmt::format("def (xs) (range {} nil)", n);
+            workloads.push_back({ fmt::format("map/{}", n), { xs }, "map (add 1) xs" });
+            workloads.push_back({ fmt::format("foldl/{}", n), { xs }, "foldl add 0 xs" });
+            workloads.push_back({ fmt::format("filter/{}", n), { xs }, "filter odd xs" });
+        }
+        /* a native function, and the same function defined in lisp. */
+        workloads.push_back({ "native/clamp", { "def (xs) (range 1000 nil)" },
+                              "foldl (\\ (acc x) (+ acc (clamp x 100 900))) 0 xs" });
+        workloads.push_back({ "native/lisp-clamp",
+                              { "def (xs) (range 1000 nil)",
+                                "defun (lclamp x lo hi) (if (< x lo) [lo] [if (> x hi) [hi] [x]])" },
+                              "foldl (\\ (acc x) (+ acc (lclamp x 100 900))) 0 xs" });
+        /* a rule with constant sub-expressions, and a small function called by it. */
+        workloads.push_back({ "rules/constants",
+                              { "def (xs) (range 1000 nil)",
+                                "defun (seconds d) (* d 60 60 24)",
+                                "defun (rule x) (if (> x (* 2 60 60 24)) [- x (seconds 2)] [+ x (/ (* 24 60) 4)])" },
+                              "foldl (\\ (acc x) (+ acc (rule (* x 1000)))) 0 xs" });
+        /* summing the same numbers held in a vector rather than a list. */
+        for (size_t n: { 1000, 100000 }) {
+            std::string xs = fmt::format("def (xs) (vmap (\\ (n) (* n 0.5)) (vec (range {} nil)))", n);
+            workloads.push_back({ fmt::format("vector/sum/{}", n), { xs }, "vsum xs" });
+            workloads.push_back({ fmt::format("vector/dot/{}", n), { xs }, "vdot xs xs" });
+        }
+        /* the recursive lisp definitions, limited by the stack of the tree walker. */
+        for (size_t n: { 100, 1000 }) {
+            std::string xs = fmt::format("def (xs) (range {} nil)", n);
+            workloads.push_back({ fmt::format("lisp-map/{}", n), { xs }, "lmap (add 1) xs" });
+            workloads.push_back({ fmt::format("lisp-foldl/{}", n), { xs }, "lfoldl add 0 xs" });
+            workloads.push_back({ fmt::format("lisp-filter/{}", n), { xs }, "lfilter odd xs" });
+        }
+        /* last, as the peak rss reported is that of the process so far. */
+        for (size_t n: { 1000, 10000 }) {
+            workloads.push_back({ fmt::format("parse/{}", n), {}, source(n), true });
+        }
+        return workloads;
+    }
+
+    size_t peakRss() {
+#if defined(__APPLE__)
+        struct rusage usage {};
+        getrusage(RUSAGE_SELF, &usage);
+        return usage.ru_maxrss / 1024; /* bytes. */
+#elif defined(__unix__)
+        struct rusage usage {};
+        getrusage(RUSAGE_SELF, &usage);
+        return usage.ru_maxrss;
+#else
+        return 0;
+#endif
+    }
+
+    std::string describe(ValuePtr v) {
+        std::ostringstream os;
+        os << v;
+        return os.str();
+    }
+
+    /* A workload set up in an interpreter of its own, ready to run ops. */
+    class Instance {
+    public:
+        Instance(const Workload& workload, Evaluator evaluator) : workload(workload), interpreter(evaluator) {
+            interpreter.registerNative("clamp", +[](long x, long lo, long hi) { return std::min(std::max(x, lo), hi); });
+            for (const auto& forms: { prelude, workload.setup }) {
+                for (const auto& form: forms) {
+                    if ( auto error = evaluate(form) ) {
+                        throw std::runtime_error(fmt::format("{}: setup '{}' failed, {}", workload.name, form, *error));
+                    }
+                }
+            }
+
+            if ( !workload.parseOnly ) {
+                auto v = parse(workload.form);
+                if ( !v ) throw std::runtime_error(fmt::format("{}: {}", workload.name, v.left().message));
+                form = v.right();
+            }
+            if ( !op() ) throw std::runtime_error(fmt::format("{}: {}", workload.name, error));
+        }
+
+        /* An op, returns false if it fails, the first (untimed) op reports the error. */
+        bool op() {
+            if ( workload.parseOnly ) {
+                auto v = parse(workload.form);
+                if ( !v ) error = v.left().message;
+                return bool(v);
+            }
+            ValuePtr result = interpreter.evaluate(form);
+            if ( Ops::isError(result) ) error = describe(result);
+            return !Ops::isError(result);
+        }
+
+    private:
+        /* Evaluate an input, returns the error message if it fails to parse or evaluates to an error. */
+        std::optional<std::string> evaluate(const std::string& input) {
+            auto v = parse(input);
+            if ( !v ) return v.left().message;
+            ValuePtr result = interpreter.evaluate(v.right());
+            if ( Ops::isError(result) ) return describe(result);
+            return std::nullopt;
+        }
+
+        const Workload& workload;
+        Interpreter     interpreter;
+        ValuePtr        form;
+        std::string     error;
+    };
+
+    Result run(const Workload& workload, Evaluator evaluator, double minTime) {
+        using Clock = std::chrono::steady_clock;
+
+        Instance instance(workload, evaluator);
+        auto op = [&]() { return instance.op(); };
+
+        Result result { workload.name, 0, 0, 0, 0, 0 };
+        size_t allocated = allocations();
+        size_t values = Heap::stats().allocated;
+        for (size_t batch = 1; result.seconds < minTime; batch *= 2) {
+            auto start = Clock::now();
+            for (size_t k = 0; k < batch; k++) op();
+            result.seconds += std::chrono::duration<double>(Clock::now() - start).count();
+            result.ops += batch;
+        }
+        result.allocations = allocations() - allocated;
+        result.values = Heap::stats().allocated - values;
+        result.peakRss = peakRss();
+        return result;
+    }
+
+    struct Scaling {
+        std::string name;
+        size_t      threads;
+        double      opsPerSecond;   /* of all the threads together. */
+    };
+
+    /* The throughput of 'threads' threads running the workload at once, each with its own interpreter. */
+    Scaling scale(const Workload& workload, Evaluator evaluator, double minTime, size_t threads) {
+        using Clock = std::chrono::steady_clock;
+
+        std::atomic<size_t> ready { 0 };
+        std::atomic<bool> started { false }, stopped { false };
+        std::vector<size_t> ops(threads, 0);
+        std::vector<std::string> errors(threads);
+
+        std::vector<std::thread> workers;
+        for (size_t t = 0; t < threads; t++) {
+            workers.emplace_back([&, t]() {
+                std::optional<Instance> instance;
+                try {
+                    instance.emplace(workload, evaluator);
+                } catch (const std::exception& e) {
+                    errors[t] = e.what();
+                }
+                ready++;
+                while ( !started.load() ) std::this_thread::yield();
+                if ( !instance ) return;
+                while ( !stopped.load(std::memory_order_relaxed) && instance->op() ) ops[t]++;
+            });
+        }
+
+        while ( ready.load() < threads ) std::this_thread::yield();
+        auto start = Clock::now();
+        started = true;
+        std::this_thread::sleep_for(std::chrono::duration<double>(minTime));
+        stopped = true;
+        for (auto& w: workers) w.join();
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+        for (const auto& error: errors) {
+            if ( !error.empty() ) throw std::runtime_error(error);
+        }
+        size_t total = 0;
+        for (auto n: ops) total += n;
+        return Scaling { workload.name, threads, total / seconds };
+    }
+
+    void printScaling(const std::vector<Scaling>& results, const char* mode) {
+        fmt::print("{:<22} {:>8} {:>14} {:>10}\n", mode, "threads", "ops/s", "speedup");
+        double single = 0;
+        for (const auto& r: results) {
+            if ( r.threads == 1 ) single = r.opsPerSecond;
+            fmt::print("{:<22} {:>8} {:>14.1f} {:>9.2f}x\n", r.name, r.threads, r.opsPerSecond, single > 0 ? r.opsPerSecond / single : 0);
+        }
+    }
+
+    void printScalingJson(const std::vector<Scaling>& results, const char* mode) {
+        fmt::print("{{\n  \"evaluator\": \"{}\",\n  \"scaling\": [", mode);
+        for (size_t k = 0; k < results.size(); k++) {
+            const auto& r = results[k];
+            fmt::print("{}\n    {{ \"name\": \"{}\", \"threads\": {}, \"ops_per_second\": {:.1f} }}",
+                       k ? "," : "", r.name, r.threads, r.opsPerSecond);
+        }
+        fmt::print("\n  ]\n}}\n");
+    }
+
+    std::string formatTime(double seconds) {
+        if ( seconds < 1e-6 ) return fmt::format("{:.1f} ns", seconds * 1e9);
+        if ( seconds < 1e-3 ) return fmt::format("{:.2f} us", seconds * 1e6);
+        if ( seconds < 1 ) return fmt::format("{:.2f} ms", seconds * 1e3);
+        return fmt::format("{:.2f} s", seconds);
+    }
+
+    void printTable(const std::vector<Result>& results, const char* mode) {
+        fmt::print("{:<22} {:>10} {:>12} {:>12} {:>12} {:>12}\n", mode, "ops", "time/op", "allocs/op", "values/op", "peak rss");
+        for (const auto& r: results) {
+            fmt::print("{:<22} {:>10} {:>12} {:>12.1f} {:>12.1f} {:>9} KB\n", r.name, r.ops, formatTime(r.seconds / r.ops),
+                       double(r.allocations) / r.ops, double(r.values) / r.ops, r.peakRss);
+        }
+    }
+
+    void printJson(const std::vector<Result>& results, const char* mode) {
+        fmt::print("{{\n  \"evaluator\": \"{}\",\n  \"benchmarks\": [", mode);
+        for (size_t k = 0; k < results.size(); k++) {
+            const auto& r = results[k];
+            fmt::print("{}\n    {{ \"name\": \"{}\", \"ops\": {}, \"ns_per_op\": {:.1f}, \"allocs_per_op\": {:.2f}, "
+                       "\"values_per_op\": {:.2f}, \"peak_rss_kb\": {} }}", k ? "," : "", r.name, r.ops,
+                       r.seconds * 1e9 / r.ops, double(r.allocations) / r.ops, double(r.values) / r.ops, r.peakRss);
+        }
+        fmt::print("\n  ],\n  \"peak_rss_kb\": {}\n}}\n", peakRss());
+    }
+}
+
+
+int main(int argc, char** argv) {
+    using namespace Inky::Lisp;
+
+    bool json = false, list = false, optimized = false;
+    Evaluator evaluator = eval;
+    double minTime = 0.2;
+    size_t threads = 0;
+    std::vector<std::string> filters;
+
+    for (int k = 1; k < argc; k++) {
+        std::string arg = argv[k];
+        if ( arg == "--json" ) json = true;
+        else if ( arg == "--vm" ) evaluator = execute;
+        else if ( arg == "--optimize" ) optimized = true;
+        else if ( arg == "--list" ) list = true;
+        else if ( arg == "--min-time" && k + 1 < argc ) minTime = std::strtod(argv[++k], nullptr);
+        else if ( arg == "--threads" && k + 1 < argc ) threads = std::strtoul(argv[++k], nullptr, 10);
+        else if ( arg[0] == '-' ) {
+            fmt::print(stderr, "usage: inky-bench [--json] [--vm] [--optimize] [--min-time seconds] [--threads n] [--list] [filter ...]\n");
+            return 2;
+        }
+        else filters.push_back(arg);
+    }
+
+    std::vector<Workload> workloads;
+    for (auto& w: corpus()) {
+        bool selected = filters.empty();
+        for (const auto& f: filters) selected |= w.name.find(f) != std::string::npos;
+        if ( selected ) workloads.push_back(std::move(w));
+    }
+
+    if ( list ) {
+        for (const auto& w: workloads) fmt::print("{}\n", w.name);
+        return 0;
+    }
+
+    const char* mode = evaluator == execute ? "vm" : "eval";
+    if ( optimized ) {
+        mode = evaluator == execute ? "vm-optimized" : "eval-optimized";
+        evaluator = evaluator == execute ? executeOptimized : evalOptimized;
+    }
+    if ( threads > 0 ) {
+        std::vector<Scaling> results;
+        try {
+            for (const auto& w: workloads) {
+                for (size_t n = 1; n <= threads; n = n < threads && 2 * n > threads ? threads : 2 * n) {
+                    results.push_back(scale(w, evaluator, minTime, n));
+                }
+            }
+        } catch (const std::exception& e) {
+            fmt::print(stderr, "inky-bench: {}\n", e.what());
+            return 1;
+        }
+        if ( json ) printScalingJson(results, mode);
+        else printScaling(results, mode);
+        return 0;
+    }
+
+    std::vector<Result> results;
+    try {
+        for (const auto& w: workloads) results.push_back(run(w, evaluator, minTime));
+    } catch (const std::exception& e) {
+        fmt::print(stderr, "inky-bench: {}\n", e.what());
+        return 1;
+    }
+
+    if ( json ) printJson(results, mode);
+    else printTable(results, mode);
+    return 0;
+}
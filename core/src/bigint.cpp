@@ -0,0 +1,209 @@
+#include <algorithm>
+#include <cmath>
+
+#include "bigint.h"
+
+namespace Inky::Lisp {
+
+    BigInteger::BigInteger(long x) : negative(x < 0) {
+        /* the magnitude of LONG_MIN doesn't fit in a long, so negate as unsigned. */
+        uint64_t m = x < 0 ? 0 - (uint64_t) x : (uint64_t) x;
+        for (; m != 0; m >>= 32) magnitude.push_back((uint32_t) m);
+    }
+
+    BigInteger::BigInteger(bool negative, Digits magnitude) : negative(negative), magnitude(std::move(magnitude)) {
+        trim(this->magnitude);
+        if ( this->magnitude.empty() ) this->negative = false;
+    }
+
+    std::optional<BigInteger> BigInteger::parse(std::string_view s) {
+        bool negative = false;
+        if ( !s.empty() && (s[0] == '-' || s[0] == '+') ) {
+            negative = s[0] == '-';
+            s.remove_prefix(1);
+        }
+        if ( s.empty() ) return std::nullopt;
+
+        /* nine decimal digits at a time, each chunk fits a digit. */
+        Digits magnitude;
+        size_t chunk = s.size() % 9 == 0 ? 9 : s.size() % 9;
+        for (size_t k = 0; k < s.size(); k += chunk, chunk = 9) {
+            uint32_t value = 0, scale = 1;
+            for (size_t j = k; j < k + chunk; j++) {
+                if ( s[j] < '0' || s[j] > '9' ) return std::nullopt;
+                value = value * 10 + (s[j] - '0');
+                scale *= 10;
+            }
+            multiplyAdd(magnitude, scale, value);
+        }
+        return BigInteger(negative, std::move(magnitude));
+    }
+
+    bool BigInteger::fitsLong() const {
+        if ( magnitude.size() > 2 ) return false;
+        uint64_t m = 0;
+        for (size_t k = magnitude.size(); k-- > 0; ) m = (m << 32) | magnitude[k];
+        return negative ? m <= (uint64_t) LONG_MAX + 1 : m <= (uint64_t) LONG_MAX;
+    }
+
+    long BigInteger::toLong() const {
+        uint64_t m = 0;
+        for (size_t k = magnitude.size(); k-- > 0; ) m = (m << 32) | magnitude[k];
+        return negative ? (long) (0 - m) : (long) m;
+    }
+
+    double BigInteger::toDouble() const {
+        double x = 0;
+        for (size_t k = magnitude.size(); k-- > 0; ) x = x * 4294967296.0 + magnitude[k];
+        return negative ? -x : x;
+    }
+
+    std::string BigInteger::toString() const {
+        if ( magnitude.empty() ) return "0";
+
+        std::vector<uint32_t> chunks; /* base 10^9, least significant first. */
+        Digits m = magnitude;
+        while ( !m.empty() ) chunks.push_back(divideSmall(m, 1000000000));
+
+        std::string s = negative ? "-" : "";
+        s += std::to_string(chunks.back());
+        for (size_t k = chunks.size() - 1; k-- > 0; ) {
+            std::string digits = std::to_string(chunks[k]);
+            s.append(9 - digits.size(), '0');
+            s += digits;
+        }
+        return s;
+    }
+
+    int BigInteger::compare(const BigInteger& other) const {
+        if ( negative != other.negative ) return negative ? -1 : 1;
+        int c = compareMagnitude(magnitude, other.magnitude);
+        return negative ? -c : c;
+    }
+
+    BigInteger BigInteger::operator+(const BigInteger& other) const {
+        if ( negative == other.negative ) return BigInteger(negative, add(magnitude, other.magnitude));
+        if ( compareMagnitude(magnitude, other.magnitude) >= 0 ) return BigInteger(negative, subtract(magnitude, other.magnitude));
+        return BigInteger(other.negative, subtract(other.magnitude, magnitude));
+    }
+
+    BigInteger BigInteger::operator-(const BigInteger& other) const {
+        BigInteger negated(!other.negative, other.magnitude);
+        return *this + negated;
+    }
+
+    BigInteger BigInteger::operator*(const BigInteger& other) const {
+        return BigInteger(negative != other.negative, multiply(magnitude, other.magnitude));
+    }
+
+    BigInteger BigInteger::operator/(const BigInteger& other) const {
+        return BigInteger(negative != other.negative, divide(magnitude, other.magnitude));
+    }
+
+    int BigInteger::compareMagnitude(const Digits& x, const Digits& y) {
+        if ( x.size() != y.size() ) return x.size() < y.size() ? -1 : 1;
+        for (size_t k = x.size(); k-- > 0; ) {
+            if ( x[k] != y[k] ) return x[k] < y[k] ? -1 : 1;
+        }
+        return 0;
+    }
+
+    BigInteger::Digits BigInteger::add(const Digits& x, const Digits& y) {
+        const Digits& longer = x.size() >= y.size() ? x : y;
+        const Digits& shorter = x.size() >= y.size() ? y : x;
+        Digits z(longer.size() + 1);
+        uint64_t carry = 0;
+        for (size_t k = 0; k < longer.size(); k++) {
+            carry += (uint64_t) longer[k] + (k < shorter.size() ? shorter[k] : 0);
+            z[k] = (uint32_t) carry;
+            carry >>= 32;
+        }
+        z[longer.size()] = (uint32_t) carry;
+        trim(z);
+        return z;
+    }
+
+    BigInteger::Digits BigInteger::subtract(const Digits& x, const Digits& y) {
+        Digits z(x.size());
+        int64_t borrow = 0;
+        for (size_t k = 0; k < x.size(); k++) {
+            int64_t d = (int64_t) x[k] - (k < y.size() ? y[k] : 0) - borrow;
+            borrow = d < 0;
+            z[k] = (uint32_t) (d + (borrow << 32));
+        }
+        trim(z);
+        return z;
+    }
+
+    BigInteger::Digits BigInteger::multiply(const Digits& x, const Digits& y) {
+        if ( x.empty() || y.empty() ) return {};
+        Digits z(x.size() + y.size());
+        for (size_t i = 0; i < x.size(); i++) {
+            uint64_t carry = 0;
+            for (size_t j = 0; j < y.size(); j++) {
+                carry += (uint64_t) x[i] * y[j] + z[i + j];
+                z[i + j] = (uint32_t) carry;
+                carry >>= 32;
+            }
+            z[i + y.size()] = (uint32_t) carry;
+        }
+        trim(z);
+        return z;
+    }
+
+    /* Schoolbook binary long division, one bit of the quotient at a time; the numbers involved are small. */
+    BigInteger::Digits BigInteger::divide(const Digits& x, const Digits& y) {
+        if ( compareMagnitude(x, y) < 0 ) return {};
+        if ( y.size() == 1 ) {
+            Digits q = x;
+            divideSmall(q, y[0]);
+            return q;
+        }
+
+        Digits q(x.size()), r;
+        for (size_t bit = x.size() * 32; bit-- > 0; ) {
+            /* r = r * 2 + next bit of x. */
+            uint32_t carry = (x[bit / 32] >> (bit % 32)) & 1;
+            for (auto& d: r) {
+                uint32_t top = d >> 31;
+                d = (d << 1) | carry;
+                carry = top;
+            }
+            if ( carry ) r.push_back(carry);
+
+            if ( compareMagnitude(r, y) >= 0 ) {
+                r = subtract(r, y);
+                q[bit / 32] |= 1u << (bit % 32);
+            }
+        }
+        trim(q);
+        return q;
+    }
+
+    void BigInteger::multiplyAdd(Digits& x, uint32_t m, uint32_t a) {
+        uint64_t carry = a;
+        for (auto& d: x) {
+            carry += (uint64_t) d * m;
+            d = (uint32_t) carry;
+            carry >>= 32;
+        }
+        if ( carry ) x.push_back((uint32_t) carry);
+        trim(x);
+    }
+
+    uint32_t BigInteger::divideSmall(Digits& x, uint32_t d) {
+        uint64_t remainder = 0;
+        for (size_t k = x.size(); k-- > 0; ) {
+            uint64_t n = (remainder << 32) | x[k];
+            x[k] = (uint32_t) (n / d);
+            remainder = n % d;
+        }
+        trim(x);
+        return (uint32_t) remainder;
+    }
+
+    void BigInteger::trim(Digits& x) {
+        while ( !x.empty() && x.back() == 0 ) x.pop_back();
+    }
+
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <climits>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace Inky::Lisp {
+
+    /*
+     * Arbitrary precision integer, the result of integer arithmetic that overflows a long. Integers are
+     * held as a long whenever they fit (see Ops::makeBigInteger), so a BigInteger value is never equal
+     * to an Integer value. The magnitude is held as base 2^32 digits, least significant first.
+     */
+    class BigInteger {
+    public:
+        BigInteger() = default; /* zero. */
+        explicit BigInteger(long x);
+
+        /* Parse an optionally signed string of decimal digits, nothing if it isn't one. */
+        static std::optional<BigInteger> parse(std::string_view s);
+
+        bool isZero() const { return magnitude.empty(); }
+        bool fitsLong() const;
+        long toLong() const; /* provided it fits. */
+        double toDouble() const;
+        std::string toString() const;
+
+        /* Less than zero, zero or greater than zero as this is less than, equal to or greater than 'other'. */
+        int compare(const BigInteger& other) const;
+
+        BigInteger operator+(const BigInteger& other) const;
+        BigInteger operator-(const BigInteger& other) const;
+        BigInteger operator*(const BigInteger& other) const;
+
+        /* Division truncated toward zero, as for long; the divisor must not be zero. */
+        BigInteger operator/(const BigInteger& other) const;
+
+    private:
+        typedef std::vector<uint32_t> Digits;
+
+        BigInteger(bool negative, Digits magnitude);
+
+        static int compareMagnitude(const Digits& x, const Digits& y);
+        static Digits add(const Digits& x, const Digits& y);
+        static Digits subtract(const Digits& x, const Digits& y); /* x >= y. */
+        static Digits multiply(const Digits& x, const Digits& y);
+        static Digits divide(const Digits& x, const Digits& y);
+
+        /* x = x * m + a, in place. */
+        static void multiplyAdd(Digits& x, uint32_t m, uint32_t a);
+
+        /* x = x / d in place, returns the remainder. */
+        static uint32_t divideSmall(Digits& x, uint32_t d);
+
+        static void trim(Digits& x);
+
+        bool    negative = false;
+        Digits  magnitude;
+    };
+
+    /*
+     * Overflow checked arithmetic on longs, each returns false (leaving r unchanged) if the result
+     * doesn't fit in a long. Used by the fixnum fast paths, which promote to BigInteger on overflow.
+     */
+    namespace Checked {
+#if defined(__GNUC__) || defined(__clang__)
+        inline bool add(long a, long b, long& r) { long x; return !__builtin_add_overflow(a, b, &x) && (r = x, true); }
+        inline bool subtract(long a, long b, long& r) { long x; return !__builtin_sub_overflow(a, b, &x) && (r = x, true); }
+        inline bool multiply(long a, long b, long& r) { long x; return !__builtin_mul_overflow(a, b, &x) && (r = x, true); }
+#else
+        inline bool add(long a, long b, long& r) {
+            if ( (b > 0 && a > LONG_MAX - b) || (b < 0 && a < LONG_MIN - b) ) return false;
+            r = a + b;
+            return true;
+        }
+        inline bool subtract(long a, long b, long& r) {
+            if ( (b < 0 && a > LONG_MAX + b) || (b > 0 && a < LONG_MIN + b) ) return false;
+            r = a - b;
+            return true;
+        }
+        inline bool multiply(long a, long b, long& r) {
+            bool overflow = a > 0 ? (b > 0 ? a > LONG_MAX / b : b < LONG_MIN / a)
+                                  : (b > 0 ? a < LONG_MIN / b : a != 0 && b < LONG_MAX / a);
+            if ( overflow ) return false;
+            r = a * b;
+            return true;
+        }
+#endif
+    }
+
+}
@@ -4,15 +4,23 @@
 #include <variant>
 #include <fmt/core.h>
 
+#include "bigint.h"
 #include "eval.h"
+#include "map.h"
+#include "memo.h"
+#include "pool.h"
+#include "profiler.h"
+#include "source.h"
+#include "trace.h"
 #include "value.h"
+#include "vector.h"
 #include "builtin.h"
 
 
 namespace Inky::Lisp {
 
 
-    ValuePtr builtin_lambda(EnvironmentPtr env, ValuePtr p) {
+    ValuePtr builtin_lambda(const EnvironmentPtr& env, const ValuePtr& p) {
         if ( !Ops::isExpression(p) ) Ops::makeError("lambda fn, formals & body must be [] expression.");
         ExpressionPtr expression = std::get<ExpressionPtr>(p->var);
 
@@ -26,8 +34,8 @@ namespace Inky::Lisp {
         }
 
         /* Formals must be expression containing symbols. */
-        ValuePtr formals = expression->cells[0]; expression->cells.pop_front();
-        ValuePtr body = expression->cells[0];  expression->cells.pop_front();
+        ValuePtr formals = expression->cells[0];
+        ValuePtr body = expression->cells[1];
 
         if ( !Ops::isExpression(formals) ) return Ops::makeError("formals must be an expression containing symbols for arguments.");
         ExpressionPtr formalExp = std::get<ExpressionPtr>(formals->var);
@@ -36,12 +44,21 @@ namespace Inky::Lisp {
             if (c->kind != Type::Symbol) return Ops::makeError("lambda function formal must be symbol.");
         }
 
-        EnvironmentPtr e(new Environment()); /* Eval should set the outer scope? */
+        EnvironmentPtr e = makeFrame(formals); /* Eval should set the outer scope? */
+        env->markLocals(e->slotNames());
 
-        return Ops::makeFunction(std::make_shared<Lambda>(Lambda{ formals, body, e }));
+        return Ops::makeFunction(std::make_shared<Lambda>(Lambda{ formals, body, e, nullptr }));
     }
 
-    ValuePtr builtin_define(EnvironmentPtr e, ValuePtr a, bool insertIntoOuterScope) {
+    ValuePtr nameFunction(const ValuePtr& v, Symbol name) {
+        if ( v->kind != Type::Function || std::get<LambdaPtr>(v->var)->name != Symbols::Lambda ) return v;
+        /* the lambda may be bound elsewhere too, so it is named in a copy. */
+        Lambda named = *std::get<LambdaPtr>(v->var);
+        named.name = name;
+        return Ops::makeFunction(std::make_shared<Lambda>(named));
+    }
+
+    ValuePtr builtin_define(const EnvironmentPtr& e, const ValuePtr& a, bool insertIntoOuterScope) {
         if ( !Ops::isExpression(a) ) return Ops::makeError("define parameters must be [] expressions.");
         ExpressionPtr expression = std::get<ExpressionPtr>(a->var);
 
@@ -63,31 +80,31 @@ namespace Inky::Lisp {
                 if (Ops::isError(tmp))  return tmp;
             }
             auto val = expression->cells[i+1] ;
+            val = nameFunction(val, std::get<Symbol>(key->var));
 
-
-            if (insertIntoOuterScope) e->insertGlobal(std::get<std::string>(key->var),val);
-            else e->insert(std::get<std::string>(key->var),val) ;
+            if (insertIntoOuterScope) e->insertGlobal(std::get<Symbol>(key->var),val);
+            else e->insert(std::get<Symbol>(key->var),val) ;
         }
 
         /* value defined, return empty s-expression. */
         return Ops::makeSExpression();
     }
 
-    ValuePtr builtin_def(EnvironmentPtr e, ValuePtr a) {
+    ValuePtr builtin_def(const EnvironmentPtr& e, const ValuePtr& a) {
         return builtin_define(e,a,true);
     }
 
 
-    ValuePtr builtin_put(EnvironmentPtr e, ValuePtr a) {
+    ValuePtr builtin_put(const EnvironmentPtr& e, const ValuePtr& a) {
         return builtin_define(e,a,false);
     }
 
-    ValuePtr builtin_list(EnvironmentPtr , ValuePtr a) {
+    ValuePtr builtin_list(const EnvironmentPtr& , const ValuePtr& a) {
         a->kind = Type::QExpression;
         return a;
     }
 
-    ValuePtr builtin_head(EnvironmentPtr , ValuePtr a) {
+    ValuePtr builtin_head(const EnvironmentPtr& , const ValuePtr& a) {
         if ( !Ops::isExpression(a) )  return Ops::makeError("argument to head function must be list expression.");
         ExpressionPtr expression = std::get<ExpressionPtr>(a->var);
         if (expression->cells.size() != 1) return Ops::makeError("head function passed more than one argument.");
@@ -105,198 +122,745 @@ namespace Inky::Lisp {
         return Ops::makeQExpression(result);
     }
 
-    ValuePtr builtin_tail(EnvironmentPtr , ValuePtr a) {
+    ValuePtr builtin_tail(const EnvironmentPtr& , const ValuePtr& a) {
         if ( !Ops::isExpression(a) )  return Ops::makeError("argument to tail function must be list expression.");
         ExpressionPtr expression = std::get<ExpressionPtr>(a->var);
         if (expression->cells.size() != 1) return Ops::makeError("tail function passed more than one argument.");
 
-        ValuePtr list = expression->cells[0]->clone();
+        ValuePtr list = expression->cells[0];
         ExpressionPtr xs = std::get<ExpressionPtr>(list->var);
 
         if ( xs->cells.empty() )  return Ops::makeError("tail of empty list.");
             //return Ops::makeQExpression(); /* tail of empty list is empty list, could be error? */
-        xs->cells.pop_front(); /* Remove the head. */
 
-        return Ops::makeQExpression(xs);
+        /* Evaluation doesn't modify values, so the cells can be shared rather than cloned. */
+        ExpressionPtr ys(new Expression());
+        ys->cells = xs->cells.drop(1); /* Remove the head, the cells are shared not copied. */
+
+        return Ops::makeQExpression(ys);
     }
 
-    ValuePtr builtin_eval(EnvironmentPtr e, ValuePtr a) {
+    ValuePtr builtin_eval(const EnvironmentPtr& e, const ValuePtr& a) {
         if (!Ops::isExpression(a)) return Ops::makeError("argument to eval function must be list expression.");
         ExpressionPtr expression = std::get<ExpressionPtr>(a->var);
         if (expression->cells.size() != 1) return Ops::makeError("eval function passed more than one argument.");
 
-        /* clone, if we have def (xs) [ ex1 ex2 ... exn ] we don't want eval to change xs, should be immutable.
-         * the result can be defined or assigned = */
-        ValuePtr xs = expression->cells[0]->clone();
-        xs->kind = Type::SExpression;
-        return eval(e, xs);
+        /* if we have def (xs) [ ex1 ex2 ... exn ] evaluation leaves xs unchanged, no need to clone. */
+        return evalExpression(e, expression->cells[0]);
     }
 
-    ValuePtr builtin_join(EnvironmentPtr e, ValuePtr a) {
+    ValuePtr builtin_join(const EnvironmentPtr& e, const ValuePtr& a) {
         if (!Ops::isExpression(a)) return Ops::makeError("argument to join function must be list expression.");
         ExpressionPtr expression = std::get<ExpressionPtr>(a->var);
         if (expression->cells.empty()) return a;
 
         ExpressionPtr xs(new Expression());
 
-        while (!expression->cells.empty()) {
-            ValuePtr ys = expression->cells[0]; expression->cells.pop_front();
+        /*
+         * The lists being joined are left unchanged, (they may still be bound to symbols or be bytecode
+         * constants), the result shares the cells of the longer list where it can.
+         */
+        for (const auto& ys: expression->cells) {
             if ( Ops::isExpression(ys) ) {
-                ExpressionPtr zs = std::get<ExpressionPtr>(ys->var);
-                while ( !zs->cells.empty())  {
-                   xs->cells.push_back(zs->cells[0]);
-                   zs->cells.pop_front();
-                }
+                xs->cells = Cells::join(xs->cells, std::get<ExpressionPtr>(ys->var)->cells);
             }
         }
 
         return Ops::makeQExpression(xs);
     }
 
-    /* Define some primitive numerical operations, enough so that Prelude can boostrap more... */
-    using integer_op = std::function<long(const long&, const long&)>;
-    using double_op  = std::function<double(const double&, const double&)>;
+    /*
+     * List functions, native versions of the prelude's len, fst, drop, foldl, map & filter; they
+     * loop over the cells rather than recursing. As in the prelude, each element is evaluated (as
+     * 'fst' does) before it is passed to the function. The argument array of a call is reused,
+     * lambdas bind their formals from it directly.
+     */
+    ValuePtr listArgument(const ValuePtr& a, size_t count, const char* usage, ExpressionPtr& xs) {
+        if ( !Ops::isExpression(a) ) return Ops::makeError(usage);
+        ExpressionPtr expression = std::get<ExpressionPtr>(a->var);
+        if ( expression->cells.size() != count ) return Ops::makeError(usage);
+        const ValuePtr& list = expression->cells[count - 1];
+        if ( !Ops::isExpression(list) ) return Ops::makeError(usage);
+        xs = std::get<ExpressionPtr>(list->var);
+        return nullptr;
+    }
 
-    struct numeric_operators { integer_op  f; double_op   g; };
+    bool isFunction(const ValuePtr& f) { return f->kind == Type::Function || f->kind == Type::BuiltinFunction; }
 
-    template<typename T> T add(const T& a, const T& b) { return a+b; }
-    template<typename T> T subtract(const T& a, const T& b) { return a-b; }
-    template<typename T> T multiply(const T& a, const T& b) { return a*b; }
-    template<typename T> T divide(const T& a, const T& b) {
-        if ( b == 0 ) {
-            throw std::runtime_error("divide by zero.");
+    ValuePtr builtin_len(const EnvironmentPtr& , const ValuePtr& a) {
+        ExpressionPtr xs;
+        if ( auto error = listArgument(a, 1, "len expects a list argument, len [x y ...].", xs) ) return error;
+        return Ops::makeInteger(xs->cells.size());
+    }
+
+    ValuePtr builtin_fst(const EnvironmentPtr& e, const ValuePtr& a) {
+        ExpressionPtr xs;
+        if ( auto error = listArgument(a, 1, "fst expects a list argument, fst [x y ...].", xs) ) return error;
+        if ( xs->cells.empty() ) return Ops::makeError("fst of empty list.");
+        return eval(e, xs->cells[0]);
+    }
+
+    ValuePtr builtin_drop(const EnvironmentPtr& , const ValuePtr& a) {
+        ExpressionPtr xs;
+        if ( auto error = listArgument(a, 2, "drop expects a count and a list, drop n [x y ...].", xs) ) return error;
+        const ValuePtr& n = std::get<ExpressionPtr>(a->var)->cells[0];
+        if ( n->kind != Type::Integer || std::get<long>(n->var) < 0 ) return Ops::makeError("drop count must be a non-negative integer.");
+        if ( std::get<long>(n->var) > (long) xs->cells.size() ) return Ops::makeError("tail of empty list.");
+
+        ExpressionPtr ys(new Expression());
+        ys->cells = xs->cells.drop(std::get<long>(n->var));
+        return Ops::makeQExpression(ys);
+    }
+
+    ValuePtr builtin_foldl(const EnvironmentPtr& e, const ValuePtr& a) {
+        ExpressionPtr xs;
+        if ( auto error = listArgument(a, 3, "foldl expects a function, initial value and list, foldl f z [x y ...].", xs) ) return error;
+        ExpressionPtr expression = std::get<ExpressionPtr>(a->var);
+        const ValuePtr& f = expression->cells[0];
+        if ( !isFunction(f) ) return Ops::makeError("foldl, first argument must be a function.");
+
+        ValuePtr args[2] = { expression->cells[1], nullptr }; /* accumulator, element. */
+        for (const auto& x: xs->cells) {
+            args[1] = eval(e, x);
+            if ( Ops::isError(args[1]) ) return args[1];
+            args[0] = apply(e, f, args, args + 2);
+            if ( Ops::isError(args[0]) ) return args[0];
         }
-        return a/b;
+        return args[0];
     }
 
-    ValuePtr builtin_op(EnvironmentPtr /* ignore. */, ValuePtr vp, numeric_operators nop) {
-        /*
-         * 1. check that we have cells to reduce.
-         * 2. runtime type check:
-         *    Check that all cells are numeric.
-         *    If any cell is double, we set the accumulator to double
-         *    and cast any long to double as we accumulate.
-         *    Otherwise, we treat as integer.
-         * 3. On complete, we remove/delete the cells
-         *    and return the value (type will be double or integer).
-         */
+    ValuePtr builtin_map(const EnvironmentPtr& e, const ValuePtr& a) {
+        ExpressionPtr xs;
+        if ( auto error = listArgument(a, 2, "map expects a function and a list, map f [x y ...].", xs) ) return error;
+        const ValuePtr& f = std::get<ExpressionPtr>(a->var)->cells[0];
+        if ( !isFunction(f) ) return Ops::makeError("map, first argument must be a function.");
+
+        ExpressionPtr ys(new Expression());
+        ValuePtr arg;
+        for (const auto& x: xs->cells) {
+            arg = eval(e, x);
+            if ( Ops::isError(arg) ) return arg;
+            ValuePtr y = apply(e, f, &arg, &arg + 1);
+            if ( Ops::isError(y) ) return y;
+            ys->insert(y);
+        }
+        return Ops::makeQExpression(ys);
+    }
+
+    ValuePtr builtin_filter(const EnvironmentPtr& e, const ValuePtr& a) {
+        ExpressionPtr xs;
+        if ( auto error = listArgument(a, 2, "filter expects a function and a list, filter f [x y ...].", xs) ) return error;
+        const ValuePtr& f = std::get<ExpressionPtr>(a->var)->cells[0];
+        if ( !isFunction(f) ) return Ops::makeError("filter, first argument must be a function.");
+
+        ExpressionPtr ys(new Expression());
+        ValuePtr arg;
+        for (const auto& x: xs->cells) {
+            arg = eval(e, x);
+            if ( Ops::isError(arg) ) return arg;
+            ValuePtr keep = apply(e, f, &arg, &arg + 1);
+            if ( Ops::isError(keep) ) return keep;
+            if ( keep->kind != Type::Integer ) return Ops::makeError("if condition must return true or false.");
+            if ( std::get<long>(keep->var) ) ys->insert(x); /* the element itself, as (head xs). */
+        }
+        return Ops::makeQExpression(ys);
+    }
+
+    /*
+     * Parallel versions of map, filter & foldl. The list is split into chunks that run as tasks on
+     * the shared thread pool, so the function should be free of side effects: a def made by a task
+     * is safe, but the order of such definitions is undefined. The results are in list order, if a
+     * call fails the error for the first failing element is returned.
+     */
+    template<typename F>
+    void parallelFor(const EnvironmentPtr& e, size_t n, F f) {
+        if ( n == 0 ) return;
+        ThreadPool& pool = ThreadPool::instance();
+        size_t chunks = std::min(n, 4 * (pool.size() + 1)); /* a few per thread, to balance the load. */
+        if ( chunks <= 1 ) {
+            f(0, n);
+            return;
+        }
+
+        /* a task may run on a thread evaluating for another interpreter, so the sessions it records into are set. */
+        Profiler::Session& profile = Profiler::session();
+        std::vector<std::function<void()>> tasks;
+        for (size_t c = 0; c < chunks; c++) {
+            size_t begin = n * c / chunks;
+            size_t end = n * (c + 1) / chunks;
+            tasks.emplace_back([&f, &profile, begin, end]() {
+                Trace::Use untraced(nullptr);
+                Profiler::Use profiled(&profile);
+                f(begin, end);
+            });
+        }
+
+        e->beginParallel();
+        pool.run(tasks);
+        e->endParallel();
+    }
+
+    /* The first error in the results, or nullptr; a chunk stops at an error, so later results of the chunk are unset. */
+    ValuePtr firstError(const std::vector<ValuePtr>& results) {
+        for (const auto& result: results) {
+            if ( result != nullptr && Ops::isError(result) ) return result;
+        }
+        return nullptr;
+    }
+
+    ValuePtr builtin_pmap(const EnvironmentPtr& e, const ValuePtr& a) {
+        ExpressionPtr xs;
+        if ( auto error = listArgument(a, 2, "pmap expects a function and a list, pmap f [x y ...].", xs) ) return error;
+        const ValuePtr& f = std::get<ExpressionPtr>(a->var)->cells[0];
+        if ( !isFunction(f) ) return Ops::makeError("pmap, first argument must be a function.");
+
+        const Cells& cells = xs->cells;
+        std::vector<ValuePtr> results(cells.size());
+        parallelFor(e, cells.size(), [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                ValuePtr arg = eval(e, cells[i]);
+                results[i] = Ops::isError(arg) ? arg : apply(e, f, &arg, &arg + 1);
+                if ( Ops::isError(results[i]) ) break;
+            }
+        });
+        if ( auto error = firstError(results) ) return error;
+
+        ExpressionPtr ys(new Expression());
+        ys->cells.assign(results.begin(), results.end());
+        return Ops::makeQExpression(ys);
+    }
+
+    ValuePtr builtin_pfilter(const EnvironmentPtr& e, const ValuePtr& a) {
+        ExpressionPtr xs;
+        if ( auto error = listArgument(a, 2, "pfilter expects a function and a list, pfilter f [x y ...].", xs) ) return error;
+        const ValuePtr& f = std::get<ExpressionPtr>(a->var)->cells[0];
+        if ( !isFunction(f) ) return Ops::makeError("pfilter, first argument must be a function.");
+
+        const Cells& cells = xs->cells;
+        std::vector<ValuePtr> results(cells.size());
+        parallelFor(e, cells.size(), [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                ValuePtr arg = eval(e, cells[i]);
+                results[i] = Ops::isError(arg) ? arg : apply(e, f, &arg, &arg + 1);
+                if ( !Ops::isError(results[i]) && results[i]->kind != Type::Integer ) {
+                    results[i] = Ops::makeError("if condition must return true or false.");
+                }
+                if ( Ops::isError(results[i]) ) break;
+            }
+        });
+        if ( auto error = firstError(results) ) return error;
+
+        ExpressionPtr ys(new Expression());
+        for (size_t i = 0; i < cells.size(); i++) {
+            if ( std::get<long>(results[i]->var) ) ys->insert(cells[i]);
+        }
+        return Ops::makeQExpression(ys);
+    }
+
+    /*
+     * preduce f z xs, as foldl f z xs for an associative f: each chunk is folded from its first
+     * element, then the results of the chunks are folded from z.
+     */
+    ValuePtr builtin_preduce(const EnvironmentPtr& e, const ValuePtr& a) {
+        ExpressionPtr xs;
+        if ( auto error = listArgument(a, 3, "preduce expects a function, initial value and list, preduce f z [x y ...].", xs) ) return error;
+        ExpressionPtr expression = std::get<ExpressionPtr>(a->var);
+        const ValuePtr& f = expression->cells[0];
+        if ( !isFunction(f) ) return Ops::makeError("preduce, first argument must be a function.");
+
+        const Cells& cells = xs->cells;
+        std::vector<ValuePtr> partials(cells.size()); /* the fold of a chunk is held at the chunk's first index. */
+        std::vector<ValuePtr> errors(cells.size());
+        parallelFor(e, cells.size(), [&](size_t begin, size_t end) {
+            ValuePtr args[2];
+            for (size_t i = begin; i < end; i++) {
+                args[1] = eval(e, cells[i]);
+                if ( Ops::isError(args[1]) ) { errors[i] = args[1]; return; }
+                if ( i == begin ) args[0] = args[1];
+                else args[0] = apply(e, f, args, args + 2);
+                if ( Ops::isError(args[0]) ) { errors[i] = args[0]; return; }
+            }
+            partials[begin] = args[0];
+        });
+        for (const auto& error: errors) {
+            if ( error != nullptr ) return error;
+        }
+
+        ValuePtr args[2] = { expression->cells[1], nullptr };
+        for (const auto& partial: partials) {
+            if ( partial == nullptr ) continue;
+            args[1] = partial;
+            args[0] = apply(e, f, args, args + 2);
+            if ( Ops::isError(args[0]) ) return args[0];
+        }
+        return args[0];
+    }
+
+    /*
+     * Define some primitive numerical operations, enough so that Prelude can boostrap more...
+     *
+     * Each operator is a kernel, a type whose apply folds x into the accumulator for each numeric
+     * representation. The reductions are templates on the kernel, so the operation is inlined into
+     * the loop over the cells. For a long, apply returns false if the result doesn't fit (or divide
+     * by zero), the reduction then continues with BigIntegers; for a double or BigInteger false is
+     * a failure (divide by zero).
+     */
+    struct Add {
+        static bool apply(long& acc, long x) { return Checked::add(acc, x, acc); }
+        static bool apply(double& acc, double x) { acc += x; return true; }
+        static bool apply(BigInteger& acc, const BigInteger& x) { acc = acc + x; return true; }
+    };
+
+    struct Subtract {
+        static bool apply(long& acc, long x) { return Checked::subtract(acc, x, acc); }
+        static bool apply(double& acc, double x) { acc -= x; return true; }
+        static bool apply(BigInteger& acc, const BigInteger& x) { acc = acc - x; return true; }
+    };
+
+    struct Multiply {
+        static bool apply(long& acc, long x) { return Checked::multiply(acc, x, acc); }
+        static bool apply(double& acc, double x) { acc *= x; return true; }
+        static bool apply(BigInteger& acc, const BigInteger& x) { acc = acc * x; return true; }
+    };
+
+    struct Divide {
+        static bool apply(long& acc, long x) {
+            if ( x == 0 || (x == -1 && acc == LONG_MIN) ) return false;
+            acc /= x;
+            return true;
+        }
+        static bool apply(double& acc, double x) {
+            if ( x == 0 ) return false;
+            acc /= x;
+            return true;
+        }
+        static bool apply(BigInteger& acc, const BigInteger& x) {
+            if ( x.isZero() ) return false;
+            acc = acc / x;
+            return true;
+        }
+    };
+
+    struct Min {
+        template<typename T> static bool apply(T& acc, const T& x) { if ( x < acc ) acc = x; return true; }
+        static bool apply(BigInteger& acc, const BigInteger& x) { if ( x.compare(acc) < 0 ) acc = x; return true; }
+    };
+
+    struct Max {
+        template<typename T> static bool apply(T& acc, const T& x) { if ( x > acc ) acc = x; return true; }
+        static bool apply(BigInteger& acc, const BigInteger& x) { if ( x.compare(acc) > 0 ) acc = x; return true; }
+    };
+
+    double toDouble(const ValuePtr& v) {
+        switch (v->kind) {
+            case Type::Integer:     return (double) std::get<long>(v->var);
+            case Type::BigInteger:  return std::get<BigIntegerPtr>(v->var)->toDouble();
+            default:                return std::get<double>(v->var);
+        }
+    }
+
+    BigInteger toBigInteger(const ValuePtr& v) {
+        if ( v->kind == Type::Integer ) return BigInteger(std::get<long>(v->var));
+        return *std::get<BigIntegerPtr>(v->var);
+    }
+
+    /*
+     * Sum a block of integer cells, if each is within +/- 2^56 the block's sum can't overflow, so it
+     * is summed by a loop the compiler can vectorise and added to acc with one checked add. Returns
+     * false, with acc unchanged, if the block needs the checked loop.
+     */
+    bool sumBlock(const ValuePtr* cells, size_t n, long& acc) {
+        constexpr size_t blockSize = 64;
+        constexpr unsigned long bound = 1UL << 56;
+        long block[blockSize];
+        for (size_t k = 0; k < n; k++) block[k] = std::get<long>(cells[k]->var);
+
+        /* summed unsigned, which wraps rather than overflows; the sum is only used if it fits. */
+        unsigned long large = 0;
+        unsigned long sum = 0;
+        for (size_t k = 0; k < n; k++) {
+            large |= (unsigned long) block[k] + bound > 2 * bound;
+            sum += (unsigned long) block[k];
+        }
+        return !large && Checked::add(acc, (long) sum, acc);
+    }
 
+    /*
+     * Reduce the integer cells from [i,n) into acc, stops at a BigInteger cell or when a result
+     * doesn't fit in a long; returns the index of the first cell not reduced.
+     */
+    template<typename Op>
+    size_t reduceIntegers(const Cells& cells, size_t i, long& acc) {
+        constexpr size_t blockSize = 64;
+        while ( i < cells.size() ) {
+            if constexpr ( std::is_same_v<Op, Add> ) {
+                size_t n = 0;
+                while ( n < blockSize && i + n < cells.size() && cells[i + n]->kind == Type::Integer ) n++;
+                if ( n > 1 && sumBlock(cells.begin() + i, n, acc) ) {
+                    i += n;
+                    continue;
+                }
+            }
+            if ( cells[i]->kind != Type::Integer || !Op::apply(acc, std::get<long>(cells[i]->var)) ) return i;
+            i++;
+        }
+        return i;
+    }
+
+    /*
+     * Reduce the cells, the result is a double if one of the cells is a double, else an integer held
+     * as a long while it fits.
+     */
+    template<typename Op>
+    ValuePtr reduce(const ValuePtr& vp, const char* failure) {
+        if ( !Ops::isExpression(vp) ) return Ops::makeError("runtime error, no cells to reduce");
         ExpressionPtr v = std::get<ExpressionPtr>(vp->var);
+        const Cells& cells = v->cells;
 
-        if (v->cells.empty()) {
+        if (cells.empty()) {
             return Ops::makeError("runtime error, no cells to reduce");
         }
 
+        /* The usual case, two integers. */
+        if ( cells.size() == 2 && cells[0]->kind == Type::Integer && cells[1]->kind == Type::Integer ) {
+            long acc = std::get<long>(cells[0]->var);
+            if ( Op::apply(acc, std::get<long>(cells[1]->var)) ) return Ops::makeInteger(acc);
+        }
+
         bool is_double = false;
-        for (const auto &c : v->cells) {
+        for (const auto &c : cells) {
             if (!Ops::isNumeric(c)) return Ops::makeError("runtime_error, +,-,/,* reduce non numeric.");
             if (c->kind == Type::Double) is_double = true;
         }
 
-        /* If we have a double then any integer value should be cast to double. */
-        std::variant<long, double> accumulator;
-
-        ValuePtr cell = v->cells[0];
+        /* If we have a double then any integer value is cast to double, the cells are reduced in order. */
         if ( is_double ) {
-            double cell_val =
-                    cell->kind == Type::Integer ? (double) std::get<long>(cell->var)
-                                                       : std::get<double>(cell->var);
-            accumulator =  cell_val;
+            double acc = toDouble(cells[0]);
+            for (size_t i = 1; i < cells.size(); i++) {
+                if ( !Op::apply(acc, toDouble(cells[i])) ) return Ops::makeError(failure);
+            }
+            return Ops::makeDouble(acc);
+        }
+
+        size_t i = 0;
+        long acc = 0;
+        if ( cells[0]->kind == Type::Integer ) {
+            acc = std::get<long>(cells[0]->var);
+            i = reduceIntegers<Op>(cells, 1, acc);
+            if ( i == cells.size() ) {
+                return Ops::makeInteger(acc);
+            }
+        }
+
+        /* Continue with BigIntegers, from the cell that didn't fit. */
+        BigInteger big = i == 0 ? toBigInteger(cells[0]) : BigInteger(acc);
+        for (i = std::max<size_t>(i, 1); i < cells.size(); i++) {
+            if ( !Op::apply(big, toBigInteger(cells[i])) ) return Ops::makeError(failure);
+        }
+        return Ops::makeBigInteger(std::move(big));
+    }
+
+    struct Less         { template<typename T> bool operator()(T a, T b) const { return a < b; } };
+    struct LessEqual    { template<typename T> bool operator()(T a, T b) const { return a <= b; } };
+    struct Greater      { template<typename T> bool operator()(T a, T b) const { return a > b; } };
+    struct GreaterEqual { template<typename T> bool operator()(T a, T b) const { return a >= b; } };
+
+    template<typename Cmp>
+    ValuePtr compare(const ValuePtr& a) {
+        if (! Ops::isExpression(a) ) return Ops::makeError("expected expression  'cmp a b'");
+        ExpressionPtr xs = std::get<ExpressionPtr>(a->var);
+        if ( xs->cells.size() != 2) return Ops::makeError("error cmp operator, expected 2 arguments.");
+
+        const ValuePtr& x = xs->cells[0];
+        const ValuePtr& y = xs->cells[1];
+        if ( !Ops::isNumeric(x) || !Ops::isNumeric(y) ) return Ops::makeError("error, cmp argument non-numeric.");
+
+        bool result;
+        if ( x->kind == Type::Integer && y->kind == Type::Integer ) {
+            result = Cmp()(std::get<long>(x->var), std::get<long>(y->var));
+        } else if ( x->kind == Type::Double || y->kind == Type::Double ) { /* cast any args to double. */
+            result = Cmp()(toDouble(x), toDouble(y));
         } else {
-            accumulator = std::get<long>(cell->var);
+            result = Cmp()(toBigInteger(x).compare(toBigInteger(y)), 0);
         }
+        return Ops::makeInteger(result ? 1 : 0);
+    }
 
-        for (int i = 1; i < v->cells.size(); i++) {
-            ValuePtr c= v->cells[i];
+    ValuePtr builtin_lt(const EnvironmentPtr&, const ValuePtr& v) { return compare<Less>(v); }
+    ValuePtr builtin_lte(const EnvironmentPtr&, const ValuePtr& v) { return compare<LessEqual>(v); }
+    ValuePtr builtin_gt(const EnvironmentPtr&, const ValuePtr& v) { return compare<Greater>(v); }
+    ValuePtr builtin_gte(const EnvironmentPtr&, const ValuePtr& v) { return compare<GreaterEqual>(v); }
 
-            try {
-                if (is_double) {
-                    double cell_val =
-                            c->kind == Type::Integer ? (double) std::get<long>(c->var) : std::get<double>(c->var);
-                    accumulator = (double) nop.g(std::get<double>(accumulator), cell_val);
-                } else {
-                    accumulator = nop.f(std::get<long>(accumulator), std::get<long>(c->var));
-                }
-            } catch ( const std::runtime_error& e) {
-                return Ops::makeError(e.what());
+
+    /* n.b. Builtin add/subtract don't act as unary operators. */
+    ValuePtr builtin_add(const EnvironmentPtr&, const ValuePtr& v) { return reduce<Add>(v, ""); }
+    ValuePtr builtin_subtract(const EnvironmentPtr&, const ValuePtr& v) { return reduce<Subtract>(v, ""); }
+    ValuePtr builtin_multiply(const EnvironmentPtr&, const ValuePtr& v) { return reduce<Multiply>(v, ""); }
+    ValuePtr builtin_divide(const EnvironmentPtr&, const ValuePtr& v) { return reduce<Divide>(v, "divide by zero."); }
+    ValuePtr builtin_min(const EnvironmentPtr&, const ValuePtr& v) { return reduce<Min>(v, ""); }
+    ValuePtr builtin_max(const EnvironmentPtr&, const ValuePtr& v) { return reduce<Max>(v, ""); }
+
+    /*
+     * Numeric vectors, vec makes a vector of its arguments (or of the numbers of a list) and the
+     * other builtins run the Simd kernels over the vectors' arrays. Integers stay exact, the sum of a
+     * vector of longs may be a BigInteger, an elementwise result that overflows a long is an error.
+     * An operation on a vector of longs and a vector of doubles is done on doubles.
+     */
+    ValuePtr vectorArguments(const ValuePtr& a, size_t count, const char* usage, std::vector<VectorPtr>& xs) {
+        if ( !Ops::isExpression(a) ) return Ops::makeError(usage);
+        const Cells& cells = std::get<ExpressionPtr>(a->var)->cells;
+        if ( cells.size() != count ) return Ops::makeError(usage);
+        for (const auto& c: cells) {
+            if ( c->kind != Type::Vector ) return Ops::makeError(usage);
+            xs.push_back(std::get<VectorPtr>(c->var));
+        }
+        return nullptr;
+    }
+
+    /* The elements of x as doubles, converted into 'storage' if x holds longs. */
+    const double* toDoubles(const Vector& x, std::vector<double>& storage) {
+        if ( x.isDouble() ) return x.doubles().data();
+        storage.assign(x.longs().begin(), x.longs().end());
+        return storage.data();
+    }
+
+    ValuePtr builtin_vec(const EnvironmentPtr&, const ValuePtr& a) {
+        if ( !Ops::isExpression(a) ) return Ops::makeError("vec expects numbers, vec x y ... or vec [x y ...].");
+        const Cells* cells = &std::get<ExpressionPtr>(a->var)->cells;
+        if ( cells->size() == 1 && (*cells)[0]->kind == Type::QExpression ) cells = &std::get<ExpressionPtr>((*cells)[0]->var)->cells;
+
+        bool is_double = false;
+        for (const auto& c: *cells) {
+            if ( c->kind != Type::Integer && c->kind != Type::Double ) {
+                return Ops::makeError("vec, elements must be integers that fit in a long or doubles.");
             }
+            if ( c->kind == Type::Double ) is_double = true;
         }
 
-        v->cells.resize(0); /* erase the cells, they've been evaluated. */
+        Vector v;
+        if ( is_double ) {
+            std::vector<double> xs;
+            xs.reserve(cells->size());
+            for (const auto& c: *cells) xs.push_back(toDouble(c));
+            v.elements = std::move(xs);
+        } else {
+            std::vector<long> xs;
+            xs.reserve(cells->size());
+            for (const auto& c: *cells) xs.push_back(std::get<long>(c->var));
+            v.elements = std::move(xs);
+        }
+        return Ops::makeVector(std::move(v));
+    }
 
-        if (is_double) return Ops::makeDouble(std::get<double>(accumulator));
-        return Ops::makeInteger(std::get<long>(accumulator));
+    ValuePtr builtin_vlist(const EnvironmentPtr&, const ValuePtr& a) {
+        std::vector<VectorPtr> xs;
+        if ( auto error = vectorArguments(a, 1, "vlist expects a vector, vlist v.", xs) ) return error;
+        ExpressionPtr ys(new Expression());
+        if ( xs[0]->isDouble() ) for (double x: xs[0]->doubles()) ys->insert(Ops::makeDouble(x));
+        else for (long x: xs[0]->longs()) ys->insert(Ops::makeInteger(x));
+        return Ops::makeQExpression(ys);
     }
 
-    using integer_cmp = std::function<bool(const long&, const long&)>;
-    using double_cmp  = std::function<bool(const double&, const double&)>;
+    ValuePtr builtin_vsum(const EnvironmentPtr&, const ValuePtr& a) {
+        std::vector<VectorPtr> xs;
+        if ( auto error = vectorArguments(a, 1, "vsum expects a vector, vsum v.", xs) ) return error;
+        const Vector& x = *xs[0];
+        if ( x.isDouble() ) return Ops::makeDouble(Simd::sum(x.doubles().data(), x.size()));
 
-    struct numeric_cmp { integer_op  f; double_op   g; };
+        Simd::LongSum s = Simd::sum(x.longs().data(), x.size());
+        long result;
+        if ( Checked::multiply(s.high, 1L << 32, result) && Checked::add(result, s.low, result) ) return Ops::makeInteger(result);
+        return Ops::makeBigInteger(BigInteger(s.high) * BigInteger(1L << 32) + BigInteger(s.low));
+    }
 
-    ValuePtr builtin_cmp(EnvironmentPtr, ValuePtr a, numeric_cmp op) {
-        if (! Ops::isExpression(a) ) return Ops::makeError("expected expression  'cmp a b'");
-        ExpressionPtr xs = std::get<ExpressionPtr>(a->var);
-        if ( xs->cells.size() != 2) return Ops::makeError("error cmp operator, expected 2 arguments.");
+    ValuePtr builtin_vdot(const EnvironmentPtr&, const ValuePtr& a) {
+        std::vector<VectorPtr> xs;
+        if ( auto error = vectorArguments(a, 2, "vdot expects two vectors, vdot v w.", xs) ) return error;
+        const Vector& x = *xs[0];
+        const Vector& y = *xs[1];
+        if ( x.size() != y.size() ) return Ops::makeError("vdot, vectors must be the same length.");
+
+        if ( x.isDouble() || y.isDouble() ) {
+            std::vector<double> u, w;
+            return Ops::makeDouble(Simd::dot(toDoubles(x, u), toDoubles(y, w), x.size()));
+        }
+
+        /* Integer products are checked, as (+ (* x y) ...) would be. */
+        long acc = 0;
+        size_t i = 0;
+        for (long p; i < x.size(); i++) {
+            if ( !Checked::multiply(x.longs()[i], y.longs()[i], p) || !Checked::add(acc, p, acc) ) break;
+        }
+        if ( i == x.size() ) return Ops::makeInteger(acc);
+        BigInteger big(acc);
+        for (; i < x.size(); i++) big = big + BigInteger(x.longs()[i]) * BigInteger(y.longs()[i]);
+        return Ops::makeBigInteger(std::move(big));
+    }
 
-        bool isDouble = false;
-        for (const auto& arg: xs->cells) {
-            if ( !Ops::isNumeric(arg) ) return Ops::makeError("error, cmp argument non-numeric.");
-            if ( arg->kind == Type::Double) isDouble = true;
+    template<bool Min>
+    ValuePtr vectorExtremum(const ValuePtr& a, const char* usage) {
+        std::vector<VectorPtr> xs;
+        if ( auto error = vectorArguments(a, 1, usage, xs) ) return error;
+        const Vector& x = *xs[0];
+        if ( x.size() == 0 ) return Ops::makeError("runtime error, no elements to reduce");
+        if ( x.isDouble() ) {
+            return Ops::makeDouble(Min ? Simd::min(x.doubles().data(), x.size()) : Simd::max(x.doubles().data(), x.size()));
         }
+        return Ops::makeInteger(Min ? Simd::min(x.longs().data(), x.size()) : Simd::max(x.longs().data(), x.size()));
+    }
 
-        bool result = false;
-        ValuePtr x = xs->cells[0];
-        ValuePtr y = xs->cells[1];
-        if (isDouble) {  /* one or more arguments is double, so cast any args to double. */
-            double fst = x->kind == Type::Integer ? (double) std::get<long>(x->var) : std::get<double>(x->var);
-            double snd = y->kind == Type::Integer ? (double) std::get<long>(y->var) : std::get<double>(y->var);
-            result = op.g(fst,snd);
+    ValuePtr builtin_vmin(const EnvironmentPtr&, const ValuePtr& a) { return vectorExtremum<true>(a, "vmin expects a vector, vmin v."); }
+    ValuePtr builtin_vmax(const EnvironmentPtr&, const ValuePtr& a) { return vectorExtremum<false>(a, "vmax expects a vector, vmax v."); }
+
+    template<typename Op>
+    ValuePtr elementwise(const ValuePtr& a, const char* usage, Op op) {
+        std::vector<VectorPtr> xs;
+        if ( auto error = vectorArguments(a, 2, usage, xs) ) return error;
+        const Vector& x = *xs[0];
+        const Vector& y = *xs[1];
+        if ( x.size() != y.size() ) return Ops::makeError("elementwise operation, vectors must be the same length.");
+
+        Vector r;
+        if ( x.isDouble() || y.isDouble() ) {
+            std::vector<double> u, w, result(x.size());
+            op(toDoubles(x, u), toDoubles(y, w), result.data(), x.size());
+            r.elements = std::move(result);
         } else {
-            long fst = std::get<long>(x->var);
-            long snd = std::get<long>(y->var);
-            result = op.f(fst,snd);
+            std::vector<long> result(x.size());
+            if ( !op(x.longs().data(), y.longs().data(), result.data(), x.size()) ) {
+                return Ops::makeError("elementwise operation, integer overflow (use a vector of doubles).");
+            }
+            r.elements = std::move(result);
         }
+        return Ops::makeVector(std::move(r));
+    }
 
-        return result ? Ops::makeInteger(1) : Ops::makeInteger(0);
+    ValuePtr builtin_vadd(const EnvironmentPtr&, const ValuePtr& a) {
+        return elementwise(a, "v+ expects two vectors, v+ v w.", [](const auto* x, const auto* y, auto* r, size_t n) { return Simd::add(x, y, r, n); });
     }
 
-    template<typename T> bool lt(const T& a, const T& b) { return a < b;}
-    template<typename T> bool lte(const T& a, const T& b) { return a <= b;}
-    template<typename T> bool gt(const T& a, const T& b) { return a > b;}
-    template<typename T> bool gte(const T& a, const T& b) { return a >= b;}
+    ValuePtr builtin_vmultiply(const EnvironmentPtr&, const ValuePtr& a) {
+        return elementwise(a, "v* expects two vectors, v* v w.", [](const auto* x, const auto* y, auto* r, size_t n) { return Simd::multiply(x, y, r, n); });
+    }
 
-    /* numeric only. */
-    template<typename T> bool eq(const T& a, const T& b) { return a == b;}
-    template<typename T> bool neq(const T& a, const T& b)  { return a != b; }
+    /* Apply a function to each element, the results must be numbers. */
+    ValuePtr builtin_vmap(const EnvironmentPtr& e, const ValuePtr& a) {
+        const char* usage = "vmap expects a function and a vector, vmap f v.";
+        if ( !Ops::isExpression(a) ) return Ops::makeError(usage);
+        const Cells& cells = std::get<ExpressionPtr>(a->var)->cells;
+        if ( cells.size() != 2 || !isFunction(cells[0]) || cells[1]->kind != Type::Vector ) return Ops::makeError(usage);
+        const ValuePtr& f = cells[0];
+        const Vector& x = *std::get<VectorPtr>(cells[1]->var);
+
+        ExpressionPtr ys(new Expression());
+        ValuePtr arg;
+        for (size_t i = 0; i < x.size(); i++) {
+            arg = x.isDouble() ? Ops::makeDouble(x.doubles()[i]) : Ops::makeInteger(x.longs()[i]);
+            ValuePtr y = apply(e, f, &arg, &arg + 1);
+            if ( Ops::isError(y) ) return y;
+            ys->insert(y);
+        }
+        return builtin_vec(e, Ops::makeSExpression(ys));
+    }
 
-    auto builtin_lt = [](EnvironmentPtr e, ValuePtr v) { return builtin_cmp(e,v, {lt<long>,lt<double>});};
-    auto builtin_lte = [](EnvironmentPtr e, ValuePtr v) { return builtin_cmp(e,v, {lte<long>,lte<double>});};
-    auto builtin_gt = [](EnvironmentPtr e, ValuePtr v) { return builtin_cmp(e,v, {gt<long>,gt<double>});};
-    auto builtin_gte = [](EnvironmentPtr e, ValuePtr v) { return builtin_cmp(e,v, {gte<long>,gte<double>});};
+    /*
+     * Hash maps, see map.h. map-put and map-del return a new map, the map passed is unchanged; each
+     * takes any number of keys (and values) so a map is copied once for several changes.
+     */
+    /* The map of the first argument and the arguments after it, of which every 'stride'th is a key. */
+    ValuePtr mapArguments(const ValuePtr& a, const char* usage, size_t stride, MapPtr& m, Cells& rest) {
+        if ( !Ops::isExpression(a) ) return Ops::makeError(usage);
+        const Cells& cells = std::get<ExpressionPtr>(a->var)->cells;
+        if ( cells.empty() || cells[0]->kind != Type::Map ) return Ops::makeError(usage);
+        m = std::get<MapPtr>(cells[0]->var);
+        rest = cells.drop(1);
+        for (size_t k = 0; k < rest.size(); k += stride) {
+            if ( !HashMap::isKey(rest[k]) ) return Ops::makeError("map keys must be strings, symbols or numbers.");
+        }
+        return nullptr;
+    }
 
+    /* map-get m k, or map-get m k default; the value of k in m, the default (else an error) if k isn't in m. */
+    ValuePtr builtin_map_get(const EnvironmentPtr&, const ValuePtr& a) {
+        const char* usage = "map-get expects a map, a key and an optional default, map-get m k.";
+        MapPtr m;
+        Cells rest;
+        if ( auto error = mapArguments(a, usage, 2, m, rest) ) return error;
+        if ( rest.size() != 1 && rest.size() != 2 ) return Ops::makeError(usage);
+
+        if ( ValuePtr value = m->find(rest[0]) ) return value;
+        if ( rest.size() == 2 ) return rest[1];
+        std::ostringstream os;
+        os << rest[0];
+        return Ops::makeError(fmt::format("map-get, key not found: {}", os.str()));
+    }
 
-    /* n.b. Builtin add/subtract don't act as unary operators. */
-    auto builtin_add = [](EnvironmentPtr e, ValuePtr v)      {
-        return builtin_op(e,v, { add<long>, add<double> });
-    };
+    ValuePtr builtin_map_put(const EnvironmentPtr&, const ValuePtr& a) {
+        const char* usage = "map-put expects a map followed by keys and values, map-put m k v ...";
+        MapPtr m;
+        Cells rest;
+        if ( auto error = mapArguments(a, usage, 2, m, rest) ) return error;
+        if ( rest.empty() || rest.size() % 2 != 0 ) return Ops::makeError(usage);
 
-    auto builtin_subtract = [](EnvironmentPtr e, ValuePtr v) {
-        return builtin_op(e,v, { subtract<long>, subtract<double> });
-    };
+        HashMap copy = *m;
+        for (size_t k = 0; k < rest.size(); k += 2) copy.put(rest[k], rest[k + 1]);
+        return Ops::makeMap(std::move(copy));
+    }
+
+    ValuePtr builtin_map_del(const EnvironmentPtr&, const ValuePtr& a) {
+        const char* usage = "map-del expects a map followed by keys, map-del m k ...";
+        MapPtr m;
+        Cells rest;
+        if ( auto error = mapArguments(a, usage, 1, m, rest) ) return error;
+
+        HashMap copy = *m;
+        for (const auto& key: rest) copy.erase(key);
+        return Ops::makeMap(std::move(copy));
+    }
 
-    auto builtin_divide = [](EnvironmentPtr e, ValuePtr v)   { return builtin_op(e,v, { divide<long>, divide<double> }); };
-    auto builtin_multiply = [](EnvironmentPtr e, ValuePtr v) { return builtin_op(e,v, { multiply<long>, multiply<double> }); };
+    /* map-keys m, the keys in the order they were added. */
+    ValuePtr builtin_map_keys(const EnvironmentPtr&, const ValuePtr& a) {
+        const char* usage = "map-keys expects a map, map-keys m.";
+        MapPtr m;
+        Cells rest;
+        if ( auto error = mapArguments(a, usage, 1, m, rest) ) return error;
+        if ( !rest.empty() ) return Ops::makeError(usage);
 
-    bool equals(ValuePtr a, ValuePtr b) {
+        ExpressionPtr xs(new Expression());
+        for (const auto& entry: m->entries()) {
+            if ( entry.key ) xs->insert(entry.key);
+        }
+        return Ops::makeQExpression(xs);
+    }
+
+    bool equalMaps(const HashMap& x, const HashMap& y) {
+        if ( x.size() != y.size() ) return false;
+        for (const auto& entry: x.entries()) {
+            if ( !entry.key ) continue;
+            ValuePtr value = y.find(entry.key);
+            if ( !value || !equals(entry.value, value) ) return false;
+        }
+        return true;
+    }
+
+    bool equalVectors(const Vector& x, const Vector& y) {
+        if ( x.size() != y.size() ) return false;
+        if ( !x.isDouble() && !y.isDouble() ) return x.longs() == y.longs();
+        std::vector<double> u, w;
+        const double* xs = toDoubles(x, u);
+        return std::equal(xs, xs + x.size(), toDoubles(y, w));
+    }
+
+    bool equals(const ValuePtr& a, const ValuePtr& b) {
         /*
          * For numeric types, check if they are numerically the same.
          * So, cast from long to double if necessary.
          */
         if (Ops::isNumeric(a) && Ops::isNumeric(b)) {
             if (a->kind == Type::Double || b->kind == Type::Double) {
-               double v1 = a->kind == Type::Integer ? (double) std::get<long>(a->var) : std::get<double>(a->var);
-               double v2 = b->kind == Type::Integer ? (double) std::get<long>(b->var) : std::get<double>(b->var);
-               return v1 == v2;
+               return toDouble(a) == toDouble(b);
+            } else if (a->kind == Type::BigInteger || b->kind == Type::BigInteger) {
+                return toBigInteger(a).compare(toBigInteger(b)) == 0;
             } else {
                 long v1 = std::get<long>(a->var);
                 long v2 = std::get<long>(b->var);
@@ -314,10 +878,12 @@ namespace Inky::Lisp {
            }
            case Type::Integer:
            case Type::Double:
+           case Type::BigInteger:
                 return true; /* Case dealt with above, added to avoid compiler warning. */
            case Type::String:
-           case Type::Symbol:
                return std::get<std::string>(a->var) == std::get<std::string>(b->var);
+           case Type::Symbol:
+               return std::get<Symbol>(a->var) == std::get<Symbol>(b->var);
            case Type::BuiltinFunction:
                return false; /* change this to check the address.*/
            case Type::Function: {
@@ -325,13 +891,17 @@ namespace Inky::Lisp {
                LambdaPtr ys = std::get<LambdaPtr>(b->var);
                return equals(xs->formals,ys->formals) && equals(xs->body, ys->body);
            }
+           case Type::Vector:
+               return equalVectors(*std::get<VectorPtr>(a->var), *std::get<VectorPtr>(b->var));
+           case Type::Map:
+               return equalMaps(*std::get<MapPtr>(a->var), *std::get<MapPtr>(b->var));
            case Type::SExpression:
            case Type::QExpression: {
                ExpressionPtr xs = std::get<ExpressionPtr>(a->var);
                ExpressionPtr ys = std::get<ExpressionPtr>(b->var);
                if (xs->cells.size() != ys->cells.size()) return false;
                for (size_t i = 0; i < xs->cells.size(); i++) {
-                   if (!equals(xs->cells[0], ys->cells[0])) return false;
+                   if (!equals(xs->cells[i], ys->cells[i])) return false;
                }
                return true;
            }
@@ -341,32 +911,107 @@ namespace Inky::Lisp {
     }
 
 
-    bool notEquals(ValuePtr a, ValuePtr b) { return ! equals(a,b); }
+    bool notEquals(const ValuePtr& a, const ValuePtr& b) { return ! equals(a,b); }
+
+    /*
+     * Numbers that are equal compare equal as doubles, so every number is hashed as a double (large
+     * integers that differ only beyond a double's precision collide).
+     */
+    size_t hashDouble(double d) { return d == 0 ? 0 : std::hash<double>()(d); /* 0.0 == -0.0 */ }
+
+    size_t hash(const ValuePtr& v) {
+        auto combine = [](size_t h, size_t x) { return h ^ (x + 0x9e3779b97f4a7c15 + (h << 6) + (h >> 2)); };
+
+        switch (v->kind) {
+            case Type::Integer:
+            case Type::Double:
+            case Type::BigInteger:
+                return hashDouble(toDouble(v));
+            case Type::Error:
+                return std::hash<std::string>()(std::get<LispErrorPtr>(v->var)->message);
+            case Type::String:
+                return std::hash<std::string>()(std::get<std::string>(v->var));
+            case Type::Symbol:
+                return SymbolHash()(std::get<Symbol>(v->var));
+            case Type::BuiltinFunction:
+                return 0; /* builtins are never equal. */
+            case Type::Function: {
+                LambdaPtr fn = std::get<LambdaPtr>(v->var);
+                return combine(hash(fn->formals), hash(fn->body));
+            }
+            case Type::SExpression:
+            case Type::QExpression: {
+                size_t h = (size_t) v->kind;
+                for (const auto& c: std::get<ExpressionPtr>(v->var)->cells) h = combine(h, hash(c));
+                return h;
+            }
+            case Type::Vector: {
+                size_t h = (size_t) v->kind;
+                std::visit([&](const auto& xs) { for (auto x: xs) h = combine(h, hashDouble((double) x)); },
+                           std::get<VectorPtr>(v->var)->elements);
+                return h;
+            }
+            case Type::Map: { /* independent of the order of the entries, as equality is. */
+                size_t h = (size_t) v->kind;
+                for (const auto& entry: std::get<MapPtr>(v->var)->entries()) {
+                    if ( entry.key ) h += combine(entry.hash, hash(entry.value));
+                }
+                return h;
+            }
+        }
+        return 0;
+    }
+
 
-    ValuePtr builtin_eq(EnvironmentPtr e, ValuePtr a) {
+    ValuePtr builtin_eq(const EnvironmentPtr& e, const ValuePtr& a) {
         if ( !Ops::isExpression(a) ) return Ops::makeError("eq expecting an expression.");
         ExpressionPtr xs = std::get<ExpressionPtr>(a->var);
         if ( xs->cells.size() != 2) return Ops::makeError("eq operator expecting two arguments.");
 
-        ValuePtr x = xs->cells[0];
-        ValuePtr y = xs->cells[1];
+        const ValuePtr& x = xs->cells[0];
+        const ValuePtr& y = xs->cells[1];
 
         return  equals(x,y) ? Ops::makeInteger(1) : Ops::makeInteger(0);
     }
 
-    ValuePtr builtin_neq (EnvironmentPtr e, ValuePtr a) {
+    ValuePtr builtin_neq (const EnvironmentPtr& e, const ValuePtr& a) {
         if ( !Ops::isExpression(a) ) return Ops::makeError("neq expecting an expression.");
         ExpressionPtr xs = std::get<ExpressionPtr>(a->var);
         if ( xs->cells.size() != 2) return Ops::makeError("neq operator expecting two arguments.");
 
-        ValuePtr x = xs->cells[0];
-        ValuePtr y = xs->cells[1];
+        const ValuePtr& x = xs->cells[0];
+        const ValuePtr& y = xs->cells[1];
 
         return  notEquals(x,y) ? Ops::makeInteger(1) : Ops::makeInteger(0);
     }
 
+    /* memoize f, or memoize f capacity; a function that caches the results of f, see memo.h. */
+    ValuePtr builtin_memoize(const EnvironmentPtr&, const ValuePtr& a) {
+        const char* usage = "memoize expects a function and an optional capacity, memoize f or memoize f n.";
+        if ( !Ops::isExpression(a) ) return Ops::makeError(usage);
+        const Cells& cells = std::get<ExpressionPtr>(a->var)->cells;
+        if ( cells.empty() || cells.size() > 2 || !isFunction(cells[0]) ) return Ops::makeError(usage);
+        if ( cells.size() == 1 ) return memoize(cells[0]);
+        if ( cells[1]->kind != Type::Integer || std::get<long>(cells[1]->var) <= 0 ) return Ops::makeError(usage);
+        return memoize(cells[0], std::get<long>(cells[1]->var));
+    }
+
+    /* memo-stats f, the hits, misses, size & capacity of a memoized function's cache. */
+    ValuePtr builtin_memo_stats(const EnvironmentPtr&, const ValuePtr& a) {
+        const char* usage = "memo-stats expects a memoized function, memo-stats f.";
+        if ( !Ops::isExpression(a) ) return Ops::makeError(usage);
+        const Cells& cells = std::get<ExpressionPtr>(a->var)->cells;
+        MemoPtr memo = cells.size() == 1 ? memoOf(cells[0]) : nullptr;
+        if ( memo == nullptr ) return Ops::makeError(usage);
+
+        Memo::Stats stats = memo->stats();
+        ExpressionPtr xs(new Expression());
+        for (size_t x: { stats.hits, stats.misses, stats.size, stats.capacity }) xs->insert(Ops::makeInteger(x));
+        return Ops::makeQExpression(xs);
+    }
+
     /* If. */
-    ValuePtr builtin_if(EnvironmentPtr e, ValuePtr v) {
+    ValuePtr builtin_if(const EnvironmentPtr& e, const ValuePtr& v) {
         if ( !Ops::isExpression(v) ) return Ops::makeError("if statement not of form 'if (exp) [exp1] [exp2]'");
         ExpressionPtr xs = std::get<ExpressionPtr>(v->var);
         if ( xs->cells.size() != 3) return Ops::makeError(" if statement missing argument.");
@@ -377,17 +1022,14 @@ namespace Inky::Lisp {
 
         if (cond->kind != Type::Integer) return Ops::makeError("if condition must return true or false.");
 
-        /* Now set them to SExpression for eval. */
-        exp1->kind = Type::SExpression;
-        exp2->kind = Type::SExpression;
-
+        /* Evaluate the branch taken as an SExpression. */
         long result = std::get<long>(cond->var);
-        if (result) return eval(e,exp1);
-        else return eval(e,exp2);
+        if (result) return evalExpression(e,exp1);
+        else return evalExpression(e,exp2);
     }
 
     /* Error function. */
-    ValuePtr builtin_error(EnvironmentPtr , ValuePtr v) {
+    ValuePtr builtin_error(const EnvironmentPtr& , const ValuePtr& v) {
         if (!Ops::isExpression(v)) return Ops::makeError("error function must be passed a string literal expression.");
         ExpressionPtr xs = std::get<ExpressionPtr>(v->var);
         if ( xs->cells.size() != 1) return Ops::makeError("error function expects a single argument.");
@@ -396,32 +1038,90 @@ namespace Inky::Lisp {
         return Ops::makeError( std::get<std::string>(xs->cells[0]->var) );
     }
 
-    void addBuiltinFunctions(EnvironmentPtr env) {
-        std::initializer_list<std::pair<std::string,BuiltinFunction>> builtins = {
-                { "lambda", builtin_lambda},
-                { "define", builtin_def},
-                { "def", builtin_def},
-                {"=",builtin_put},
-                {"\\", builtin_lambda},
-                { "list", builtin_list },
-                { "head", builtin_head},
-                {"tail", builtin_tail},
-                { "eval", builtin_eval},
-                {"join", builtin_join},
-                { "+",builtin_add},
-                { "-",builtin_subtract},
-                { "/",builtin_divide},
-                {"*",builtin_multiply},
-                {"<",builtin_lt},
-                {"<=",builtin_lte},
-                { ">",builtin_gt},
-                {">=",builtin_gte},
-                {"==",builtin_eq},
-                {"!=",builtin_neq},
-                {"if",builtin_if},
-                {"error",builtin_error}
-        };
+    /* load "file", evaluates the forms of a file, see loadFile. */
+    ValuePtr builtin_load(const EnvironmentPtr& e, const ValuePtr& v) {
+        if (!Ops::isExpression(v)) return Ops::makeError("load function must be passed a file name.");
+        ExpressionPtr xs = std::get<ExpressionPtr>(v->var);
+        if ( xs->cells.size() != 1) return Ops::makeError("load function expects a single argument.");
+        if ( xs->cells[0]->kind != Type::String ) return Ops::makeError("load function argument does not evaluate to string.");
+
+        return loadFile(e, std::get<std::string>(xs->cells[0]->var), eval);
+    }
+
+    bool isBuiltin(const ValuePtr& v, Primitive p) {
+        if ( v->kind != Type::BuiltinFunction ) return false;
+        auto target = std::get<BuiltinFunction>(v->var).target<Primitive>();
+        return target != nullptr && *target == p;
+    }
 
+    /* The builtin functions, by name. */
+    const std::pair<const char*, Primitive> builtins[] = {
+            { "lambda", builtin_lambda},
+            { "define", builtin_def},
+            { "def", builtin_def},
+            {"=",builtin_put},
+            {"\\", builtin_lambda},
+            { "list", builtin_list },
+            { "head", builtin_head},
+            {"tail", builtin_tail},
+            { "eval", builtin_eval},
+            {"join", builtin_join},
+            { "len", builtin_len},
+            { "fst", builtin_fst},
+            { "drop", builtin_drop},
+            { "foldl", builtin_foldl},
+            { "map", builtin_map},
+            { "filter", builtin_filter},
+            { "pmap", builtin_pmap},
+            { "pfilter", builtin_pfilter},
+            { "preduce", builtin_preduce},
+            { "+",builtin_add},
+            { "-",builtin_subtract},
+            { "/",builtin_divide},
+            {"*",builtin_multiply},
+            {"<",builtin_lt},
+            {"<=",builtin_lte},
+            { ">",builtin_gt},
+            {">=",builtin_gte},
+            {"==",builtin_eq},
+            {"!=",builtin_neq},
+            {"min",builtin_min},
+            {"max",builtin_max},
+            {"vec",builtin_vec},
+            {"vlist",builtin_vlist},
+            {"vsum",builtin_vsum},
+            {"vdot",builtin_vdot},
+            {"vmin",builtin_vmin},
+            {"vmax",builtin_vmax},
+            {"v+",builtin_vadd},
+            {"v*",builtin_vmultiply},
+            {"vmap",builtin_vmap},
+            {"memoize",builtin_memoize},
+            {"memo-stats",builtin_memo_stats},
+            {"map-get",builtin_map_get},
+            {"map-put",builtin_map_put},
+            {"map-del",builtin_map_del},
+            {"map-keys",builtin_map_keys},
+            {"if",builtin_if},
+            {"error",builtin_error},
+            {"load",builtin_load}
+    };
+
+    const char* builtinName(const ValuePtr& v) {
+        for (const auto& kv: builtins ) {
+            if ( isBuiltin(v, kv.second) ) return kv.first;
+        }
+        return nullptr;
+    }
+
+    ValuePtr makeBuiltin(std::string_view name) {
+        for (const auto& kv: builtins ) {
+            if ( name == kv.first ) return Ops::makeBuiltin(kv.second);
+        }
+        return nullptr;
+    }
+
+    void addBuiltinFunctions(EnvironmentPtr env) {
         for (const auto& kv: builtins ) {
             env->insert(kv.first, Ops::makeBuiltin(kv.second));
         }
@@ -7,4 +7,41 @@ namespace Inky::Lisp {
 
     void addBuiltinFunctions(EnvironmentPtr env);
 
-}
\ No newline at end of file
+    /* A builtin implemented by a plain function. */
+    typedef ValuePtr (*Primitive)(const EnvironmentPtr&, const ValuePtr&);
+
+    /* True if the value is the builtin function implemented by 'p'. */
+    bool isBuiltin(const ValuePtr& v, Primitive p);
+
+    /* The name of the builtin function 'v', nullptr if it isn't one of the builtins (images re-link builtins by name). */
+    const char* builtinName(const ValuePtr& v);
+
+    /* A new value for the builtin function registered as 'name', nullptr if there is none. */
+    ValuePtr makeBuiltin(std::string_view name);
+
+    /* 'v' as it is bound to 'name' by def: an anonymous lambda becomes a copy named 'name', for the profiler. */
+    ValuePtr nameFunction(const ValuePtr& v, Symbol name);
+
+    /* Structural equality, as ==; and a hash consistent with it, equal values have equal hashes. */
+    bool equals(const ValuePtr& a, const ValuePtr& b);
+    size_t hash(const ValuePtr& v);
+
+    /*
+     * Primitive numeric builtins, exposed so that the bytecode VM can recognise them
+     * when they are bound to a call site and use its dedicated instructions instead.
+     */
+    ValuePtr builtin_add(const EnvironmentPtr& e, const ValuePtr& v);
+    ValuePtr builtin_subtract(const EnvironmentPtr& e, const ValuePtr& v);
+    ValuePtr builtin_multiply(const EnvironmentPtr& e, const ValuePtr& v);
+    ValuePtr builtin_divide(const EnvironmentPtr& e, const ValuePtr& v);
+    ValuePtr builtin_lt(const EnvironmentPtr& e, const ValuePtr& v);
+    ValuePtr builtin_lte(const EnvironmentPtr& e, const ValuePtr& v);
+    ValuePtr builtin_gt(const EnvironmentPtr& e, const ValuePtr& v);
+    ValuePtr builtin_gte(const EnvironmentPtr& e, const ValuePtr& v);
+    ValuePtr builtin_eq(const EnvironmentPtr& e, const ValuePtr& v);
+    ValuePtr builtin_neq(const EnvironmentPtr& e, const ValuePtr& v);
+
+    /* 'if', recognised by the evaluators so that the branch taken is evaluated as a tail call. */
+    ValuePtr builtin_if(const EnvironmentPtr& e, const ValuePtr& v);
+
+}
@@ -0,0 +1,331 @@
+#include <fmt/core.h>
+
+#include "compiler.h"
+#include "environment.h"
+#include "value.h"
+
+
+namespace Inky::Lisp {
+
+    /*
+     * Lowers a parsed expression into bytecode for the VM. The compiler follows the evaluation rules
+     * of Eval::evalSExpression: special forms are recognised by symbol name, 'if', 'lambda' and
+     * 'def' are given dedicated instructions when they have their usual shape, anything unusual
+     * (e.g. extra arguments) is compiled as a plain application so that the builtin produces the
+     * same result, or error, as the tree walking evaluator.
+     *
+     * When compiling a lambda body, symbols naming one of the formals are resolved to a slot of the
+     * lambda's frame. Other symbols are looked up by name at runtime: inky is dynamically scoped, a
+     * free variable of a lambda is found in the environment of its caller, so only the lambda's own
+     * frame can be addressed statically.
+     */
+    class Compiler {
+    public:
+        explicit Compiler(SlotNames names = nullptr) : code(std::make_shared<Code>()), layout(names) {}
+        ~Compiler() = default;
+
+        CodePtr compileForm(ValuePtr v) {
+            compile(v);
+            emitReturn();
+            return code;
+        }
+
+        CodePtr compileBody(ValuePtr body) {
+            compileSubExpression(body);
+            emitReturn();
+            return code;
+        }
+
+    private:
+
+        void compile(ValuePtr v) {
+            switch (v->kind) {
+                case Type::Symbol: {
+                    int index = slot(std::get<Symbol>(v->var));
+                    if ( index >= 0 ) emit(OpCode::LoadLocal, index, constant(v));
+                    else emit(OpCode::Load, constant(v));
+                    break;
+                }
+
+                case Type::SExpression:
+                    compileExpression(v);
+                    break;
+
+                case Type::Error:
+                case Type::Integer:
+                case Type::Double:
+                case Type::BigInteger:
+                case Type::Vector:
+                case Type::Map:
+                case Type::String:
+                case Type::QExpression:
+                case Type::BuiltinFunction:
+                case Type::Function:
+                    emit(OpCode::Constant, constant(v));
+                    break;
+            }
+        }
+
+        /* Lambda bodies and the branches of 'if' are evaluated as S-Expressions, whatever their kind. */
+        void compileSubExpression(ValuePtr v) {
+            if (Ops::isExpression(v)) compileExpression(v);
+            else compile(v);
+        }
+
+        /* An expression optimized by the optimizer, its reduction while it holds or else its cells. */
+        void compileExpression(ValuePtr v) {
+            ExpressionPtr xs = std::get<ExpressionPtr>(v->var);
+            if ( xs->reduction == nullptr ) {
+                compileCells(xs->cells);
+                return;
+            }
+            size_t jumpToCells = emit(OpCode::Optimized, constant(v));
+            compileSubExpression(xs->reduction->value);
+            size_t jumpToEnd = emit(OpCode::Jump);
+            code->instructions[jumpToCells].b = code->instructions.size();
+            compileCells(xs->cells);
+            code->instructions[jumpToEnd].a = code->instructions.size();
+        }
+
+        void compileCells(const Cells& cells) {
+            if ( cells.empty() ) {
+                emit(OpCode::Constant, constant(Ops::makeSExpression()));
+                return;
+            }
+            if ( cells.size() == 1 ) {
+                compile(cells[0]);
+                return;
+            }
+
+            ValuePtr head = cells[0];
+            if ( isIf(head) && cells.size() == 4 ) {
+                compileIf(cells);
+                return;
+            }
+            if ( isLambda(head) && cells.size() == 3 && isFormals(cells[1]) ) {
+                emit(OpCode::Lambda, constant(prototype(cells[1], cells[2])));
+                return;
+            }
+            if ( isDefine(head) && cells.size() >= 3 ) {
+                ValuePtr symbols = quote(cells[1]);
+                ExpressionPtr xs = std::get<ExpressionPtr>(symbols->var);
+                if ( xs->cells.size() == cells.size() - 2 && isFormals(symbols) ) {
+                    for (size_t k = 2; k < cells.size(); k++) compile(cells[k]);
+                    bool global = !Ops::isSymbol(head, Symbols::Assign);
+                    emit(global ? OpCode::Define : OpCode::Put, xs->cells.size(), constant(symbols));
+                    return;
+                }
+            }
+
+            /* General case, reduce each cell (skipping the arguments of special forms) then apply. */
+            uint32_t count = 0;
+            size_t k = 0;
+            while ( k < cells.size() ) {
+                ValuePtr cell = cells[k];
+                if ( Ops::isSymbol(cell, Symbols::Defun) || Ops::isSymbol(cell, Symbols::Defmemo) ) {
+                    if ( !compileDefun(cells, k) ) return;
+                    k += 3;
+                    count += 1;
+                }
+                else if ( isLambda(cell) ) {
+                    emit(OpCode::Load, constant(cell));
+                    if ( k + 2 >= cells.size() ) {
+                        fail("lambda definition must contain formals and body.");
+                        return;
+                    }
+                    emit(OpCode::Constant, constant(cells[k+1]));
+                    emit(OpCode::Constant, constant(cells[k+2]));
+                    k += 3;
+                    count += 3;
+                }
+                else if ( isDefine(cell) ) {
+                    emit(OpCode::Load, constant(cell));
+                    if ( k + 2 >= cells.size() ) {
+                        fail("define must have two arguments.");
+                        return;
+                    }
+                    emit(OpCode::Constant, constant(quote(cells[k+1])));
+                    k += 2;
+                    count += 2;
+                }
+                else if ( isIf(cell) ) {
+                    emit(OpCode::Load, constant(cell));
+                    if ( k + 3 >= cells.size() ) {
+                        fail("if statement must be of form if (condition) (then) (else).");
+                        return;
+                    }
+                    compile(cells[k+1]);
+                    emit(OpCode::Constant, constant(cells[k+2]));
+                    emit(OpCode::Constant, constant(cells[k+3]));
+                    k += 4;
+                    count += 4;
+                }
+                else {
+                    if ( k == 0 ) compileHead(cell);
+                    else compile(cell);
+                    k += 1;
+                    count += 1;
+                }
+            }
+
+            emit(primitive(head), count);
+        }
+
+        /* The head of a call, a symbol that isn't one of the formals is looked up through an inline cache. */
+        void compileHead(ValuePtr v) {
+            if ( v->kind != Type::Symbol || slot(std::get<Symbol>(v->var)) >= 0 ) {
+                compile(v);
+                return;
+            }
+            code->caches.emplace_back();
+            emit(OpCode::Load, constant(v), code->caches.size());
+        }
+
+        /* if (condition) (then) (else) */
+        void compileIf(const Cells& cells) {
+            compile(cells[1]);
+            size_t jumpToElse = emit(OpCode::JumpIfFalse);
+            compileSubExpression(cells[2]);
+            size_t jumpToEnd = emit(OpCode::Jump);
+            code->instructions[jumpToElse].a = code->instructions.size();
+            compileSubExpression(cells[3]);
+            code->instructions[jumpToEnd].a = code->instructions.size();
+        }
+
+        /* defun (foo x y) (+ x y) => define (foo) (lambda (x y) (+ x y)), as defmemo with the memoized lambda. */
+        bool compileDefun(const Cells& cells, size_t k) {
+            if ( k + 2 >= cells.size() ) {
+                fail("defun must contain formals and body arguments.");
+                return false;
+            }
+
+            ValuePtr formals = cells[k+1];
+            if ( !Ops::isExpression(formals) ) {
+                fail("formals to defun should be expression.");
+                return false;
+            }
+            ExpressionPtr xs = std::get<ExpressionPtr>(formals->var);
+            if ( xs->cells.size() < 2 ) {
+                fail("function must have name and at least one argument.");
+                return false;
+            }
+            ValuePtr name = xs->cells[0];
+            if ( name->kind != Type::Symbol ) {
+                fail("function name must be a symbol.");
+                return false;
+            }
+
+            /* The parsed formals are left untouched, the lambda gets a copy without the function name. */
+            ExpressionPtr args = std::make_shared<Expression>(Expression());
+            args->cells = xs->cells.drop(1);
+            ValuePtr argsValue = std::make_shared<Value>(Value { formals->kind, args });
+
+            OpCode op = Ops::isSymbol(cells[k], Symbols::Defmemo) ? OpCode::Defmemo : OpCode::Defun;
+            emit(op, constant(prototype(argsValue, cells[k+2], std::get<Symbol>(name->var))), constant(name));
+            return true;
+        }
+
+        /*
+         * A prototype holds the formals, body and compiled code of a lambda expression; each time the
+         * expression is evaluated a new instance (with its own environment) is created from it.
+         */
+        static ValuePtr prototype(ValuePtr formals, ValuePtr body, Symbol name = Symbols::Lambda) {
+            LambdaPtr lambda = std::make_shared<Lambda>(Lambda{ formals, body, makeFrame(formals), nullptr, name });
+            lambda->code = compileLambda(lambda);
+            return Ops::makeFunction(lambda);
+        }
+
+        /* def (x y) 1 2, def [x y] 1 2 and def x 1 are equivalent. */
+        static ValuePtr quote(ValuePtr v) {
+            if ( v->kind == Type::QExpression ) return v;
+            if ( v->kind == Type::SExpression ) return Ops::makeQExpression(std::get<ExpressionPtr>(v->var));
+            ExpressionPtr ys(new Expression());
+            ys->insert(v);
+            return Ops::makeQExpression(ys);
+        }
+
+        static bool isFormals(ValuePtr v) {
+            if ( !Ops::isExpression(v) ) return false;
+            for (const auto& c: std::get<ExpressionPtr>(v->var)->cells) {
+                if ( c->kind != Type::Symbol ) return false;
+            }
+            return true;
+        }
+
+        static bool isIf(ValuePtr v) { return Ops::isSymbol(v, Symbols::If); }
+
+        static bool isLambda(ValuePtr v) { return Ops::isSymbol(v, Symbols::Lambda) || Ops::isSymbol(v, Symbols::Backslash); }
+
+        static bool isDefine(ValuePtr v) {
+            return Ops::isSymbol(v, Symbols::Def) || Ops::isSymbol(v, Symbols::Define) || Ops::isSymbol(v, Symbols::Assign);
+        }
+
+        /* Calls whose head names an arithmetic or comparison builtin get the primitive instruction. */
+        static OpCode primitive(ValuePtr head) {
+            static const std::pair<Symbol, OpCode> primitives[] = {
+                    { intern("+"), OpCode::Add }, { intern("-"), OpCode::Subtract }, { intern("*"), OpCode::Multiply },
+                    { intern("/"), OpCode::Divide }, { intern("<"), OpCode::Less }, { intern("<="), OpCode::LessEqual },
+                    { intern(">"), OpCode::Greater }, { intern(">="), OpCode::GreaterEqual }, { intern("=="), OpCode::Equal },
+                    { intern("!="), OpCode::NotEqual }
+            };
+            for (const auto& [name, op]: primitives) {
+                if ( Ops::isSymbol(head, name) ) return op;
+            }
+            return OpCode::Apply;
+        }
+
+        /* Returns the slot of the frame holding the named formal, or -1. */
+        int slot(Symbol name) const {
+            if ( layout == nullptr ) return -1;
+            for (size_t k = 0; k < layout->size(); k++) {
+                if ( (*layout)[k] == name ) return k;
+            }
+            return -1;
+        }
+
+        /*
+         * A jump to a Return is replaced by a Return, so that a call at the end of a branch of 'if'
+         * is followed by a Return and the VM treats it as a tail call. Jumps only go forward, so
+         * working backwards resolves jumps to jumps to a Return.
+         */
+        void emitReturn() {
+            emit(OpCode::Return);
+            auto& instructions = code->instructions;
+            for (size_t k = instructions.size(); k-- > 0; ) {
+                if ( instructions[k].op == OpCode::Jump && instructions[instructions[k].a].op == OpCode::Return ) {
+                    instructions[k] = Instruction { OpCode::Return, 0, 0 };
+                }
+            }
+        }
+
+        void fail(const std::string& message) {
+            emit(OpCode::Fail, constant(Ops::makeError(message)));
+        }
+
+        uint32_t constant(ValuePtr v) {
+            code->constants.push_back(v);
+            return code->constants.size() - 1;
+        }
+
+        size_t emit(OpCode op, uint32_t a = 0, uint32_t b = 0) {
+            code->instructions.push_back(Instruction { op, a, b });
+            return code->instructions.size() - 1;
+        }
+
+    private:
+        CodePtr     code;
+        SlotNames   layout; /* Slots of the frame of the lambda being compiled, if any. */
+    };
+
+
+    CodePtr compile(ValuePtr value) {
+        Compiler c;
+        return c.compileForm(value);
+    }
+
+    CodePtr compileLambda(LambdaPtr lambda) {
+        Compiler c(lambda->env->slotNames());
+        return c.compileBody(lambda->body);
+    }
+
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "value.h"
+
+namespace Inky::Lisp {
+
+    /*
+     * Instruction set of the bytecode VM. Operands are held in the 'a' and 'b' fields of an
+     * Instruction, values referred to by an instruction are held in the constant pool of the Code.
+     */
+    enum class OpCode : uint8_t {
+        Constant,       /* push constants[a].                                                   */
+        Load,           /* push the value bound to the symbol constants[a], if b isn't 0 the    */
+                        /* head of a call, looked up through the inline cache caches[b - 1].   */
+        LoadLocal,      /* push slot a of the lambda's frame, (the symbol constants[b] if unbound). */
+        Define,         /* bind the a values on the stack to the symbols in constants[b] (global). */
+        Put,            /* bind the a values on the stack to the symbols in constants[b] (local).  */
+        Lambda,         /* push a new instance of the lambda constants[a].                      */
+        Defun,          /* as Lambda, also binding the instance to the symbol constants[b].     */
+        Defmemo,        /* as Defun, the instance is memoized.                                  */
+        Optimized,      /* continue at instruction b unless the reduction of the expression     */
+                        /* constants[a] holds (optimizer.h), its code follows.                  */
+        Jump,           /* continue at instruction a.                                           */
+        JumpIfFalse,    /* pop the condition, continue at instruction a if it is zero.          */
+        Apply,          /* apply the a values on the stack, a function call or list of results. */
+        Add,            /* the primitive arithmetic & comparison instructions apply the a       */
+        Subtract,       /* values on the stack; if the head is still bound to the primitive     */
+        Multiply,       /* builtin they are computed in place, otherwise they behave as Apply.  */
+        Divide,
+        Less,
+        LessEqual,
+        Greater,
+        GreaterEqual,
+        Equal,
+        NotEqual,
+        Fail,           /* stop evaluation with the error constants[a].                         */
+        Return          /* return the value on top of the stack to the caller.                  */
+    };
+
+    struct Instruction {
+        OpCode      op;
+        uint32_t    a;
+        uint32_t    b;
+    };
+
+    /* A compiled top-level form or lambda body. */
+    struct Code {
+        std::vector<Instruction>    instructions;
+        std::vector<ValuePtr>       constants;
+        std::vector<InlineCache>    caches;     /* of the calls whose head is a global name. */
+    };
+
+    /* Compile a parsed expression (as returned by parse) into bytecode. */
+    CodePtr compile(ValuePtr value);
+
+    /*
+     * Compile the body of a lambda; the body is evaluated as an S-Expression when the lambda is called.
+     * References to the lambda's formals are resolved to the slots of its frame.
+     */
+    CodePtr compileLambda(LambdaPtr lambda);
+
+}
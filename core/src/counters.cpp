@@ -0,0 +1,83 @@
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "counters.h"
+
+namespace Inky::Lisp::Counters {
+
+    namespace detail {
+        std::atomic<bool> enabled { false };
+        thread_local Block* current = nullptr;
+    }
+
+    namespace {
+        /* The blocks of every thread that has counted, kept after the thread exits. */
+        std::mutex blocksLock;
+        std::vector<std::unique_ptr<detail::Block>> blocks;
+        Stats base {}; /* the totals at the last reset. */
+
+        Stats totals() {
+            Stats s {};
+            for (const auto& b: blocks) {
+                for (size_t k = 0; k < types; k++) s.values[k] += b->values[k].load(std::memory_order_relaxed);
+                for (size_t k = 0; k < depths; k++) s.lookups[k] += b->lookups[k].load(std::memory_order_relaxed);
+                s.clones += b->clones.load(std::memory_order_relaxed);
+                s.cloned += b->cloned.load(std::memory_order_relaxed);
+                s.environmentClones += b->environmentClones.load(std::memory_order_relaxed);
+                s.environments += b->environments.load(std::memory_order_relaxed);
+                s.unbound += b->unbound.load(std::memory_order_relaxed);
+                s.builtinCalls += b->builtinCalls.load(std::memory_order_relaxed);
+            }
+            return s;
+        }
+    }
+
+    detail::Block& detail::attach() {
+        std::lock_guard<std::mutex> guard(blocksLock);
+        blocks.push_back(std::make_unique<Block>()); /* value initialised, every count is zero. */
+        current = blocks.back().get();
+        return *current;
+    }
+
+    void setEnabled(bool on) {
+        detail::enabled.store(on);
+    }
+
+    void reset() {
+        std::lock_guard<std::mutex> guard(blocksLock);
+        base = totals();
+    }
+
+    Stats stats() {
+        std::lock_guard<std::mutex> guard(blocksLock);
+        Stats s = totals();
+        for (size_t k = 0; k < types; k++) s.values[k] -= base.values[k];
+        for (size_t k = 0; k < depths; k++) s.lookups[k] -= base.lookups[k];
+        s.clones -= base.clones;
+        s.cloned -= base.cloned;
+        s.environmentClones -= base.environmentClones;
+        s.environments -= base.environments;
+        s.unbound -= base.unbound;
+        s.builtinCalls -= base.builtinCalls;
+        return s;
+    }
+
+    const char* typeName(Type kind) {
+        switch (kind) {
+            case Type::Error:           return "error";
+            case Type::Integer:         return "integer";
+            case Type::Double:          return "double";
+            case Type::String:          return "string";
+            case Type::Symbol:          return "symbol";
+            case Type::BuiltinFunction: return "builtin";
+            case Type::Function:        return "function";
+            case Type::SExpression:     return "sexpression";
+            case Type::QExpression:     return "qexpression";
+            case Type::BigInteger:      return "biginteger";
+            case Type::Vector:          return "vector";
+            case Type::Map:             return "map";
+        }
+        return "unknown";
+    }
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+
+#include "value.h"
+
+namespace Inky::Lisp {
+
+    /*
+     * Runtime counters: Values allocated by type, deep copies (Value::clone and Environment::clone)
+     * and the values they copy, environments created, the number of scopes searched by each lookup
+     * and builtin calls. Each thread counts into its own block, only the thread writes to it, so
+     * counting is a plain increment; stats sums the blocks of every thread.
+     *
+     * Counting is off by default, when disabled the cost is a relaxed atomic load at each point.
+     */
+    namespace Counters {
+
+        constexpr size_t types = (size_t) Type::Map + 1;
+        constexpr size_t depths = 16; /* the last bucket counts the lookups that search more scopes. */
+
+        struct Stats {
+            size_t values[types];       /* Values allocated from the heap, by Type.            */
+            size_t clones;              /* deep copies, not counting those made within one.    */
+            size_t cloned;              /* Values copied by the deep copies.                   */
+            size_t environmentClones;   /* environments copied by the deep copies.             */
+            size_t environments;        /* environments created, global scopes and frames.     */
+            size_t lookups[depths];     /* lookups of bound symbols, by scopes searched - 1.   */
+            size_t unbound;             /* lookups of unbound symbols.                         */
+            size_t builtinCalls;        /* calls of builtin functions.                         */
+        };
+
+        namespace detail {
+            extern std::atomic<bool> enabled;
+
+            /* The counts of one thread, written only by that thread. */
+            struct Block {
+                std::atomic<size_t> values[types];
+                std::atomic<size_t> clones;
+                std::atomic<size_t> cloned;
+                std::atomic<size_t> environmentClones;
+                std::atomic<size_t> environments;
+                std::atomic<size_t> lookups[depths];
+                std::atomic<size_t> unbound;
+                std::atomic<size_t> builtinCalls;
+                size_t              cloneDepth; /* deep copies in progress. */
+            };
+
+            extern thread_local Block* current;
+
+            /* The calling thread's block, made on first use. */
+            Block& attach();
+
+            inline Block& block() { return current != nullptr ? *current : attach(); }
+
+            /* Only the owning thread writes, so there is no need for a locked read-modify-write. */
+            inline void increment(std::atomic<size_t>& n) { n.store(n.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed); }
+        }
+
+        inline bool enabled() { return detail::enabled.load(std::memory_order_relaxed); }
+
+        void setEnabled(bool on);
+
+        /* Start counting again from zero. */
+        void reset();
+
+        /* The counts of every thread since the last reset. */
+        Stats stats();
+
+        /* The name a type is reported by. */
+        const char* typeName(Type kind);
+
+        inline void value(Type kind) {
+            if ( enabled() ) detail::increment(detail::block().values[(size_t) kind]);
+        }
+
+        inline void environment() {
+            if ( enabled() ) detail::increment(detail::block().environments);
+        }
+
+        /* A bound symbol found after searching 'scopes' scopes, 0 if it is unbound. */
+        inline void lookup(size_t scopes) {
+            if ( !enabled() ) return;
+            detail::Block& b = detail::block();
+            if ( scopes == 0 ) detail::increment(b.unbound);
+            else detail::increment(b.lookups[std::min(scopes, depths) - 1]);
+        }
+
+        inline void builtinCall() {
+            if ( enabled() ) detail::increment(detail::block().builtinCalls);
+        }
+
+        /* Counts a Value::clone or Environment::clone, for as long as it is in scope. */
+        class Clone {
+        public:
+            explicit Clone(bool environment) : counting(enabled()) {
+                if ( !counting ) return;
+                detail::Block& b = detail::block();
+                if ( b.cloneDepth++ == 0 ) detail::increment(b.clones);
+                detail::increment(environment ? b.environmentClones : b.cloned);
+            }
+
+            ~Clone() {
+                if ( counting ) detail::block().cloneDepth--;
+            }
+
+            Clone(const Clone&) = delete;
+            Clone& operator=(const Clone&) = delete;
+
+        private:
+            bool counting;
+        };
+    }
+}
@@ -1,25 +1,190 @@
 #include <algorithm>
+#include <mutex>
 
+#include "counters.h"
 #include "value.h"
 #include "environment.h"
 
 
 namespace Inky::Lisp {
 
-    ValuePtr Environment::lookup(const std::string& name) const {
-        auto i = definitions.find(name);
-        if ( i != definitions.end()) return i->second;
-        else {
-            for (auto j=outer; j!=nullptr; j=j->outer) {
-                i = j->definitions.find(name);
-                if (i != j->definitions.end()) return i->second;
+    Environment::Environment() { Counters::environment(); }
+
+    Environment::Environment(SlotNames names) : names(names), slots(names->size()) { Counters::environment(); }
+
+    /* The versions of global scopes, unique across every environment. */
+    static std::atomic<uint64_t> versions { 0 };
+
+    static uint64_t nextVersion() { return versions.fetch_add(1, std::memory_order_relaxed) + 1; }
+
+    const ValuePtr* Environment::find(Symbol name) const {
+        if ( names == nullptr ) {
+            auto i = definitions.find(name);
+            return i != definitions.end() ? &i->second : nullptr;
+        }
+
+        for (size_t k = 0; k < names->size(); k++) {
+            if ( slots[k] != nullptr && (*names)[k] == name ) return &slots[k];
+        }
+        for (const auto& kv: locals) {
+            if ( kv.first == name ) return &kv.second;
+        }
+        return nullptr;
+    }
+
+    Environment& Environment::outermost() {
+        Environment* j = this;
+        while ( j->outer != nullptr ) j = j->outer.get();
+        return *j;
+    }
+
+    void Environment::beginParallel() { outermost().parallel++; }
+
+    void Environment::endParallel() { outermost().parallel--; }
+
+    ValuePtr Environment::lookup(Symbol name) const {
+        size_t scopes = 0;
+        for (const Environment* j = this; j != nullptr; j = j->outer.get()) {
+            scopes++;
+            if ( j->names == nullptr && j->parallel.load(std::memory_order_relaxed) > 0 ) {
+                std::shared_lock<std::shared_mutex> guard(j->lock);
+                auto i = j->find(name);
+                if ( i != nullptr ) {
+                    Counters::lookup(scopes);
+                    return *i;
+                }
+                continue;
+            }
+            auto i = j->find(name);
+            if ( i != nullptr ) {
+                Counters::lookup(scopes);
+                return *i;
             }
         }
+        Counters::lookup(0);
         return nullptr;
     }
 
-   void Environment::insert(const std::string& name, ValuePtr value) {
-       definitions[name] = value;
+    ValuePtr Environment::lookup(Symbol name, InlineCache& cache) const {
+        /* Only frames may lie between this scope and the global scope, for the frames to be skipped. */
+        size_t scopes = 1;
+        const Environment* global = this;
+        for (; global->outer != nullptr; global = global->outer.get(), scopes++) {
+            if ( global->names == nullptr ) return lookup(name);
+        }
+        if ( global->names != nullptr || global->parallel.load(std::memory_order_relaxed) > 0 ) return lookup(name);
+        if ( global->isLocal(name) ) return lookup(name);
+
+        uint64_t version = global->version.load(std::memory_order_acquire);
+        const ValuePtr* binding = nullptr;
+        if ( version != 0 && cache.version.load(std::memory_order_acquire) == version ) {
+            binding = cache.binding.load(std::memory_order_acquire);
+            if ( cache.version.load(std::memory_order_relaxed) != version ) binding = nullptr; /* refilled meanwhile. */
+        }
+
+        if ( binding == nullptr ) {
+            binding = global->find(name);
+            if ( binding == nullptr ) {
+                Counters::lookup(0);
+                return nullptr;
+            }
+            /* a binding's node in the map isn't moved by inserts, so the cache can point to it. */
+            uint64_t seen = cache.version.load(std::memory_order_relaxed);
+            if ( version != 0 && seen != InlineCache::Filling
+                 && cache.version.compare_exchange_strong(seen, InlineCache::Filling, std::memory_order_acquire) ) {
+                cache.binding.store(binding, std::memory_order_release);
+                cache.version.store(version, std::memory_order_release);
+            }
+        }
+
+        Counters::lookup(scopes);
+        return *binding;
+    }
+
+   const Environment* Environment::globalScope() const {
+       const Environment* j = this;
+       while ( j->outer != nullptr ) j = j->outer.get();
+       return j->names == nullptr ? j : nullptr;
+   }
+
+   bool Environment::holds(const Reduction& reduction) const {
+       uint64_t current = version.load(std::memory_order_acquire);
+       uint64_t checked = reduction.checked.load(std::memory_order_acquire);
+       if ( current != 0 && checked >> 1 == current ) return checked & 1;
+
+       bool held = true;
+       {
+           std::shared_lock<std::shared_mutex> guard(lock, std::defer_lock);
+           if ( parallel.load(std::memory_order_relaxed) > 0 ) guard.lock();
+           for (const auto& [name, value]: reduction.bindings) {
+               const ValuePtr* binding = find(name);
+               if ( isLocal(name) || (binding != nullptr ? *binding : nullptr) != value ) {
+                   held = false;
+                   break;
+               }
+           }
+       }
+       if ( current != 0 ) reduction.checked.store(current << 1 | (held ? 1 : 0), std::memory_order_release);
+       return held;
+   }
+
+   bool Environment::isLocal(Symbol name) const {
+       return name.id < localNames.size() && localNames[name.id];
+   }
+
+   void Environment::markLocal(Symbol name) {
+       Environment& global = outermost();
+       if ( global.names != nullptr ) return; /* not nested in a global scope, so lookups from it aren't cached. */
+
+       bool parallel = global.parallel.load(std::memory_order_relaxed) > 0;
+       {
+           std::shared_lock<std::shared_mutex> guard(global.lock, std::defer_lock);
+           if ( parallel ) guard.lock();
+           if ( global.isLocal(name) ) return;
+       }
+       std::unique_lock<std::shared_mutex> guard(global.lock, std::defer_lock);
+       if ( parallel ) guard.lock();
+       if ( global.localNames.size() <= name.id ) global.localNames.resize(std::max<size_t>(name.id + 1, 2 * global.localNames.size()));
+       global.localNames[name.id] = true;
+       /* call sites that cached the global binding of the name must now search the frames. */
+       global.version.store(nextVersion(), std::memory_order_release);
+   }
+
+   void Environment::markLocals(const SlotNames& formals) {
+       if ( formals == nullptr ) return;
+       for (Symbol name: *formals) markLocal(name);
+   }
+
+   void Environment::insert(Symbol name, ValuePtr value) {
+       if ( names == nullptr ) {
+           /* a lambda may come from another environment, its formals are bound in frames of this one. */
+           if ( value != nullptr && value->kind == Type::Function ) {
+               const EnvironmentPtr& frame = std::get<LambdaPtr>(value->var)->env;
+               if ( frame != nullptr ) markLocals(frame->slotNames());
+           }
+           if ( parallel.load(std::memory_order_relaxed) > 0 ) {
+               std::unique_lock<std::shared_mutex> guard(lock);
+               definitions[name] = value;
+           }
+           else definitions[name] = value;
+           version.store(nextVersion(), std::memory_order_release);
+           return;
+       }
+
+       for (size_t k = 0; k < names->size(); k++) {
+           if ( (*names)[k] == name ) {
+               slots[k] = value;
+               return;
+           }
+       }
+       for (auto& kv: locals) {
+           if ( kv.first == name ) {
+               kv.second = value;
+               return;
+           }
+       }
+       markLocal(name);
+       locals.emplace_back(name, value);
    }
 
    EnvironmentPtr Environment::getGlobalScope() {
@@ -33,7 +198,7 @@ namespace Inky::Lisp {
         return i;
     }
 
-    void Environment::insertGlobal(const std::string &name, ValuePtr value) {
+    void Environment::insertGlobal(Symbol name, ValuePtr value) {
         if ( outer == nullptr ) {
             insert(name,value);
         } else {
@@ -43,7 +208,25 @@ namespace Inky::Lisp {
     }
 
     void Environment::setOuterScope(EnvironmentPtr env) {
-        if ( env.get() != this) outer = env;
+        if ( env.get() == this ) return;
+        outer = env;
+        scopes = outer != nullptr ? outer->scopes + 1 : 1;
+    }
+
+    bool Environment::shadows(const Environment& e) const {
+        if ( e.names == nullptr ) return false; /* the global scope is never skipped. */
+        for (size_t k = 0; k < e.names->size(); k++) {
+            if ( e.slots[k] != nullptr && find((*e.names)[k]) == nullptr ) return false;
+        }
+        for (const auto& kv: e.locals) {
+            if ( find(kv.first) == nullptr ) return false;
+        }
+        return true;
+    }
+
+    void Environment::setCallerScope(EnvironmentPtr caller) {
+        while ( caller != nullptr && shadows(*caller) ) caller = caller->outer;
+        setOuterScope(caller);
     }
 
     EnvironmentPtr Environment::getOuterScope() {
@@ -51,20 +234,49 @@ namespace Inky::Lisp {
     }
 
     EnvironmentPtr Environment::clone() {
+        Counters::Clone counted(true);
+        EnvironmentPtr env = shallowCopy();
+        for (auto& kv: env->definitions) kv.second = kv.second->clone();
+        for (auto& v: env->slots) if ( v != nullptr ) v = v->clone();
+        for (auto& kv: env->locals) kv.second = kv.second->clone();
+        return env;
+    }
+
+    EnvironmentPtr Environment::shallowCopy() {
         EnvironmentPtr env (new Environment());
         env->outer = outer; /* Outer scopes are shared not cloned. */
-        for(const auto& kv: definitions) {
-            env->insert(kv.first,kv.second->clone());
-        }
+        env->scopes = scopes;
+        env->definitions = definitions;
+        env->names = names;
+        env->slots = slots;
+        env->locals = locals;
+        if ( names == nullptr ) env->version.store(nextVersion(), std::memory_order_relaxed);
         return env;
     }
 
+    EnvironmentPtr makeFrame(ValuePtr formals) {
+        auto names = std::make_shared<std::vector<Symbol>>();
+        if ( Ops::isExpression(formals) ) {
+            for (const auto& c: std::get<ExpressionPtr>(formals->var)->cells) {
+                /* a formal that isn't a symbol is an error when called, it gets a slot that is never bound. */
+                names->push_back(c->kind == Type::Symbol ? std::get<Symbol>(c->var) : Symbols::Varargs);
+            }
+        }
+        return std::make_shared<Environment>(names);
+    }
+
     std::ostream& operator<<(std::ostream& os, EnvironmentPtr env) {
-        for (const auto& kv: env->definitions) os << "\t:" << kv.first << " :" << kv.second << "\n";
+        for (const auto& kv: env->definitions) os << "\t:" << symbolName(kv.first) << " :" << kv.second << "\n";
+        if ( env->names != nullptr ) {
+            for (size_t k = 0; k < env->names->size(); k++) {
+                if ( env->slots[k] != nullptr ) os << "\t:" << symbolName((*env->names)[k]) << " :" << env->slots[k] << "\n";
+            }
+        }
+        for (const auto& kv: env->locals) os << "\t:" << symbolName(kv.first) << " :" << kv.second << "\n";
         if ( env->outer != nullptr ) {
             os << env->outer << "\n";
         }
         return os;
     }
 
-}
\ No newline at end of file
+}
@@ -1,46 +1,118 @@
 #pragma once
 
+#include <atomic>
 #include <ostream>
+#include <shared_mutex>
 #include <unordered_map>
 #include <ostream>
+#include <vector>
 
 #include "either.h"
 #include "value.h"
 
 namespace Inky::Lisp {
 
+    /* The names of the slots of a lambda's environment (its formals), shared by every call of the lambda. */
+    typedef std::shared_ptr<const std::vector<Symbol>> SlotNames;
+
     /*
      * An environment represents the set of definitions within a given scope.
      * Each environment contains a pointer to the parent outer scope.
+     *
+     * The global scope holds its definitions in a map. The environment of a lambda is a frame,
+     * its formals are held in a flat array of slots (so that compiled code can address them by
+     * index) and any other local definitions in a short list.
      */
 
    class Environment {
    public:
-       Environment() = default;
+       Environment();
+       explicit Environment(SlotNames names);
        ~Environment() = default;
 
       /* Returns the ValuePtr associated with the name, or nullptr if it doesn't exist. */
-      ValuePtr lookup(const std::string& name) const;
+      ValuePtr lookup(Symbol name) const;
+      ValuePtr lookup(const std::string& name) const { return lookup(intern(name)); }
+
+      /*
+       * As lookup, for the name at the head of a call site. A name that no lambda of the global
+       * scope binds in its frame (see markLocal) can only be bound in the global scope, so the
+       * frames are not searched and the binding is taken from the cache while the global scope is
+       * unchanged.
+       */
+      ValuePtr lookup(Symbol name, InlineCache& cache) const;
+
+      /*
+       * Record that a lambda frame nested in this environment's global scope binds 'name', as a
+       * formal or by '='. Lambdas mark their formals when they are made, in the environment they
+       * are made in. The first time a name is marked the version of the global scope changes.
+       */
+      void markLocal(Symbol name);
+      void markLocals(const SlotNames& formals);
+
+      /* The global scope this environment is nested in, nullptr if its outermost scope is a lambda frame. */
+      const Environment* globalScope() const;
+
+      /* True if each name a reduction depends on still has the binding it was reduced with, of a global scope. */
+      bool holds(const Reduction& reduction) const;
 
       /* Insert a value for a given name. */
-      void insert(const std::string& name, ValuePtr value);
+      void insert(Symbol name, ValuePtr value);
+      void insert(const std::string& name, ValuePtr value) { insert(intern(name), value); }
 
       /*
        * Insert into global scope. Insert the symbol into the outermost scope that this
        * environment refers to.
        */
-      void insertGlobal(const std::string& name, ValuePtr value);
+      void insertGlobal(Symbol name, ValuePtr value);
+
+      /* Returns the value held in a slot of a lambda frame, nullptr if the slot is unbound. */
+      const ValuePtr& slot(size_t index) const { return slots[index]; }
+
+      /* Bind the value held in a slot of a lambda frame. */
+      void setSlot(size_t index, ValuePtr value) { slots[index] = std::move(value); }
+
+      /* Returns the names of the slots, nullptr if this isn't a lambda frame. */
+      const SlotNames& slotNames() const { return names; }
 
       /* Set the outer scope of this environment. */
       void setOuterScope(EnvironmentPtr env);
 
+      /*
+       * Set the outer scope of a lambda frame to the scope of its caller. A caller's frame whose
+       * bindings are all shadowed by this frame can't be seen from it and is skipped, so that
+       * recursive calls don't lengthen the chain of scopes searched by lookup.
+       */
+      void setCallerScope(EnvironmentPtr caller);
+
       /* Returns the outer scope of this environment. */
       EnvironmentPtr getOuterScope();
 
+      /*
+       * Returns the number of scopes searched by a lookup, this one and those it is nested in. Kept
+       * as the outer scope is set, so it is as current as the outer scope's was then.
+       */
+      size_t depth() const { return scopes; }
+
       /* Make a copy of the items in this environment, copy the ptr to the outer environment. */
       EnvironmentPtr clone();
 
+      /* As clone, but the values are shared rather than copied. */
+      EnvironmentPtr shallowCopy();
+
+      /*
+       * Between beginParallel and endParallel tasks may be running on other threads, lookups and
+       * inserts of this environment's global scope are then locked. A lambda frame is only modified
+       * by the thread running the call, other threads only read it; so frames are never locked.
+       * Global scopes are independent, evaluation in one never locks another.
+       */
+      void beginParallel();
+      void endParallel();
+
       friend std::ostream& operator<<(std::ostream& os, EnvironmentPtr env);
+      friend class ImageWriter;
+      friend class Memo;
+      friend class Optimizer;
 
    private:
 
@@ -51,13 +123,40 @@ namespace Inky::Lisp {
         */
        EnvironmentPtr getGlobalScope();
 
+       /* The outermost scope, this one if it is the global scope. */
+       Environment& outermost();
+
+       /* True if the name is marked as bound in lambda frames, of a global scope. */
+       bool isLocal(Symbol name) const;
+
+       /* Lookup the name in this scope only. */
+       const ValuePtr* find(Symbol name) const;
+
+       /* True if every name bound in the lambda frame 'e' is also bound in this scope. */
+       bool shadows(const Environment& e) const;
+
    private:
-       /* An unordered map from symbol name to its Value. */
-       std::unordered_map<std::string, ValuePtr> definitions;
+       /* An unordered map from symbol to its Value, (global scope). */
+       std::unordered_map<Symbol, ValuePtr, SymbolHash> definitions;
+       mutable std::shared_mutex lock; /* guards definitions while parallel tasks are running. */
+       std::atomic<int> parallel { 0 }; /* number of parallel sections in progress, of a global scope. */
+       std::atomic<uint64_t> version { 0 }; /* of a global scope, changed by each insert; 0 before the first. */
+       std::vector<bool> localNames; /* of a global scope, by symbol id, see markLocal. */
+
+       /* Lambda frame, slot i holds the value of names[i]. */
+       SlotNames names;
+       std::vector<ValuePtr> slots;
+
+       /* Lambda frame, values defined with '=' that are not formals. */
+       std::vector<std::pair<Symbol, ValuePtr>> locals;
 
       /* The outer environment. */
       EnvironmentPtr outer;
+      uint32_t scopes = 1; /* see depth. */
    };
 
+   /* Make the environment of a lambda, a frame with a slot for each of the formals. */
+   EnvironmentPtr makeFrame(ValuePtr formals);
+
    std::ostream& operator<<(std::ostream& os, EnvironmentPtr env);
-}
\ No newline at end of file
+}
@@ -1,7 +1,14 @@
 #include <fmt/core.h>
+#include <optional>
 #include <sstream>
 
+#include "builtin.h"
+#include "counters.h"
 #include "environment.h"
+#include "lambda.h"
+#include "memo.h"
+#include "profiler.h"
+#include "trace.h"
 #include "value.h"
 
 #include "eval.h"
@@ -16,22 +23,25 @@ namespace Inky::Lisp {
         ~Eval() = default;
 
 
-        ValuePtr eval(ValuePtr v) {
+        ValuePtr eval(const ValuePtr& v) {
             switch (v->kind) {
 
                 case Type::SExpression:
                     return evalSExpression(v);
 
                 case Type::Symbol: {
-                    auto key = std::get<std::string>(v->var);
+                    auto key = std::get<Symbol>(v->var);
                     auto lookup = env->lookup(key);
                     if (lookup) return lookup;
-                    else return Ops::makeError(fmt::format("unbound symbol: {}",key));
+                    else return Ops::makeError(fmt::format("unbound symbol: {}",symbolName(key)));
                 }
 
                 case Type::Error:
                 case Type::Integer:
                 case Type::Double:
+                case Type::BigInteger:
+                case Type::Vector:
+                case Type::Map:
                 case Type::String:
                 case Type::QExpression:
                 case Type::BuiltinFunction:
@@ -40,270 +50,331 @@ namespace Inky::Lisp {
             }
         }
 
-        ValuePtr evalSExpression(ValuePtr vp) {
-            ExpressionPtr v = std::get<ExpressionPtr>(vp->var);
+        /* The first cell of an expression, a symbol is looked up through the expression's inline cache. */
+        ValuePtr evalHead(const ExpressionPtr& v) {
+            const ValuePtr& head = v->cells[0];
+            if ( head->kind != Type::Symbol ) return eval(head);
+            auto key = std::get<Symbol>(head->var);
+            auto lookup = env->lookup(key, v->head);
+            if (lookup) return lookup;
+            else return Ops::makeError(fmt::format("unbound symbol: {}",symbolName(key)));
+        }
 
-            if ( v->cells.empty() ) return vp;
-            if ( v->cells.size() == 1) return eval(v->cells[0]);
+        /* Evaluate an S or Q expression as an S-Expression, used for lambda bodies, if & eval. */
+        ValuePtr evalExpression(const ValuePtr& v) {
+            if ( !Ops::isExpression(v) ) return eval(v);
+            if ( v->kind == Type::SExpression ) return evalSExpression(v);
+            if ( Ops::isEmptyExpression(v) ) return Ops::makeSExpression();
+            return traced(std::get<ExpressionPtr>(v->var));
+        }
 
-            /*
-             *
-             *  This small section of code can be used if you rely on []
-             *  syntax for argument and function definitions.
-             *  The [] syntax tags something as 'don't eagerly evaluate'.
-             *
-                    for (auto & cell : v->cells) {
-                        auto maybe = eval(cell);
-                        if ( maybe ) cell = maybe.right();
-                        else return maybe.left();
-                    }
-             *
-             * The while loop beneath is the 'special terms' required to
-             * tweak the eval so that you can use the more regular ()
-             * syntax, i.e.
-             * We want to write
-             *  (lambda (x) (+1 x)) 10
-             *  instead of ( lambda [x] [+ 1 x]) 10
-             */
+        ValuePtr evalSExpression(const ValuePtr& vp) {
+            ExpressionPtr v = std::get<ExpressionPtr>(vp->var);
+            if ( v->cells.empty() ) return vp;
+            return traced(v);
+        }
 
-            size_t k = 0;
-            while ( k < v->cells.size() )  {
-              if ( Ops::hasSymbolName(v->cells[k],"defun"))   {
-                if ( k + 2 >= v->cells.size() ) {
-                    return Ops::makeError("defun must contain formals and body arguments.");
-                }
+        /* evalCells, recording the step in the trace when it is enabled. */
+        ValuePtr traced(const ExpressionPtr& expression) {
+            ValuePtr result = evalCells(expression);
+            if ( Trace::enabled() ) Trace::record(expression, *env, result->kind, false);
+            return result;
+        }
 
-                /* defun (foo x y) (+ x y) => define (foo) (lambda (x y) (+ x y) */
-                /* defun (args) (body) = define (head(args)) (lambda (tail args) (body)) */
-
-                auto formals = v->cells[k+1];
-                auto body = v->cells[k+2];
-                /*
-                 * we could doOps::makeSymbol("head") and Ops::makeSymbol("tail")
-                 * and evaluate these functions to get the head and tail of the
-                 * formals.
-                 * It is quicker to just short-circuit that and manipulate the
-                 * lists directly.
-                 *
-                 * Similarly, we could just invoke builtin functions here,
-                 * but we can directly construct and put the function name into
-                 * the environment etc.
-                 *
-                 */
-
-                if ( !Ops::isExpression(formals) ) {
-                    return Ops::makeError("formals to defun should be expression.");
-                }
-                ExpressionPtr xs = std::get<ExpressionPtr>(formals->var);
-                if (xs->cells.size() < 2) {
-                    return Ops::makeError("function must have name and at least one argument.");
+        /*
+         * The expression being evaluated is never modified, (it may be the body of a lambda or a
+         * list bound to a symbol). Evaluated cells are held in a separate frame, which becomes the
+         * argument list of the function call.
+         *
+         * Expressions in tail position, the body of a lambda being called and the branch taken by
+         * 'if', are not evaluated recursively: the loop continues with them (in the lambda's scope),
+         * so that tail recursion runs in constant stack. The caller's environment is restored on return.
+         */
+        ValuePtr evalCells(const ExpressionPtr& expression) {
+            std::optional<ScopeGuard> guard;
+            Profiler::Scope profile; /* the lambda being called, a tail call replaces it. */
+            ExpressionPtr v = expression;
+
+            while ( true ) {
+                ValuePtr next; /* the expression in tail position. */
+
+                if ( const ValuePtr* optimized = reduced(*v) ) {
+                    next = *optimized;
                 }
-                ValuePtr functionName= xs->cells[0];
-                if ( functionName->kind != Type::Symbol ) {
-                   return Ops::makeError("function name must be a symbol.");
+                else if ( v->cells.size() == 1 ) {
+                    if ( v->cells[0]->kind != Type::SExpression ) return eval(v->cells[0]);
+                    next = v->cells[0];
                 }
-                std::string name = std::get<std::string>(functionName->var);
-                xs->cells.pop_front(); /* remove the function name from the formals. */
-                EnvironmentPtr e(new Environment());
-                ValuePtr lambda = Ops::makeFunction(std::make_shared<Lambda>(Lambda{ formals, body, e }));
-
-                env->insert(name,lambda);
-
-                v->cells.pop_front(); // defun.
-                v->cells.pop_front(); // formals
-                v->cells.pop_front(); // args.
-                v->cells.push_front(lambda); // lambda.
-              }
-              else {
-                  auto maybe = eval(v->cells[k]);
-                  if ( ! Ops::isError(maybe)) {
-                      /*
-                       * The base implementation has a syntax [] for 'quoted expressions',
-                       * eval([x]) = [x],
-                       * This is useful for evaluation, e.g.
-                       *
-                       *  (lambda [x] [+ 1 x])  (+ 10 10)
-                       *
-                       *  Eval can just - evaluate all sub expressions, run the function.
-                       *  Since [x] and [+1 x] return themselves.
-                       *
-                       *  To allow the more regular syntax we need to deal with lambda, define, and defun
-                       *  in the eval:
-                       */
-                      if (Ops::hasSymbolName(v->cells[k], "lambda") || Ops::hasSymbolName(v->cells[k], "\\")) {
-                          if (k + 2 >= v->cells.size()) {
-                              return Ops::makeError("lambda definition must contain formals and body.");
-                          }
-                          v->cells[k] = maybe;
-
-                          /*  Simply skip over the eval of the lambda formals and body defn;
-                           * This allows:
-                           *  lambda (x) (+ 1 x) to be written, rather than explicitly  lambda [x] [+1 x]
-                           *  The [] syntax specified the type as 'q-expression' meaning just return self.
-                           *  which is convenient, but 'not standard'.
-                           */
-                          k += 3; /* don't eval lambda function arguments on defn. */
-                      } else if (Ops::hasSymbolName(v->cells[k], "def")
-                                || Ops::hasSymbolName(v->cells[k], "define")
-                                || Ops::hasSymbolName(v->cells[k],"="))
-                        {
-                          if (k + 2 >= v->cells.size()) {
-                              return Ops::makeError("define must have two arguments.");
-                          }
-                          v->cells[k] = maybe;
-                          if ( v->cells[k+1]->kind == Type::SExpression) v->cells[k+1]->kind = Type::QExpression;
-                          else {
-                              ExpressionPtr ys(new Expression());
-                              ys->insert(v->cells[k+1]);
-                              v->cells[k + 1] = Ops::makeQExpression(ys);
-                          }
-
-                          k += 2;
-                      } else if (Ops::hasSymbolName(v->cells[k], "if")) {
-                          /* if (condition) (then) (else) */
-                          if (k + 3 >= v->cells.size()) {
-                              return Ops::makeError("if statement must be of form if (condition) (then) (else).");
-                          }
-                          v->cells[k] = maybe;
-                          auto cond = eval(v->cells[k + 1]);
-                          if (!Ops::isError(cond)) {
-                              v->cells[k + 1] = cond;
+                else {
+                    /*
+                     *
+                     *  This small section of code can be used if you rely on []
+                     *  syntax for argument and function definitions.
+                     *  The [] syntax tags something as 'don't eagerly evaluate'.
+                     *
+                            for (const auto& cell : v->cells) {
+                                auto maybe = eval(cell);
+                                if ( Ops::isError(maybe) ) return maybe;
+                                frame->insert(maybe);
+                            }
+                     *
+                     * The while loop beneath is the 'special terms' required to
+                     * tweak the eval so that you can use the more regular ()
+                     * syntax, i.e.
+                     * We want to write
+                     *  (lambda (x) (+1 x)) 10
+                     *  instead of ( lambda [x] [+ 1 x]) 10
+                     */
+
+                    ExpressionPtr frame(new Expression());
+                    size_t k = 0;
+                    while ( k < v->cells.size() )  {
+                      if ( Ops::isSymbol(v->cells[k],Symbols::Defun) || Ops::isSymbol(v->cells[k],Symbols::Defmemo) )   {
+                        if ( k + 2 >= v->cells.size() ) {
+                            return Ops::makeError("defun must contain formals and body arguments.");
+                        }
+
+                        /* defun (foo x y) (+ x y) => define (foo) (lambda (x y) (+ x y) */
+                        /* defun (args) (body) = define (head(args)) (lambda (tail args) (body)) */
+
+                        auto formals = v->cells[k+1];
+                        auto body = v->cells[k+2];
+                        /*
+                         * we could doOps::makeSymbol("head") and Ops::makeSymbol("tail")
+                         * and evaluate these functions to get the head and tail of the
+                         * formals.
+                         * It is quicker to just short-circuit that and manipulate the
+                         * lists directly.
+                         *
+                         * Similarly, we could just invoke builtin functions here,
+                         * but we can directly construct and put the function name into
+                         * the environment etc.
+                         *
+                         */
+
+                        if ( !Ops::isExpression(formals) ) {
+                            return Ops::makeError("formals to defun should be expression.");
+                        }
+                        ExpressionPtr xs = std::get<ExpressionPtr>(formals->var);
+                        if (xs->cells.size() < 2) {
+                            return Ops::makeError("function must have name and at least one argument.");
+                        }
+                        ValuePtr functionName= xs->cells[0];
+                        if ( functionName->kind != Type::Symbol ) {
+                           return Ops::makeError("function name must be a symbol.");
+                        }
+                        Symbol name = std::get<Symbol>(functionName->var);
+
+                        /* The lambda's formals are the defun formals without the function name. */
+                        ExpressionPtr args(new Expression());
+                        args->cells = xs->cells.drop(1);
+                        ValuePtr argsValue = std::make_shared<Value>(Value { formals->kind, args });
+
+                        EnvironmentPtr e = makeFrame(argsValue);
+                        env->markLocals(e->slotNames());
+                        ValuePtr lambda = Ops::makeFunction(std::make_shared<Lambda>(Lambda{ argsValue, body, e, nullptr, name }));
+                        /* defmemo binds the function's memoized version, so recursive calls are cached too. */
+                        if ( Ops::isSymbol(v->cells[k],Symbols::Defmemo) ) lambda = memoize(lambda);
+
+                        env->insert(name,lambda);
+
+                        frame->insert(lambda);
+                        k += 3; /* defun, formals, body. */
+                      }
+                      else {
+                          auto maybe = k == 0 ? evalHead(v) : eval(v->cells[k]);
+                          if ( ! Ops::isError(maybe)) {
+                              /*
+                               * The base implementation has a syntax [] for 'quoted expressions',
+                               * eval([x]) = [x],
+                               * This is useful for evaluation, e.g.
+                               *
+                               *  (lambda [x] [+ 1 x])  (+ 10 10)
+                               *
+                               *  Eval can just - evaluate all sub expressions, run the function.
+                               *  Since [x] and [+1 x] return themselves.
+                               *
+                               *  To allow the more regular syntax we need to deal with lambda, define, and defun
+                               *  in the eval:
+                               */
+                              if (Ops::isSymbol(v->cells[k], Symbols::Lambda) || Ops::isSymbol(v->cells[k], Symbols::Backslash)) {
+                                  if (k + 2 >= v->cells.size()) {
+                                      return Ops::makeError("lambda definition must contain formals and body.");
+                                  }
+
+                                  /*  Simply skip over the eval of the lambda formals and body defn;
+                                   * This allows:
+                                   *  lambda (x) (+ 1 x) to be written, rather than explicitly  lambda [x] [+1 x]
+                                   *  The [] syntax specified the type as 'q-expression' meaning just return self.
+                                   *  which is convenient, but 'not standard'.
+                                   */
+                                  frame->insert(maybe);
+                                  frame->insert(v->cells[k+1]);
+                                  frame->insert(v->cells[k+2]);
+                                  k += 3; /* don't eval lambda function arguments on defn. */
+                              } else if (Ops::isSymbol(v->cells[k], Symbols::Def)
+                                        || Ops::isSymbol(v->cells[k], Symbols::Define)
+                                        || Ops::isSymbol(v->cells[k], Symbols::Assign))
+                                {
+                                  if (k + 2 >= v->cells.size()) {
+                                      return Ops::makeError("define must have two arguments.");
+                                  }
+                                  frame->insert(maybe);
+                                  ValuePtr symbols = v->cells[k+1];
+                                  if ( symbols->kind == Type::SExpression ) {
+                                      frame->insert(Ops::makeQExpression(std::get<ExpressionPtr>(symbols->var)));
+                                  } else if ( symbols->kind == Type::QExpression ) {
+                                      frame->insert(symbols);
+                                  } else {
+                                      ExpressionPtr ys(new Expression());
+                                      ys->insert(symbols);
+                                      frame->insert(Ops::makeQExpression(ys));
+                                  }
+
+                                  k += 2;
+                              } else if (Ops::isSymbol(v->cells[k], Symbols::If)) {
+                                  /* if (condition) (then) (else) */
+                                  if (k + 3 >= v->cells.size()) {
+                                      return Ops::makeError("if statement must be of form if (condition) (then) (else).");
+                                  }
+                                  frame->insert(maybe);
+                                  auto cond = eval(v->cells[k + 1]);
+                                  if (!Ops::isError(cond)) {
+                                      frame->insert(cond);
+                                  } else {
+                                      return cond; /* Just return the error immediately if the condition failed to eval. */
+                                  }
+                                  frame->insert(v->cells[k+2]);
+                                  frame->insert(v->cells[k+3]);
+                                  k += 4;
+                              } else {
+                                  frame->insert(maybe);
+                                  ++k;
+                              }
                           } else {
-                              return cond; /* Just return the error immediately if the condition failed to eval. */
+                              return maybe; /* Return the error, don't try to eval further? */
                           }
-                          k += 4;
-                      } else {
-                          v->cells[k] = maybe;
-                          ++k;
                       }
-                  } else {
-                      return maybe; /* Return the error, don't try to eval further? */
-                  }
-              }
-            }
+                    }
 
-            /* applicative order eval, reduced the arguments, call the fn. */
+                    /* applicative order eval, reduced the arguments, call the fn. */
 
-            if ( v->cells[0]->kind == Type::BuiltinFunction ) {
-                ValuePtr fn = v->cells[0];
-                v->cells.pop_front();
-                return evalBuiltinFunction(fn,vp);
-            }
-            else if ( v->cells[0]->kind == Type::Function )  {
-                ValuePtr lambda = v->cells[0];
-                v->cells.pop_front();
-                return evalLambdaFunction(lambda,vp);
+                    if ( frame->cells[0]->kind == Type::BuiltinFunction ) {
+                        ValuePtr fn = frame->cells[0];
+                        if ( frame->cells.size() != 4 || !isBuiltin(fn, builtin_if) ) {
+                            frame->cells.pop_front();
+                            return evalBuiltinFunction(fn,Ops::makeSExpression(frame));
+                        }
 
-            }
-            else {
-                /* Make a list of the results, if one result return head. */
-                ExpressionPtr xs(new Expression());
-                for (size_t i=0; i<v->cells.size(); i++) {
-                    if ( !Ops::isEmptyExpression(v->cells[i]))
-                        xs->insert(v->cells[i]);
+                        /* if (condition) (then) (else), continue with the branch taken. */
+                        ValuePtr cond = frame->cells[1];
+                        if (cond->kind != Type::Integer) return Ops::makeError("if condition must return true or false.");
+                        next = std::get<long>(cond->var) ? frame->cells[2] : frame->cells[3];
+                    }
+                    else if ( frame->cells[0]->kind == Type::Function )  {
+                        ValuePtr lambda = frame->cells[0];
+                        frame->cells.pop_front();
+
+                        EnvironmentPtr scope;
+                        ValuePtr result = evalLambdaFunction(lambda, frame->cells.begin(), frame->cells.end(), scope);
+                        if ( result ) return result;
+
+                        /* continue with the body of the lambda in its scope. */
+                        if ( Trace::enabled() ) Trace::record(v, *env, Type::Function, true);
+                        if ( !guard ) guard.emplace(*this, env);
+                        env = scope;
+                        profile.enter(lambda);
+                        next = std::get<LambdaPtr>(lambda->var)->body;
+                    }
+                    else {
+                        /* Make a list of the results, if one result return head. */
+                        ExpressionPtr xs(new Expression());
+                        for (const auto& cell: frame->cells) {
+                            if ( !Ops::isEmptyExpression(cell))
+                                xs->insert(cell);
+                        }
+                        if (xs->cells.size()==1) return xs->cells[0];
+                        else return Ops::makeQExpression(xs);
+                    }
                 }
-                if (xs->cells.size()==1) return xs->cells[0];
-                else return Ops::makeQExpression(xs);
+
+                /* Evaluate the expression in tail position as an S-Expression. */
+                if ( !Ops::isExpression(next) ) return eval(next);
+                if ( Ops::isEmptyExpression(next) ) return next->kind == Type::SExpression ? next : Ops::makeSExpression();
+                v = std::get<ExpressionPtr>(next->var);
             }
         }
 
-        ValuePtr evalLambdaFunction(ValuePtr f, ValuePtr ar) {
+        /*
+         * Bind the arguments of a call to a lambda, returns nullptr with the scope that the body is
+         * to be evaluated in, or the result of the call if the body isn't evaluated.
+         */
+        template<typename Iterator>
+        ValuePtr evalLambdaFunction(const ValuePtr& f, Iterator begin, Iterator end, EnvironmentPtr& scope) {
             /* f contains:
              * the struct 'lambda':
              *  formals (Argument specification).
              *  body (Body of the function itself).
              *  evaluation environment.
              *
-             *  a sexpression:
-             *   contains the arguments to pass to the function.
-             */
-            LambdaPtr fn = std::get<LambdaPtr>(f->var);
-
-            /* copy arguments to formals;
-             * i)   if too many arguments - return an Error.
-             * ii)  too few, then partially apply.
-             * iii) allow variable number of args.
+             *  [begin,end) contains the (evaluated) arguments to pass to the function.
+             *
+             *  Neither the lambda nor its body is copied, the arguments are bound in
+             *  a new environment, so a call allocates in proportion to its arity.
              */
+            ValuePtr result = bindArguments(f, begin, end, scope);
+            if ( result ) return result; /* error, partial application or the lambda itself. */
 
-            ExpressionPtr a = std::get<ExpressionPtr>(ar->var);
-
-            size_t arg_count = a->cells.size();
-            ValuePtr formalsValuePtr = fn->formals->clone(); /* clone the formals for each execution. */
-
-            ExpressionPtr formals = std::get<ExpressionPtr>(formalsValuePtr->var);
-            size_t formals_count = formals->cells.size();
-
-            /* this flag is used to check if some args. initially supplied,
-             * so that we can differentiate between lambda defn. and partial application.
-             * i.e. both will have formals unspecified. */
-
-            bool hasSomeArgs = !a->cells.empty();
-            while ( ! a->cells.empty() ) {
-                if (formals->cells.empty()) {
-                    std::string str = fmt::format("function passed too many arguments {} , expected {}", arg_count, formals_count);
-                    return Ops::makeError(str);
-                }
-
-                ValuePtr symbol = formals->cells[0];
-                formals->cells.pop_front();
-                if ( symbol->kind != Type::Symbol ) return Ops::makeError("function eval failed formal not a symbol.");
-                std::string symbol_name = std::get<std::string>(symbol->var);
-
-                if (symbol_name == "&") { /* variable arguments. */
-                    if (formals->cells.size() != 1) {
-                        return Ops::makeError("function signature invalid, varargs '&' must have one following symbol.");
-                    }
-                    /* We have something of the form "x & xs"; bind the 'xs' symbol to list of supplied args. */
-                    ValuePtr tmp = formals->cells[0];
-                    formals->cells.pop_front();
-                    if ( tmp->kind != Type::Symbol ) return Ops::makeError("function formal not a symbol.");
-                    ar->kind = Type::QExpression; /* make list expression. */
-                    std::string xs_name = std::get<std::string>(tmp->var);
-                    fn->env->insert(xs_name,ar);
-                    break;
-                }
-
-                ValuePtr argument = a->cells[0]; a->cells.pop_front();
-                fn->env->insert(symbol_name,argument);
-            }
-
-            if (!formals->cells.empty() && Ops::hasSymbolName(formals->cells[0],"&")) {
-                /* Case deals with variable arguments where nothing supplied for the variable
-                 * args, in this case, we can just assign the formal an empty expression. */
-                if ( formals->cells.size() != 2 )
-                    return Ops::makeError("function signature should be of form: x & xs when passing variable args.");
-                formals->cells.pop_front();
-                ValuePtr xs = formals->cells[0]; formals->cells.pop_front();
-                ValuePtr exp = Ops::makeQExpression();
-                if (xs->kind != Type::Symbol) return Ops::makeError("formal must be symbol.");
-                fn->env->insert(std::get<std::string>(xs->var) ,exp);
-            }
+            scope->setCallerScope(env);
+            return nullptr;
+        }
 
-            if (formals->cells.empty()) { /* Fully supplied args. */
-                fn->env->setOuterScope(env);
-                ValuePtr body = fn->body->clone();
-                body->kind = Type::SExpression;
-                return Inky::Lisp::eval(fn->env->clone(), body);
+        /* Call a function with arguments that have already been evaluated. */
+        ValuePtr apply(const ValuePtr& f, const ValuePtr* begin, const ValuePtr* end) {
+            if ( f->kind == Type::BuiltinFunction ) {
+                ExpressionPtr args(new Expression());
+                args->cells.assign(begin, end);
+                return evalBuiltinFunction(f, Ops::makeSExpression(args));
             }
-            else if ( hasSomeArgs && !formals->cells.empty() ) { /* Partially supplied args. */
-                LambdaPtr lambda(new Lambda());
-                lambda->formals = formalsValuePtr->clone();
-                lambda->body = fn->body->clone();
-                lambda->env = fn->env->clone();
-
-                return Ops::makeFunction(lambda);
+            if ( f->kind == Type::Function ) {
+                EnvironmentPtr scope;
+                ValuePtr result = evalLambdaFunction(f, begin, end, scope);
+                if ( result ) return result;
+                Profiler::Scope profile;
+                profile.enter(f);
+                return Inky::Lisp::evalExpression(scope, std::get<LambdaPtr>(f->var)->body);
             }
-
-            return f->clone(); // Return lambda, no args called yet, just return an empty instance for use.
+            return Ops::makeError("apply, first argument is not a function.");
         }
 
-        ValuePtr evalBuiltinFunction(ValuePtr f, ValuePtr a) {
-            auto fn = std::get<BuiltinFunction>(f->var);
+        ValuePtr evalBuiltinFunction(const ValuePtr& f, const ValuePtr& a) {
+            const auto& fn = std::get<BuiltinFunction>(f->var);
+            Profiler::Scope profile;
+            profile.enter(f);
+            Counters::builtinCall();
             return fn(env, a);
         }
 
     private:
+
+        /* The optimized form of an expression, nullptr if it has none or it no longer holds. */
+        const ValuePtr* reduced(const Expression& v) {
+            if ( v.reduction == nullptr ) return nullptr;
+            if ( global == nullptr ) global = env->globalScope(); /* every scope entered is nested in the same one. */
+            return global != nullptr && global->holds(*v.reduction) ? &v.reduction->value : nullptr;
+        }
+
+        /* Restores the environment of an evaluation that continued into the body of a lambda. */
+        struct ScopeGuard {
+            ScopeGuard(Eval& e, EnvironmentPtr saved) : ev(e), saved(std::move(saved)) {}
+            ~ScopeGuard() { ev.env = std::move(saved); }
+
+            Eval&           ev;
+            EnvironmentPtr  saved;
+        };
+
         EnvironmentPtr env;
+        const Environment* global = nullptr; /* of env, found when first needed. */
     };
 
 
@@ -311,4 +382,14 @@ namespace Inky::Lisp {
         Eval ev(env);
         return ev.eval(val);
     }
-}
\ No newline at end of file
+
+    ValuePtr evalExpression(EnvironmentPtr env, ValuePtr val) {
+        Eval ev(env);
+        return ev.evalExpression(val);
+    }
+
+    ValuePtr apply(const EnvironmentPtr& env, const ValuePtr& f, const ValuePtr* begin, const ValuePtr* end) {
+        Eval ev(env);
+        return ev.apply(f, begin, end);
+    }
+}
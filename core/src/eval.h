@@ -7,4 +7,19 @@ namespace Inky::Lisp {
 
     ValuePtr eval(EnvironmentPtr env, ValuePtr val);
 
+    /* Evaluate the cells of an S or Q expression as an S-Expression, the expression is not modified. */
+    ValuePtr evalExpression(EnvironmentPtr env, ValuePtr val);
+
+    /*
+     * Call the function f (builtin or lambda) with the evaluated arguments [begin,end), as a call made in env.
+     * Used by builtins that take a function argument.
+     */
+    ValuePtr apply(const EnvironmentPtr& env, const ValuePtr& f, const ValuePtr* begin, const ValuePtr* end);
+
+    /* Alternative to eval, compiles the expression to bytecode and runs it on the VM. */
+    ValuePtr execute(EnvironmentPtr env, ValuePtr val);
+
+    /* An evaluation entry point, eval or execute. */
+    typedef ValuePtr (*Evaluator)(EnvironmentPtr, ValuePtr);
+
 }
\ No newline at end of file
@@ -0,0 +1,156 @@
+#include <atomic>
+#include <memory>
+#include <new>
+
+#include "counters.h"
+#include "heap.h"
+
+namespace Inky::Lisp::Heap {
+
+    namespace {
+
+        /* Size of a heap block, room for a Value and the reference counts that shared_ptr keeps with it. */
+        constexpr size_t blockSize = sizeof(Value) + 4 * sizeof(void*);
+
+        std::atomic<size_t> limit { 4096 };
+
+        /* Totals of the threads that have exited, and of collect. */
+        std::atomic<size_t> retiredAllocated { 0 };
+        std::atomic<size_t> retiredFreed { 0 };
+        std::atomic<size_t> retiredReused { 0 };
+        std::atomic<size_t> collections { 0 };
+        std::atomic<size_t> released { 0 };
+
+        /*
+         * The free list of a thread. Each block is allocated individually, so a block allocated by
+         * one thread may be freed by another. The list is plain data, it remains usable while
+         * thread_local objects with destructors are torn down; Drain empties it when the thread exits.
+         */
+        struct FreeList {
+            struct Block { Block* next; };
+
+            Block*  head;
+            size_t  count;
+            bool    closed;
+
+            size_t  allocated;
+            size_t  freed;
+            size_t  reused;
+
+            size_t release() {
+                size_t n = 0;
+                while ( head != nullptr ) {
+                    Block* next = head->next;
+                    ::operator delete(head);
+                    head = next;
+                    n++;
+                }
+                count = 0;
+                return n;
+            }
+        };
+
+        thread_local FreeList local = { nullptr, 0, false, 0, 0, 0 };
+
+        struct Drain {
+            ~Drain() {
+                local.release();
+                local.closed = true;
+                retiredAllocated += local.allocated;
+                retiredFreed += local.freed;
+                retiredReused += local.reused;
+                local.allocated = local.freed = local.reused = 0;
+            }
+        };
+
+        thread_local Drain drain;
+
+        void* pop() {
+            FreeList& list = local;
+            list.allocated++;
+            if ( list.head == nullptr ) {
+                if ( !list.closed ) (void) &drain; /* register the drain on first use by this thread. */
+                return ::operator new(blockSize);
+            }
+            list.reused++;
+            FreeList::Block* block = list.head;
+            list.head = block->next;
+            list.count--;
+            return block;
+        }
+
+        void push(void* p) {
+            FreeList& list = local;
+            list.freed++;
+            if ( list.closed || list.count >= limit.load(std::memory_order_relaxed) ) {
+                ::operator delete(p);
+                return;
+            }
+            auto block = static_cast<FreeList::Block*>(p);
+            block->next = list.head;
+            list.head = block;
+            list.count++;
+        }
+
+        /* Allocator used by allocate_shared, the Value and its reference counts share one block. */
+        template<typename T>
+        struct BlockAllocator {
+            using value_type = T;
+
+            BlockAllocator() = default;
+            template<typename U> BlockAllocator(const BlockAllocator<U>&) {}
+
+            T* allocate(size_t n) {
+                if constexpr ( sizeof(T) <= blockSize && alignof(T) <= alignof(std::max_align_t) ) {
+                    if ( n == 1 ) return static_cast<T*>(pop());
+                }
+                return std::allocator<T>().allocate(n);
+            }
+
+            void deallocate(T* p, size_t n) {
+                if constexpr ( sizeof(T) <= blockSize && alignof(T) <= alignof(std::max_align_t) ) {
+                    if ( n == 1 ) {
+                        push(p);
+                        return;
+                    }
+                }
+                std::allocator<T>().deallocate(p, n);
+            }
+
+            template<typename U> bool operator==(const BlockAllocator<U>&) const { return true; }
+            template<typename U> bool operator!=(const BlockAllocator<U>&) const { return false; }
+        };
+    }
+
+    ValuePtr allocate(Value&& value) {
+        Counters::value(value.kind);
+        return std::allocate_shared<Value>(BlockAllocator<Value>(), std::move(value));
+    }
+
+    Stats stats() {
+        return Stats {
+            retiredAllocated + local.allocated,
+            retiredFreed + local.freed,
+            retiredReused + local.reused,
+            local.count,
+            limit,
+            collections,
+            released
+        };
+    }
+
+    size_t collect() {
+        size_t n = local.release();
+        collections++;
+        released += n;
+        return n;
+    }
+
+    void setLimit(size_t blocks) {
+        limit = blocks;
+        if ( local.count > blocks ) {
+            /* Trim the calling thread's list, others trim as blocks are freed. */
+            released += local.release();
+        }
+    }
+}
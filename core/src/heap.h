@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+
+#include "value.h"
+
+namespace Inky::Lisp {
+
+    /*
+     * Every Value is allocated from the heap. A Value and its reference counts share one block;
+     * freed blocks are kept on a per-thread free list and reused, so code that makes many short
+     * lived values (numbers) doesn't call the system allocator once it has warmed up.
+     */
+    namespace Heap {
+
+        struct Stats {
+            size_t allocated;   /* Values allocated.                                */
+            size_t freed;       /* Values freed.                                    */
+            size_t reused;      /* allocations served from a free list.             */
+            size_t pooled;      /* free blocks held by the calling thread.          */
+            size_t limit;       /* the most free blocks a thread holds.             */
+            size_t collections; /* number of calls to collect.                      */
+            size_t released;    /* blocks returned to the system by collect.        */
+        };
+
+        /* Move a value into a new heap block. */
+        ValuePtr allocate(Value&& value);
+
+        /*
+         * Heap statistics, the counts are of the calling thread and every thread that has exited;
+         * the number of live Values is allocated - freed.
+         */
+        Stats stats();
+
+        /* Return the calling thread's free blocks to the system allocator, returns the number released. */
+        size_t collect();
+
+        /* Set the most free blocks that each thread holds for reuse. */
+        void setLimit(size_t blocks);
+    }
+}
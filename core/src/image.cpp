@@ -0,0 +1,507 @@
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <unordered_map>
+#include <vector>
+#include <fmt/core.h>
+
+#include "bigint.h"
+#include "builtin.h"
+#include "environment.h"
+#include "image.h"
+#include "map.h"
+#include "memo.h"
+#include "source.h"
+#include "value.h"
+#include "vector.h"
+
+namespace Inky::Lisp {
+
+    /*
+     * The image is a header followed by a sequence of records, a record only refers to symbols,
+     * values and environments defined by records before it:
+     *
+     *  Symbol        name                                    defines the next symbol index.
+     *  Value         kind, payload                           defines the next value index.
+     *  Environment   frame flag, [slot names]                defines the next environment index, empty.
+     *  Bindings      environment, outer, definitions/slots   fills a defined environment.
+     *  End           the last record, a truncated image has none.
+     *
+     * An environment is defined before its bindings are written, so a lambda held in the scope of its
+     * own environment refers to an environment that already exists. Environment 0 is the global
+     * environment the image was saved from, on loading it is the environment the image is loaded into.
+     * Integers are fixed width, in the byte order of the machine that saved the image; BigIntegers are
+     * saved as decimal strings.
+     */
+    namespace {
+        constexpr char magic[8] = "INKYIMG";
+        constexpr uint32_t version = 2; /* 2: a function records its name. */
+        constexpr uint32_t none = UINT32_MAX; /* an unbound slot or no outer scope. */
+        constexpr const char* memoized = "#memoized"; /* the name of a memoized function, not a builtin's. */
+
+        enum class Record : uint8_t { Symbol, Value, Environment, Bindings, End };
+    }
+
+    class ImageWriter {
+    public:
+        explicit ImageWriter(EnvironmentPtr env) : root(env) {}
+
+        ValuePtr save(const std::string& path) {
+            if ( root->names != nullptr ) return Ops::makeError("image, only the global environment can be saved.");
+            out.append(magic, sizeof(magic));
+            write(version);
+
+            bool fresh;
+            declare(root.get(), fresh);
+            bindings(root.get());
+            write(Record::End);
+            if ( !error.empty() ) return Ops::makeError(fmt::format("image, {}", error));
+
+            std::ofstream file(path, std::ios::binary | std::ios::trunc);
+            file.write(out.data(), out.size());
+            if ( !file ) return Ops::makeError(fmt::format("image, unable to write file {}.", path));
+            return Ops::makeSExpression();
+        }
+
+    private:
+
+        template<typename T>
+        void write(T x) { out.append(reinterpret_cast<const char*>(&x), sizeof(T)); }
+
+        /* Give the next index to a symbol, value or environment that has been written. */
+        template<typename Map, typename Key>
+        static uint32_t add(Map& indices, Key key) {
+            uint32_t index = indices.size();
+            indices.emplace(key, index);
+            return index;
+        }
+
+        void write(const std::string& s) {
+            write<uint32_t>(s.size());
+            out.append(s);
+        }
+
+        uint32_t symbol(Symbol s) {
+            auto i = symbols.find(s.id);
+            if ( i != symbols.end() ) return i->second;
+            write(Record::Symbol);
+            write(symbolName(s));
+            return add(symbols, s.id);
+        }
+
+        /* Write the value, after the values it refers to, returns its index. */
+        uint32_t value(const ValuePtr& v) {
+            if ( v == nullptr ) return none;
+            auto i = values.find(v.get());
+            if ( i != values.end() ) return i->second;
+
+            switch (v->kind) {
+                case Type::Error:
+                    begin(v->kind);
+                    write(std::get<LispErrorPtr>(v->var)->message);
+                    break;
+                case Type::Integer: {
+                    long x = std::get<long>(v->var);
+                    if ( auto j = integers.find(x); j != integers.end() ) return j->second; /* atoms are shared. */
+                    begin(v->kind);
+                    write<int64_t>(x);
+                    return integers[x] = add(values, v.get());
+                }
+                case Type::Double:
+                    begin(v->kind);
+                    write(std::get<double>(v->var));
+                    break;
+                case Type::String:
+                    begin(v->kind);
+                    write(std::get<std::string>(v->var));
+                    break;
+                case Type::BigInteger:
+                    begin(v->kind);
+                    write(std::get<BigIntegerPtr>(v->var)->toString());
+                    break;
+                case Type::Vector: {
+                    const Vector& x = *std::get<VectorPtr>(v->var);
+                    begin(v->kind);
+                    write<uint8_t>(x.isDouble());
+                    write<uint32_t>(x.size());
+                    if ( x.isDouble() ) for (double d: x.doubles()) write(d);
+                    else for (long l: x.longs()) write<int64_t>(l);
+                    break;
+                }
+                case Type::Symbol: {
+                    uint32_t s = symbol(std::get<Symbol>(v->var));
+                    if ( auto j = symbolValues.find(s); j != symbolValues.end() ) return j->second;
+                    begin(v->kind);
+                    write(s);
+                    return symbolValues[s] = add(values, v.get());
+                }
+                case Type::BuiltinFunction: {
+                    if ( MemoPtr memo = memoOf(v) ) { /* the function is saved, its cached results aren't. */
+                        uint32_t f = value(memo->function());
+                        begin(v->kind);
+                        write(std::string(memoized));
+                        write(f);
+                        write<uint64_t>(memo->stats().capacity);
+                        break;
+                    }
+                    const char* name = builtinName(v);
+                    if ( name == nullptr ) error = "a builtin function that isn't registered by name can't be saved.";
+                    begin(v->kind);
+                    write(std::string(name ? name : ""));
+                    break;
+                }
+                case Type::Function: {
+                    LambdaPtr fn = std::get<LambdaPtr>(v->var);
+                    uint32_t formals = value(fn->formals);
+                    uint32_t body = value(fn->body);
+                    uint32_t name = symbol(fn->name);
+                    bool fresh;
+                    uint32_t env = declare(fn->env.get(), fresh);
+                    begin(v->kind);
+                    write(formals);
+                    write(body);
+                    write(env);
+                    write(name);
+                    uint32_t index = add(values, v.get());
+                    if ( fresh ) bindings(fn->env.get());
+                    return index;
+                }
+                case Type::Map: {
+                    std::vector<uint32_t> xs;
+                    for (const auto& entry: std::get<MapPtr>(v->var)->entries()) {
+                        if ( !entry.key ) continue;
+                        xs.push_back(value(entry.key));
+                        xs.push_back(value(entry.value));
+                    }
+                    begin(v->kind);
+                    write<uint32_t>(xs.size() / 2);
+                    for (auto x: xs) write(x);
+                    break;
+                }
+                case Type::SExpression:
+                case Type::QExpression: {
+                    const Cells& cells = std::get<ExpressionPtr>(v->var)->cells;
+                    std::vector<uint32_t> xs;
+                    xs.reserve(cells.size());
+                    for (const auto& c: cells) xs.push_back(value(c));
+                    begin(v->kind);
+                    write<uint32_t>(xs.size());
+                    for (auto x: xs) write(x);
+                    break;
+                }
+            }
+            return add(values, v.get());
+        }
+
+        void begin(Type kind) {
+            write(Record::Value);
+            write<uint8_t>((uint8_t) kind);
+        }
+
+        /* Write the environment record, if it hasn't been, returns its index. Its bindings are written separately. */
+        uint32_t declare(const Environment* e, bool& fresh) {
+            fresh = false;
+            if ( e == nullptr ) return none;
+            auto i = environments.find(e);
+            if ( i != environments.end() ) return i->second;
+
+            std::vector<uint32_t> names;
+            if ( e->names != nullptr ) {
+                for (auto s: *e->names) names.push_back(symbol(s));
+            }
+            write(Record::Environment);
+            write<uint8_t>(e->names != nullptr);
+            if ( e->names != nullptr ) {
+                write<uint32_t>(names.size());
+                for (auto s: names) write(s);
+            }
+            fresh = true;
+            return add(environments, e);
+        }
+
+        void bindings(const Environment* e) {
+            bool fresh;
+            uint32_t outer = declare(e->outer.get(), fresh);
+            if ( fresh ) bindings(e->outer.get());
+
+            std::vector<std::pair<uint32_t, uint32_t>> definitions; /* symbol, value. */
+            std::vector<uint32_t> slots;
+            for (const auto& [name, v]: e->definitions) definitions.emplace_back(symbol(name), value(v));
+            for (const auto& v: e->slots) slots.push_back(value(v));
+            for (const auto& [name, v]: e->locals) definitions.emplace_back(symbol(name), value(v));
+
+            write(Record::Bindings);
+            write(environments[e]);
+            write(outer);
+            for (auto s: slots) write(s);
+            write<uint32_t>(definitions.size());
+            for (const auto& [name, v]: definitions) {
+                write(name);
+                write(v);
+            }
+        }
+
+    private:
+        EnvironmentPtr  root;
+        std::string     out;
+        std::string     error;
+
+        std::unordered_map<uint32_t, uint32_t>              symbols;        /* symbol id to index. */
+        std::unordered_map<const Value*, uint32_t>          values;
+        std::unordered_map<long, uint32_t>                  integers;       /* value index of each integer and symbol. */
+        std::unordered_map<uint32_t, uint32_t>              symbolValues;
+        std::unordered_map<const Environment*, uint32_t>    environments;
+    };
+
+
+    class ImageReader {
+    public:
+        ImageReader(std::string_view data, EnvironmentPtr env) : i(data.data()), end(data.data() + data.size()), root(env) {}
+
+        /* Returns the error message, empty if the image was loaded. */
+        std::string load() {
+            if ( size_t(end - i) < sizeof(magic) || std::memcmp(i, magic, sizeof(magic)) != 0 ) return "not an inky image.";
+            i += sizeof(magic);
+            if ( read<uint32_t>() != version ) return "unsupported image version.";
+
+            for (bool last = false; !last; ) {
+                Record record = read<Record>();
+                if ( !ok ) break;
+                switch ( record ) {
+                    case Record::Symbol:
+                        symbols.push_back(intern(string()));
+                        break;
+                    case Record::Value:
+                        values.push_back(value());
+                        break;
+                    case Record::Environment:
+                        environments.push_back(environment());
+                        break;
+                    case Record::Bindings:
+                        bindings();
+                        break;
+                    case Record::End:
+                        last = true;
+                        break;
+                    default:
+                        ok = false;
+                }
+            }
+            if ( !ok || i != end ) return "image is corrupt.";
+
+            /* the global scope is only changed once the whole image has been read. */
+            for (const auto& e: environments) root->markLocals(e->slotNames());
+            for (auto& [name, v]: globals) root->insert(name, std::move(v));
+            return "";
+        }
+
+    private:
+
+        template<typename T>
+        T read() {
+            T x {};
+            if ( size_t(end - i) < sizeof(T) ) {
+                ok = false;
+                return x;
+            }
+            std::memcpy(&x, i, sizeof(T));
+            i += sizeof(T);
+            return x;
+        }
+
+        std::string_view string() {
+            size_t n = read<uint32_t>();
+            if ( size_t(end - i) < n ) {
+                ok = false;
+                return {};
+            }
+            std::string_view s(i, n);
+            i += n;
+            return s;
+        }
+
+        /* Look up an index, an index that isn't defined yet is an error; none is nullptr. */
+        template<typename T>
+        T get(const std::vector<T>& xs, uint32_t index, bool optional = false) {
+            if ( index == none && optional ) return T{};
+            if ( index >= xs.size() ) {
+                ok = false;
+                return T{};
+            }
+            return xs[index];
+        }
+
+        Symbol symbol() {
+            uint32_t index = read<uint32_t>();
+            if ( index >= symbols.size() ) {
+                ok = false;
+                return Symbols::Varargs;
+            }
+            return symbols[index];
+        }
+
+        ValuePtr value() {
+            Type kind = (Type) read<uint8_t>();
+            switch (kind) {
+                case Type::Error:           return Ops::makeError(std::string(string()));
+                case Type::Integer:         return Ops::makeInteger(read<int64_t>());
+                case Type::Double:          return Ops::makeDouble(read<double>());
+                case Type::String:          return Ops::makeString(std::string(string()));
+                case Type::Symbol:          return Ops::makeSymbol(symbol());
+                case Type::BigInteger: {
+                    auto big = BigInteger::parse(string());
+                    if ( !big ) {
+                        ok = false;
+                        return nullptr;
+                    }
+                    return Ops::makeBigInteger(std::move(*big));
+                }
+                case Type::Vector: {
+                    bool is_double = read<uint8_t>();
+                    uint32_t n = read<uint32_t>();
+                    if ( size_t(end - i) / sizeof(int64_t) < n ) {
+                        ok = false;
+                        return nullptr;
+                    }
+                    Vector x;
+                    if ( is_double ) {
+                        std::vector<double> xs(n);
+                        for (auto& d: xs) d = read<double>();
+                        x.elements = std::move(xs);
+                    } else {
+                        std::vector<long> xs(n);
+                        for (auto& l: xs) l = read<int64_t>();
+                        x.elements = std::move(xs);
+                    }
+                    return Ops::makeVector(std::move(x));
+                }
+                case Type::BuiltinFunction: {
+                    std::string_view name = string();
+                    if ( name == memoized ) {
+                        ValuePtr f = get(values, read<uint32_t>());
+                        size_t capacity = read<uint64_t>();
+                        if ( !ok || f == nullptr ) return nullptr;
+                        return memoize(f, capacity);
+                    }
+                    ValuePtr builtin = makeBuiltin(name);
+                    if ( builtin == nullptr ) ok = false;
+                    return builtin;
+                }
+                case Type::Function: {
+                    ValuePtr formals = get(values, read<uint32_t>());
+                    ValuePtr body = get(values, read<uint32_t>());
+                    EnvironmentPtr env = get(environments, read<uint32_t>());
+                    Symbol name = symbol();
+                    if ( !ok || !Ops::isExpression(formals) || env == nullptr ) {
+                        ok = false;
+                        return nullptr;
+                    }
+                    /* the formals are bound to the last slots of a frame (see bindArguments), there must be as many. */
+                    const SlotNames& names = env->slotNames();
+                    if ( names != nullptr && std::get<ExpressionPtr>(formals->var)->cells.size() > names->size() ) {
+                        ok = false;
+                        return nullptr;
+                    }
+                    return Ops::makeFunction(std::make_shared<Lambda>(Lambda{ formals, body, env, nullptr, name }));
+                }
+                case Type::Map: {
+                    uint32_t n = read<uint32_t>();
+                    if ( size_t(end - i) / (2 * sizeof(uint32_t)) < n ) {
+                        ok = false;
+                        return nullptr;
+                    }
+                    HashMap map;
+                    for (uint32_t k = 0; k < n; k++) {
+                        ValuePtr key = get(values, read<uint32_t>());
+                        ValuePtr value = get(values, read<uint32_t>());
+                        if ( !ok || !HashMap::isKey(key) ) {
+                            ok = false;
+                            return nullptr;
+                        }
+                        map.put(key, value);
+                    }
+                    return Ops::makeMap(std::move(map));
+                }
+                case Type::SExpression:
+                case Type::QExpression: {
+                    uint32_t n = read<uint32_t>();
+                    if ( size_t(end - i) / sizeof(uint32_t) < n ) {
+                        ok = false;
+                        return nullptr;
+                    }
+                    ExpressionPtr xs(new Expression());
+                    std::vector<ValuePtr> cells(n);
+                    for (auto& c: cells) c = get(values, read<uint32_t>());
+                    xs->cells.assign(cells.begin(), cells.end());
+                    return kind == Type::SExpression ? Ops::makeSExpression(xs) : Ops::makeQExpression(xs);
+                }
+            }
+            ok = false;
+            return nullptr;
+        }
+
+        EnvironmentPtr environment() {
+            bool frame = read<uint8_t>();
+            if ( environments.empty() ) { /* the global scope the image is loaded into. */
+                if ( frame ) ok = false;
+                return root;
+            }
+            if ( !frame ) return std::make_shared<Environment>();
+
+            uint32_t n = read<uint32_t>();
+            if ( size_t(end - i) / sizeof(uint32_t) < n ) {
+                ok = false;
+                return nullptr;
+            }
+            auto names = std::make_shared<std::vector<Symbol>>();
+            for (uint32_t k = 0; k < n; k++) names->push_back(symbol());
+            return std::make_shared<Environment>(names);
+        }
+
+        void bindings() {
+            EnvironmentPtr e = get(environments, read<uint32_t>());
+            EnvironmentPtr outer = get(environments, read<uint32_t>(), true);
+            if ( !ok ) return;
+            if ( e != root ) e->setOuterScope(outer);
+
+            size_t slots = e->slotNames() != nullptr ? e->slotNames()->size() : 0;
+            for (size_t k = 0; k < slots; k++) e->setSlot(k, get(values, read<uint32_t>(), true));
+            uint32_t n = read<uint32_t>();
+            for (uint32_t k = 0; k < n && ok; k++) {
+                Symbol name = symbol();
+                ValuePtr v = get(values, read<uint32_t>());
+                if ( !ok ) break;
+                if ( e == root ) globals.emplace_back(name, std::move(v));
+                else e->insert(name, v);
+            }
+        }
+
+    private:
+        const char*                 i;
+        const char*                 end;
+        bool                        ok = true;
+        EnvironmentPtr              root;
+
+        std::vector<Symbol>         symbols;
+        std::vector<ValuePtr>       values;
+        std::vector<EnvironmentPtr> environments;
+        std::vector<std::pair<Symbol, ValuePtr>> globals; /* the bindings of the root, in the order read. */
+    };
+
+
+    ValuePtr saveImage(EnvironmentPtr env, const std::string& path) {
+        ImageWriter writer(env);
+        return writer.save(path);
+    }
+
+    ValuePtr loadImage(EnvironmentPtr env, const std::string& path) {
+        SourceFile file(path);
+        if ( !file.isOpen() ) return Ops::makeError(fmt::format("image, unable to read file {}.", path));
+
+        ImageReader reader(file.text(), env);
+        std::string error = reader.load();
+        if ( !error.empty() ) return Ops::makeError(fmt::format("image {}, {}", path, error));
+        return Ops::makeSExpression();
+    }
+
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <string>
+
+#include "environment.h"
+#include "value.h"
+
+namespace Inky::Lisp {
+
+    /*
+     * An image holds the definitions of a global environment (with the lambdas, partially applied
+     * functions and their environments) in a compact binary form, so that a process can restore an
+     * initialised environment rather than evaluate the prelude and libraries each time it starts.
+     *
+     * Builtin functions are saved by name and re-linked to the builtins of the process restoring the
+     * image, symbols are saved by name and re-interned. Compiled code isn't saved, lambdas are
+     * compiled again when the VM first calls them, and memoized functions start with an empty cache.
+     * The image is read from a memory mapping.
+     */
+
+    /* Save the definitions of the global environment 'env', returns an error or an empty expression. */
+    ValuePtr saveImage(EnvironmentPtr env, const std::string& path);
+
+    /* Add the definitions held in an image to the global environment 'env', returns an error or an empty expression. */
+    ValuePtr loadImage(EnvironmentPtr env, const std::string& path);
+
+}
@@ -0,0 +1,41 @@
+#include "builtin.h"
+#include "image.h"
+#include "interpreter.h"
+#include "parser.h"
+#include "source.h"
+
+namespace Inky::Lisp {
+
+    Interpreter::Interpreter(Evaluator evaluator) : env(new Environment()), evaluator(evaluator) {
+        addBuiltinFunctions(env);
+    }
+
+    ValuePtr Interpreter::evaluate(std::string_view source) {
+        Sessions use(*this);
+        auto forms = parseForms(source);
+        if ( !forms ) return Ops::makeError(forms.left().message);
+
+        ValuePtr result = Ops::makeSExpression();
+        for (const auto& form: std::get<ExpressionPtr>(forms.right()->var)->cells) {
+            result = evaluator(env, form);
+            if ( Ops::isError(result) ) return result;
+        }
+        return result;
+    }
+
+    ValuePtr Interpreter::evaluate(const ValuePtr& form) {
+        Sessions use(*this);
+        return evaluator(env, form);
+    }
+
+    ValuePtr Interpreter::load(const std::string& path) {
+        Sessions use(*this);
+        return loadFile(env, path, evaluator);
+    }
+
+    ValuePtr Interpreter::loadImage(const std::string& path) {
+        Sessions use(*this);
+        return Inky::Lisp::loadImage(env, path);
+    }
+
+}
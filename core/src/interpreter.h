@@ -0,0 +1,85 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+#include "environment.h"
+#include "eval.h"
+#include "native.h"
+#include "profiler.h"
+#include "trace.h"
+#include "value.h"
+
+namespace Inky::Lisp {
+
+    /*
+     * An embeddable interpreter: a global environment with the builtins defined in it, evaluating
+     * source with the tree walker (eval) or the bytecode VM (execute).
+     *
+     * Each interpreter has its own global environment, with the definitions, inline caches and
+     * names bound by lambdas that go with it, and its own trace and profile (trace.h, profiler.h),
+     * used while it evaluates: enabling either records what this interpreter does, and no other's.
+     * So any number may run at once, each on its own thread; an interpreter is used by one thread
+     * at a time.
+     *
+     * What interpreters do share is process wide and safe to share: the symbol table, read without
+     * locks once a name is known to a thread; the thread pool the parallel builtins run on; the
+     * Counters; and the heap of the thread evaluating, a cache of free blocks (heap.h) whose limit
+     * and statistics are per thread, not per interpreter. The Trace and Profiler functions used
+     * outside of an interpreter record into the thread's own trace and the process wide profile.
+     */
+    class Interpreter {
+    public:
+        explicit Interpreter(Evaluator evaluator = eval);
+        ~Interpreter() = default;
+
+        Interpreter(const Interpreter&) = delete;
+        Interpreter& operator=(const Interpreter&) = delete;
+
+        /*
+         * Parse the forms of the source (one per line unless a form's brackets span lines) and
+         * evaluate them in turn, returns the result of the last or the first error.
+         */
+        ValuePtr evaluate(std::string_view source);
+
+        /* Evaluate a parsed form. */
+        ValuePtr evaluate(const ValuePtr& form);
+
+        /* Evaluate the forms of a file, as evaluate, errors are prefixed with the file's name. */
+        ValuePtr load(const std::string& path);
+
+        /* Restore the definitions saved in an image, see image.h. */
+        ValuePtr loadImage(const std::string& path);
+
+        /* Bind a name in the global environment. */
+        void define(std::string_view name, ValuePtr value) { env->insert(intern(name), std::move(value)); }
+
+        /* Bind a name to a C++ function or lambda, see native.h. */
+        template<typename F>
+        void registerNative(std::string_view name, F f) { Inky::Lisp::registerNative(env, name, std::move(f)); }
+
+        /* The value bound to a name in the global environment, nullptr if it is unbound. */
+        ValuePtr lookup(std::string_view name) const { return env->lookup(intern(name)); }
+
+        const EnvironmentPtr& environment() const { return env; }
+
+        /* The trace and the profile of this interpreter's evaluations. */
+        Trace::Session& trace() { return tracing; }
+        Profiler::Session& profile() { return profiling; }
+
+    private:
+        /* Uses the interpreter's trace and profile on the calling thread while in scope. */
+        struct Sessions {
+            explicit Sessions(Interpreter& i) : trace(&i.tracing), profile(&i.profiling) {}
+
+            Trace::Use      trace;
+            Profiler::Use   profile;
+        };
+
+        EnvironmentPtr      env;        /* Global environment.  */
+        Evaluator           evaluator;  /* eval or execute.     */
+        Trace::Session      tracing;
+        Profiler::Session   profiling;
+    };
+
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <fmt/core.h>
+
+#include "environment.h"
+#include "value.h"
+
+namespace Inky::Lisp {
+
+    /*
+     * Bind the arguments [begin,end) to the formals of the lambda 'f', in a new environment; the
+     * lambda itself is not modified. Shared by the tree walking evaluator and the VM:
+     *  i)   too many arguments is an error.
+     *  ii)  too few, then the result is a partially applied function.
+     *  iii) 'x & xs', binds any remaining arguments to xs as a list.
+     *
+     * Returns nullptr, with 'scope' set to the environment the body should be evaluated in, if all
+     * of the formals were supplied. Otherwise returns the result of the call: an error, the partially
+     * applied function or 'f' itself if no arguments were given.
+     */
+    template<typename Iterator>
+    ValuePtr bindArguments(ValuePtr f, Iterator begin, Iterator end, EnvironmentPtr& scope) {
+        LambdaPtr fn = std::get<LambdaPtr>(f->var);
+        ExpressionPtr formals = std::get<ExpressionPtr>(fn->formals->var);
+
+        size_t arg_count = std::distance(begin, end);
+        size_t formals_count = formals->cells.size();
+
+        /* Only the bindings of a partially applied function are copied, not the function's body. */
+        EnvironmentPtr e = fn->env->shallowCopy();
+
+        /*
+         * The formals are bound to the slots of the lambda's frame, a partially applied function has
+         * the trailing formals of the original lambda, so they are offset in its frame.
+         */
+        const SlotNames& names = e->slotNames();
+        size_t offset = names != nullptr ? names->size() - formals_count : 0;
+        auto bind = [&](size_t index, Symbol name, ValuePtr value) {
+            if ( names != nullptr ) e->setSlot(offset + index, value);
+            else e->insert(name, value);
+        };
+
+        size_t j = 0; /* index of the next unbound formal. */
+        for (auto i = begin; i != end; ++i) {
+            if ( j == formals_count ) {
+                std::string str = fmt::format("function passed too many arguments {} , expected {}", arg_count, formals_count);
+                return Ops::makeError(str);
+            }
+
+            ValuePtr symbol = formals->cells[j++];
+            if ( symbol->kind != Type::Symbol ) return Ops::makeError("function eval failed formal not a symbol.");
+            Symbol symbol_name = std::get<Symbol>(symbol->var);
+
+            if ( symbol_name == Symbols::Varargs ) { /* variable arguments. */
+                if ( formals_count - j != 1 ) {
+                    return Ops::makeError("function signature invalid, varargs '&' must have one following symbol.");
+                }
+                /* We have something of the form "x & xs"; bind the 'xs' symbol to list of supplied args. */
+                ValuePtr tmp = formals->cells[j++];
+                if ( tmp->kind != Type::Symbol ) return Ops::makeError("function formal not a symbol.");
+                ExpressionPtr xs(new Expression());
+                xs->cells.assign(i, end);
+                bind(j - 1, std::get<Symbol>(tmp->var), Ops::makeQExpression(xs));
+                break;
+            }
+
+            bind(j - 1, symbol_name, *i);
+        }
+
+        if ( j < formals_count && Ops::isSymbol(formals->cells[j], Symbols::Varargs) ) {
+            /* Case deals with variable arguments where nothing supplied for the variable
+             * args, in this case, we can just assign the formal an empty expression. */
+            if ( formals_count - j != 2 ) {
+                return Ops::makeError("function signature should be of form: x & xs when passing variable args.");
+            }
+            ValuePtr xs = formals->cells[j+1];
+            j += 2;
+            if ( xs->kind != Type::Symbol ) return Ops::makeError("formal must be symbol.");
+            bind(j - 1, std::get<Symbol>(xs->var), Ops::makeQExpression());
+        }
+
+        if ( j == formals_count ) { /* Fully supplied args. */
+            scope = e;
+            return nullptr;
+        }
+        else if ( arg_count > 0 ) { /* Partially supplied args. */
+            ExpressionPtr remaining(new Expression());
+            remaining->cells = formals->cells.drop(j);
+            ValuePtr remainingFormals = std::make_shared<Value>(Value { fn->formals->kind, remaining });
+            return Ops::makeFunction(std::make_shared<Lambda>(Lambda{ remainingFormals, fn->body, e, fn->code, fn->name }));
+        }
+
+        return f; /* No args, lambdas are immutable so the function itself is returned. */
+    }
+
+}
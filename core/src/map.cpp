@@ -0,0 +1,75 @@
+#include "builtin.h"
+#include "map.h"
+
+namespace Inky::Lisp {
+
+    bool HashMap::isKey(const ValuePtr& key) {
+        return Ops::isNumeric(key) || key->kind == Type::String || key->kind == Type::Symbol;
+    }
+
+    size_t HashMap::probe(const ValuePtr& key, size_t h) const {
+        size_t mask = slots.size() - 1;
+        for (size_t i = h & mask; ; i = (i + 1) & mask) {
+            int32_t slot = slots[i];
+            if ( slot == empty ) return i;
+            if ( slot != deleted && items[slot].hash == h && equals(items[slot].key, key) ) return i;
+        }
+    }
+
+    ValuePtr HashMap::find(const ValuePtr& key) const {
+        if ( slots.empty() ) return nullptr;
+        int32_t slot = slots[probe(key, hash(key))];
+        return slot == empty ? nullptr : items[slot].value;
+    }
+
+    void HashMap::put(ValuePtr key, ValuePtr value) {
+        size_t h = hash(key);
+        if ( !slots.empty() ) {
+            size_t i = probe(key, h);
+            if ( slots[i] != empty ) {
+                items[slots[i]].value = std::move(value);
+                return;
+            }
+        }
+
+        /* every entry, deleted or not, holds a slot; keep the table at most 3/4 full. */
+        if ( (items.size() + 1) * 4 > slots.size() * 3 ) rebuild(count + 1);
+        slots[probe(key, h)] = (int32_t) items.size();
+        items.push_back(Entry { std::move(key), std::move(value), h });
+        count++;
+    }
+
+    bool HashMap::erase(const ValuePtr& key) {
+        if ( slots.empty() ) return false;
+        size_t i = probe(key, hash(key));
+        if ( slots[i] == empty ) return false;
+
+        Entry& entry = items[slots[i]];
+        entry.key = nullptr;
+        entry.value = nullptr;
+        slots[i] = deleted;
+        count--;
+        return true;
+    }
+
+    void HashMap::rebuild(size_t n) {
+        size_t capacity = 8;
+        while ( capacity < 2 * n ) capacity *= 2;
+
+        std::vector<Entry> live;
+        live.reserve(n);
+        for (auto& entry: items) {
+            if ( entry.key ) live.push_back(std::move(entry));
+        }
+        items = std::move(live);
+
+        slots.assign(capacity, empty);
+        size_t mask = capacity - 1;
+        for (size_t k = 0; k < items.size(); k++) {
+            size_t i = items[k].hash & mask;
+            while ( slots[i] != empty ) i = (i + 1) & mask;
+            slots[i] = (int32_t) k;
+        }
+    }
+
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "value.h"
+
+namespace Inky::Lisp {
+
+    /*
+     * A hash map, the value of Type::Map. Keys are strings, symbols or numbers, compared as == compares
+     * them (so 1 and 1.0 are the same key), and hashed consistently with that comparison.
+     *
+     * The entries are held in insertion order and indexed by an open addressing table (linear
+     * probing) of entry indices, so iteration (map-keys, printing) follows insertion order. A
+     * deleted entry leaves a tombstone in both until the table is next rebuilt.
+     *
+     * A map value is never changed once made, map-put and map-del copy the map.
+     */
+    class HashMap {
+    public:
+        struct Entry {
+            ValuePtr    key;    /* nullptr if the entry was deleted. */
+            ValuePtr    value;
+            size_t      hash;
+        };
+
+        /* True if 'key' is of a type that can be a key. */
+        static bool isKey(const ValuePtr& key);
+
+        /* The value of 'key', nullptr if it isn't in the map. */
+        ValuePtr find(const ValuePtr& key) const;
+
+        /* Add or replace the value of 'key'. */
+        void put(ValuePtr key, ValuePtr value);
+
+        /* Remove 'key', false if it wasn't in the map. */
+        bool erase(const ValuePtr& key);
+
+        size_t size() const { return count; }
+
+        /* The entries in insertion order, skip those whose key is nullptr. */
+        const std::vector<Entry>& entries() const { return items; }
+
+    private:
+        static constexpr int32_t empty = -1;
+        static constexpr int32_t deleted = -2;
+
+        /* The slot holding 'key', or the empty slot that ends its probe sequence. */
+        size_t probe(const ValuePtr& key, size_t hash) const;
+
+        /* Rebuild the index with room for at least n entries, dropping deleted entries. */
+        void rebuild(size_t n);
+
+        std::vector<Entry>      items;
+        std::vector<int32_t>    slots;      /* a power of two in size, or empty. */
+        size_t                  count = 0;  /* entries that aren't deleted.      */
+    };
+
+}
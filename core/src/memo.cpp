@@ -0,0 +1,161 @@
+#include <algorithm>
+#include <cstring>
+#include <fmt/core.h>
+
+#include "bigint.h"
+#include "builtin.h"
+#include "eval.h"
+#include "map.h"
+#include "memo.h"
+#include "profiler.h"
+#include "vector.h"
+
+namespace Inky::Lisp {
+
+    namespace {
+        /* The callable of a memoized builtin, a type of its own so that memoOf can recover the memo. */
+        struct Memoized {
+            MemoPtr memo;
+
+            ValuePtr operator()(const EnvironmentPtr& env, const ValuePtr& args) const { return memo->call(env, args); }
+        };
+    }
+
+    Memo::Memo(ValuePtr f, size_t capacity)
+        : f(std::move(f)),
+          profiledName(intern(fmt::format("{} (memoized)", symbolName(Profiler::nameOf(this->f))))),
+          capacity(capacity > 0 ? capacity : 1) {}
+
+    /* The hash of ==, arguments that are the same are equal. */
+    size_t Memo::KeyHash::operator()(const Key& key) const {
+        size_t h = key.size();
+        for (const auto& v: key) h ^= hash(v) + 0x9e3779b97f4a7c15 + (h << 6) + (h >> 2);
+        return h;
+    }
+
+    bool Memo::KeyEqual::operator()(const Key& x, const Key& y) const {
+        if ( x.size() != y.size() ) return false;
+        for (size_t k = 0; k < x.size(); k++) {
+            if ( !same(x[k], y[k]) ) return false;
+        }
+        return true;
+    }
+
+    bool Memo::same(const ValuePtr& a, const ValuePtr& b) {
+        if ( a == b ) return true;
+        if ( a->kind != b->kind ) return false;
+
+        switch (a->kind) {
+            case Type::Integer:
+                return std::get<long>(a->var) == std::get<long>(b->var);
+            case Type::Double: { /* bitwise, 0.0 and -0.0 differ (1/x) as do NaNs. */
+                double x = std::get<double>(a->var), y = std::get<double>(b->var);
+                return std::memcmp(&x, &y, sizeof(double)) == 0;
+            }
+            case Type::BigInteger:
+                return std::get<BigIntegerPtr>(a->var)->compare(*std::get<BigIntegerPtr>(b->var)) == 0;
+            case Type::BuiltinFunction:
+                return false; /* only the same value, above. */
+            case Type::Function: {
+                LambdaPtr x = std::get<LambdaPtr>(a->var);
+                LambdaPtr y = std::get<LambdaPtr>(b->var);
+                return x == y || (x->body == y->body && equals(x->formals, y->formals) && sameFrames(*x->env, *y->env));
+            }
+            case Type::SExpression:
+            case Type::QExpression: {
+                const Cells& xs = std::get<ExpressionPtr>(a->var)->cells;
+                const Cells& ys = std::get<ExpressionPtr>(b->var)->cells;
+                if ( xs.size() != ys.size() ) return false;
+                for (size_t k = 0; k < xs.size(); k++) {
+                    if ( !same(xs[k], ys[k]) ) return false;
+                }
+                return true;
+            }
+            case Type::Vector:
+                return std::get<VectorPtr>(a->var)->elements == std::get<VectorPtr>(b->var)->elements;
+            case Type::Map: { /* keys are unique by ==, so each key has at most one counterpart. */
+                const HashMap& x = *std::get<MapPtr>(a->var);
+                const HashMap& y = *std::get<MapPtr>(b->var);
+                if ( x.size() != y.size() ) return false;
+                for (const auto& entry: x.entries()) {
+                    if ( !entry.key ) continue;
+                    auto match = std::find_if(y.entries().begin(), y.entries().end(), [&](const auto& other) {
+                        return other.key && equals(entry.key, other.key);
+                    });
+                    if ( match == y.entries().end() || !same(entry.key, match->key) || !same(entry.value, match->value) ) return false;
+                }
+                return true;
+            }
+            case Type::Error:
+            case Type::String:
+            case Type::Symbol:
+                return equals(a, b);
+        }
+        return false;
+    }
+
+    bool Memo::sameFrames(const Environment& x, const Environment& y) {
+        if ( &x == &y ) return true;
+        if ( x.names == nullptr || x.names != y.names || x.outer != y.outer ) return false;
+        if ( x.slots.size() != y.slots.size() || x.locals.size() != y.locals.size() ) return false;
+        for (size_t k = 0; k < x.slots.size(); k++) {
+            const ValuePtr& u = x.slots[k];
+            const ValuePtr& w = y.slots[k];
+            if ( u == nullptr || w == nullptr ? u != w : !same(u, w) ) return false;
+        }
+        for (size_t k = 0; k < x.locals.size(); k++) {
+            if ( x.locals[k].first != y.locals[k].first || !same(x.locals[k].second, y.locals[k].second) ) return false;
+        }
+        return true;
+    }
+
+    ValuePtr Memo::call(const EnvironmentPtr& env, const ValuePtr& args) {
+        Key key;
+        if ( Ops::isExpression(args) ) {
+            const Cells& cells = std::get<ExpressionPtr>(args->var)->cells;
+            key.assign(cells.begin(), cells.end());
+        }
+
+        /* without arguments there's nothing to cache, the application is the function itself. */
+        if ( key.empty() ) return apply(env, f, nullptr, nullptr);
+
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            if ( auto i = index.find(key); i != index.end() ) {
+                hits++;
+                entries.splice(entries.begin(), entries, i->second);
+                return i->second->second;
+            }
+            misses++;
+        }
+
+        ValuePtr result = apply(env, f, key.data(), key.data() + key.size());
+        if ( Ops::isError(result) ) return result;
+
+        std::lock_guard<std::mutex> guard(lock);
+        if ( index.count(key) ) return result; /* added by another call meanwhile. */
+        entries.emplace_front(key, result);
+        index.emplace(std::move(key), entries.begin());
+        if ( entries.size() > capacity ) {
+            index.erase(entries.back().first);
+            entries.pop_back();
+        }
+        return result;
+    }
+
+    Memo::Stats Memo::stats() const {
+        std::lock_guard<std::mutex> guard(lock);
+        return Stats { hits, misses, entries.size(), capacity };
+    }
+
+    ValuePtr memoize(const ValuePtr& f, size_t capacity) {
+        return Ops::makeBuiltin(Memoized { std::make_shared<Memo>(f, capacity) });
+    }
+
+    MemoPtr memoOf(const ValuePtr& v) {
+        if ( v->kind != Type::BuiltinFunction ) return nullptr;
+        auto memoized = std::get<BuiltinFunction>(v->var).target<Memoized>();
+        return memoized ? memoized->memo : nullptr;
+    }
+
+}
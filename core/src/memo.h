@@ -0,0 +1,78 @@
+#pragma once
+
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "environment.h"
+#include "value.h"
+
+namespace Inky::Lisp {
+
+    /*
+     * The results of a function, cached by the values of its arguments, so a pure function called
+     * again with the same arguments returns the cached result rather than being applied. Arguments
+     * are compared as by ==, except that numbers are the same only if they are of the same kind (3
+     * and 3.0 may give different results), a builtin only to itself, and a lambda to one with the
+     * same body whose frame holds the same values (partial applications of one function). The cache holds at most 'capacity' results, the
+     * least recently used is evicted to make room. Errors aren't cached.
+     *
+     * The lock isn't held while the function is applied, so a memoized function may call itself (a
+     * recursive definition is bound to its memoized version) and be called from parallel tasks.
+     */
+    class Memo {
+    public:
+        Memo(ValuePtr f, size_t capacity);
+
+        /* Apply the function to the cells of the expression 'args', or return the cached result. */
+        ValuePtr call(const EnvironmentPtr& env, const ValuePtr& args);
+
+        struct Stats {
+            size_t hits;
+            size_t misses;
+            size_t size;
+            size_t capacity;
+        };
+        Stats stats() const;
+
+        const ValuePtr& function() const { return f; }
+
+        /* The name its calls are profiled under, "f (memoized)". */
+        Symbol name() const { return profiledName; }
+
+    private:
+        typedef std::vector<ValuePtr> Key;
+
+        struct KeyHash { size_t operator()(const Key& key) const; };
+        struct KeyEqual { bool operator()(const Key& x, const Key& y) const; };
+
+        /* True if the arguments 'a' and 'b' are the same, as described above; the same values are equal. */
+        static bool same(const ValuePtr& a, const ValuePtr& b);
+        static bool sameFrames(const Environment& x, const Environment& y);
+
+        /* Most recently used first. */
+        typedef std::list<std::pair<Key, ValuePtr>> Entries;
+
+        ValuePtr            f;
+        Symbol              profiledName;
+        size_t              capacity;
+        Entries             entries;
+        std::unordered_map<Key, Entries::iterator, KeyHash, KeyEqual> index;
+        size_t              hits = 0;
+        size_t              misses = 0;
+        mutable std::mutex  lock;
+    };
+
+    typedef std::shared_ptr<Memo> MemoPtr;
+
+    /* Results cached when a capacity isn't given (memoize f, defmemo). */
+    constexpr size_t defaultMemoCapacity = 10000;
+
+    /* A builtin that applies 'f' through a new Memo, as made by memoize and defmemo. */
+    ValuePtr memoize(const ValuePtr& f, size_t capacity = defaultMemoCapacity);
+
+    /* The memo of a value made by memoize, nullptr if it isn't one. */
+    MemoPtr memoOf(const ValuePtr& v);
+
+}
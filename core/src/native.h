@@ -0,0 +1,175 @@
+#pragma once
+
+#include <limits>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <fmt/core.h>
+
+#include "environment.h"
+#include "value.h"
+
+namespace Inky::Lisp {
+
+    /*
+     * Native functions: a C++ function or lambda registered as a builtin, e.g.
+     *
+     *      registerNative(env, "clamp", +[](double x, double lo, double hi) { return std::min(std::max(x, lo), hi); });
+     *
+     * The arity and the conversion of each argument are derived from the function's signature at
+     * compile time; the builtin checks the number of arguments and their kinds, converts them and
+     * calls the function directly, so the function is inlined into it when it can be.
+     *
+     * Arguments may be integral (from an Integer in range), floating point (Integer or Double), bool
+     * (an Integer, non-zero is true), std::string, std::string_view (String), Symbol or ValuePtr (any
+     * value, unconverted). The result may be any of these, or void for an empty expression; a native
+     * function reports an error by returning an error ValuePtr.
+     *
+     * Natives aren't registered by name with the builtins, so an image can't save them.
+     */
+    namespace Native {
+
+        template<typename T, typename = void>
+        struct Argument; /* no conversion for T, it isn't a supported argument type. */
+
+        template<typename T>
+        struct Argument<T, std::enable_if_t<std::is_integral_v<T> && !std::is_same_v<T, bool>>> {
+            static constexpr const char* type = "<integer>";
+            static bool accepts(const ValuePtr& v) {
+                if ( v->kind != Type::Integer ) return false;
+                long l = std::get<long>(v->var);
+                if constexpr ( std::is_signed_v<T> ) {
+                    return l >= (long) std::numeric_limits<T>::min() && l <= (long) std::numeric_limits<T>::max();
+                } else {
+                    return l >= 0 && (unsigned long) l <= std::numeric_limits<T>::max();
+                }
+            }
+            static T get(const ValuePtr& v) { return (T) std::get<long>(v->var); }
+        };
+
+        template<typename T>
+        struct Argument<T, std::enable_if_t<std::is_floating_point_v<T>>> {
+            static constexpr const char* type = "<double>";
+            static bool accepts(const ValuePtr& v) { return v->kind == Type::Double || v->kind == Type::Integer; }
+            static T get(const ValuePtr& v) {
+                return (T) (v->kind == Type::Double ? std::get<double>(v->var) : (double) std::get<long>(v->var));
+            }
+        };
+
+        template<>
+        struct Argument<bool> {
+            static constexpr const char* type = "<integer>";
+            static bool accepts(const ValuePtr& v) { return v->kind == Type::Integer; }
+            static bool get(const ValuePtr& v) { return std::get<long>(v->var) != 0; }
+        };
+
+        template<>
+        struct Argument<std::string> {
+            static constexpr const char* type = "<string>";
+            static bool accepts(const ValuePtr& v) { return v->kind == Type::String; }
+            static const std::string& get(const ValuePtr& v) { return std::get<std::string>(v->var); }
+        };
+
+        template<>
+        struct Argument<std::string_view> : Argument<std::string> {};
+
+        template<>
+        struct Argument<Symbol> {
+            static constexpr const char* type = "<symbol>";
+            static bool accepts(const ValuePtr& v) { return v->kind == Type::Symbol; }
+            static Symbol get(const ValuePtr& v) { return std::get<Symbol>(v->var); }
+        };
+
+        template<>
+        struct Argument<ValuePtr> {
+            static constexpr const char* type = "<value>";
+            static bool accepts(const ValuePtr&) { return true; }
+            static const ValuePtr& get(const ValuePtr& v) { return v; }
+        };
+
+        /* The Value of a native function's result. */
+        template<typename R>
+        ValuePtr result(R&& r) {
+            using T = std::decay_t<R>;
+            if constexpr ( std::is_same_v<T, ValuePtr> ) return std::forward<R>(r);
+            else if constexpr ( std::is_same_v<T, bool> ) return Ops::makeInteger(r ? 1 : 0);
+            else if constexpr ( std::is_integral_v<T> ) {
+                static_assert(sizeof(T) < sizeof(long) || std::is_signed_v<T>, "an unsigned long result may not fit an Integer.");
+                return Ops::makeInteger((long) r);
+            }
+            else if constexpr ( std::is_floating_point_v<T> ) return Ops::makeDouble((double) r);
+            else if constexpr ( std::is_same_v<T, Symbol> ) return Ops::makeSymbol(r);
+            else if constexpr ( std::is_convertible_v<R, std::string_view> ) return Ops::makeString(std::string(std::string_view(r)));
+            else static_assert(!sizeof(T), "unsupported native function result type.");
+        }
+
+        /* The signature of a function pointer or (non generic) lambda. */
+        template<typename F>
+        struct Signature : Signature<decltype(&F::operator())> {};
+
+        template<typename R, typename... A>
+        struct Signature<R (*)(A...)> {
+            using Result = R;
+            using Arguments = std::tuple<std::decay_t<A>...>;
+        };
+
+        template<typename C, typename R, typename... A>
+        struct Signature<R (C::*)(A...) const> : Signature<R (*)(A...)> {};
+
+        template<typename C, typename R, typename... A>
+        struct Signature<R (C::*)(A...)> : Signature<R (*)(A...)> {};
+
+        /* The builtin calling a native function 'f' with arguments 'A'. */
+        template<typename F, typename R, typename... A>
+        struct Function {
+            F       f;
+            Symbol  name;
+
+            ValuePtr operator()(const EnvironmentPtr&, const ValuePtr& a) const {
+                if ( !Ops::isExpression(a) ) return Ops::makeError(fmt::format("{}, arguments must be an expression.", symbolName(name)));
+                const Cells& cells = std::get<ExpressionPtr>(a->var)->cells;
+                if ( cells.size() != sizeof...(A) ) {
+                    return Ops::makeError(fmt::format("{}, expects {} arguments, received {}.", symbolName(name), sizeof...(A), cells.size()));
+                }
+                return call(cells, std::index_sequence_for<A...>{});
+            }
+
+        private:
+            template<size_t... I>
+            ValuePtr call(const Cells& cells, std::index_sequence<I...>) const {
+                size_t rejected = 0; /* the first argument that can't be converted, from 1. */
+                (void) ((Argument<A>::accepts(cells[I]) || (rejected = I + 1, false)) && ...);
+                if ( rejected != 0 ) return mismatch(cells, rejected, { Argument<A>::type... });
+
+                if constexpr ( std::is_void_v<R> ) {
+                    f(Argument<A>::get(cells[I])...);
+                    return Ops::makeSExpression();
+                }
+                else return result(f(Argument<A>::get(cells[I])...));
+            }
+
+            ValuePtr mismatch(const Cells& cells, size_t k, std::initializer_list<const char*> types) const {
+                std::ostringstream received;
+                received << cells[k - 1]->kind;
+                return Ops::makeError(fmt::format("{}, argument {} must be {}, received {}.", symbolName(name), k,
+                                                  *(types.begin() + k - 1), received.str()));
+            }
+        };
+
+        template<typename F, typename R, typename... A>
+        ValuePtr make(Symbol name, F f, Signature<R (*)(A...)>) {
+            return Ops::makeBuiltin(Function<F, R, std::decay_t<A>...> { std::move(f), name });
+        }
+    }
+
+    /* Bind 'name' to the native function 'f' (a function pointer or lambda) in the environment. */
+    template<typename F>
+    void registerNative(const EnvironmentPtr& env, std::string_view name, F f) {
+        Symbol symbol = intern(name);
+        env->insert(symbol, Native::make(symbol, std::move(f), Native::Signature<std::decay_t<F>> {}));
+    }
+
+}
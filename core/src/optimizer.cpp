@@ -0,0 +1,383 @@
+#include <cstring>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "builtin.h"
+#include "environment.h"
+#include "eval.h"
+#include "optimizer.h"
+
+
+namespace Inky::Lisp {
+
+    /*
+     * Rewrites a form following the evaluation rules of Eval::evalCells: special forms are
+     * recognised by symbol, the formals of lambda & defun and the names bound by def are left as
+     * they are, the condition of 'if' is evaluated and its branches are evaluated as S-Expressions.
+     *
+     * An expression that is folded, or replaced by a branch or an inlined body, is given a
+     * Reduction: the value it reduces to, which evaluates (by eval, or as a body by evalExpression)
+     * to the same result given the bindings of the global names looked up to reduce it. Those are
+     * recorded with the reduction as they are looked up. The expression itself keeps its cells, so
+     * it is evaluated as it is if one of those names is later redefined. A form is only rewritten
+     * where it changes, the rest of it is shared with the form parsed.
+     */
+    class Optimizer {
+    public:
+        Optimizer(EnvironmentPtr e, const ValuePtr& form) : env(std::move(e)), global(env->globalScope()) {
+            /* Names that may be rebound by the form; those the global scope's lambdas bind are marked local. */
+            bindings(form);
+            ifBinding = lookup(Symbols::If);
+            branches = isBuiltin(ifBinding, builtin_if);
+        }
+
+        ~Optimizer() = default;
+
+        /* A value evaluated by eval. */
+        ValuePtr cell(const ValuePtr& v) {
+            if ( v->kind == Type::SExpression ) return expression(v);
+            if ( v->kind == Type::Symbol ) {
+                for (const auto& kv: arguments) {
+                    if ( kv.first == std::get<Symbol>(v->var) ) return kv.second;
+                }
+            }
+            return v;
+        }
+
+    private:
+        /* The body of a lambda or a branch of 'if', evaluated as an S-Expression whatever its kind. */
+        ValuePtr body(const ValuePtr& v) {
+            return Ops::isExpression(v) ? expression(v) : cell(v);
+        }
+
+        ValuePtr expression(const ValuePtr& v) {
+            const Cells& cells = std::get<ExpressionPtr>(v->var)->cells;
+            if ( cells.empty() ) return v;
+
+            /* xs, the cells rewritten; ys, the values they reduce to, depending on 'dependencies'. */
+            ExpressionPtr xs(new Expression());
+            ExpressionPtr ys(new Expression());
+            Bindings dependencies;
+            bool changed = false;
+            auto put = [&](const ValuePtr& from, ValuePtr to) {
+                changed = changed || to != from;
+                ys->insert(reduced(to, dependencies));
+                xs->insert(std::move(to));
+            };
+
+            size_t k = 0;
+            while ( k < cells.size() ) {
+                const ValuePtr& c = cells[k];
+                if ( Ops::isSymbol(c, Symbols::Defun) || Ops::isSymbol(c, Symbols::Defmemo)
+                     || Ops::isSymbol(c, Symbols::Lambda) || Ops::isSymbol(c, Symbols::Backslash) ) {
+                    if ( k + 2 >= cells.size() ) break; /* an error when evaluated. */
+                    put(cells[k], cells[k]);
+                    put(cells[k+1], cells[k+1]);
+                    put(cells[k+2], body(cells[k+2]));
+                    k += 3;
+                }
+                else if ( Ops::isSymbol(c, Symbols::Def) || Ops::isSymbol(c, Symbols::Define) || Ops::isSymbol(c, Symbols::Assign) ) {
+                    if ( k + 2 >= cells.size() ) break;
+                    put(cells[k], cells[k]);
+                    put(cells[k+1], cells[k+1]);
+                    k += 2;
+                }
+                else if ( Ops::isSymbol(c, Symbols::If) ) {
+                    if ( k + 3 >= cells.size() ) break;
+                    put(cells[k], cells[k]);
+                    put(cells[k+1], cell(cells[k+1]));
+                    put(cells[k+2], branches ? body(cells[k+2]) : cells[k+2]);
+                    put(cells[k+3], branches ? body(cells[k+3]) : cells[k+3]);
+                    k += 4;
+                }
+                else {
+                    put(c, cell(c));
+                    k++;
+                }
+            }
+            for (; k < cells.size(); k++) {
+                xs->insert(cells[k]);
+                ys->insert(cells[k]);
+            }
+
+            size_t mark = used.size();
+            ValuePtr value = fold(ys->cells);
+            if ( value == nullptr ) value = branch(ys->cells);
+            if ( value == nullptr ) value = inlineCall(ys->cells);
+            for (size_t j = mark; value != nullptr && j < used.size(); j++) depend(dependencies, used[j]);
+            used.resize(mark);
+
+            ExpressionPtr result = changed ? xs : std::get<ExpressionPtr>(v->var);
+            if ( value != nullptr ) {
+                value = reduced(value, dependencies);
+                if ( dependencies.empty() ) return value; /* it can't change. */
+                auto reduction = std::make_shared<Reduction>();
+                reduction->value = std::move(value);
+                reduction->bindings = std::move(dependencies);
+                ExpressionPtr guarded(new Expression());
+                guarded->cells = result->cells;
+                guarded->reduction = std::move(reduction);
+                result = guarded;
+            }
+            else if ( !changed ) return v;
+            return std::make_shared<Value>(Value { v->kind, result });
+        }
+
+        /* A single value, or a call of an arithmetic or comparison builtin with constant arguments; its value. */
+        ValuePtr fold(const Cells& cells) {
+            if ( cells.size() == 1 && !Ops::isExpression(cells[0]) ) return cells[0];
+            if ( cells.size() < 2 || cells[0]->kind != Type::Symbol ) return nullptr;
+
+            ValuePtr f = lookup(std::get<Symbol>(cells[0]->var));
+            if ( !named(f, foldable) ) return nullptr;
+            for (size_t k = 1; k < cells.size(); k++) {
+                if ( !Ops::isNumeric(cells[k]) ) return nullptr;
+            }
+
+            ExpressionPtr args(new Expression());
+            args->cells = cells.drop(1);
+            ValuePtr result = std::get<BuiltinFunction>(f->var)(env, Ops::makeSExpression(args));
+            return Ops::isError(result) ? nullptr : result; /* left to fail when evaluated. */
+        }
+
+        /* 'if' with a constant condition, the branch taken. */
+        ValuePtr branch(const Cells& cells) {
+            if ( !branches || cells.size() != 4 || !Ops::isSymbol(cells[0], Symbols::If) ) return nullptr;
+            if ( cells[1]->kind != Type::Integer ) return nullptr;
+            used.emplace_back(Symbols::If, ifBinding);
+            return evaluated(std::get<long>(cells[1]->var) ? cells[2] : cells[3]);
+        }
+
+        /* A call of a lambda that can be inlined, its body with the arguments in place of its formals. */
+        ValuePtr inlineCall(const Cells& cells) {
+            if ( cells.size() < 2 || cells[0]->kind != Type::Symbol ) return nullptr;
+            ValuePtr f = lookup(std::get<Symbol>(cells[0]->var));
+            if ( f == nullptr || f->kind != Type::Function || !inlinable(f) ) return nullptr;
+
+            const Lambda& lambda = *std::get<LambdaPtr>(f->var);
+            const Cells& formals = std::get<ExpressionPtr>(lambda.formals->var)->cells;
+            if ( formals.size() != cells.size() - 1 ) return nullptr; /* partial application, or an error. */
+            for (size_t k = 1; k < cells.size(); k++) {
+                const ValuePtr& arg = cells[k];
+                bool atom = Ops::isNumeric(arg) || arg->kind == Type::String
+                            || (arg->kind == Type::Symbol && !special(std::get<Symbol>(arg->var)));
+                if ( !atom ) return nullptr;
+            }
+
+            std::vector<std::pair<Symbol, ValuePtr>> saved;
+            std::swap(saved, arguments);
+            for (size_t k = 0; k < formals.size(); k++) {
+                arguments.emplace_back(std::get<Symbol>(formals[k]->var), cells[k + 1]);
+            }
+            ValuePtr result = body(lambda.body);
+            std::swap(saved, arguments);
+            return evaluated(result);
+        }
+
+        /*
+         * True if the lambda's body may replace a call: it has a few fixed formals, none of them
+         * bound (it isn't partially applied), and its body calls only builtins that don't evaluate
+         * anything; so it can't see its formals being missing from the caller's scope.
+         */
+        bool inlinable(const ValuePtr& f) {
+            auto cached = lambdas.find(f.get());
+            if ( cached != lambdas.end() ) {
+                used.insert(used.end(), cached->second.dependencies.begin(), cached->second.dependencies.end());
+                return cached->second.ok;
+            }
+
+            size_t mark = used.size();
+            const Lambda& lambda = *std::get<LambdaPtr>(f->var);
+            bool ok = Ops::isExpression(lambda.formals) && lambda.env != nullptr && lambda.env->slotNames() != nullptr
+                      && lambda.env->locals.empty();
+            if ( ok ) {
+                const Cells& formals = std::get<ExpressionPtr>(lambda.formals->var)->cells;
+                const SlotNames& names = lambda.env->slotNames();
+                ok = !formals.empty() && formals.size() == names->size();
+                for (size_t k = 0; ok && k < formals.size(); k++) {
+                    ok = formals[k]->kind == Type::Symbol && !special(std::get<Symbol>(formals[k]->var))
+                         && lambda.env->slot(k) == nullptr;
+                }
+                size_t budget = inlineLimit;
+                ok = ok && pureBody(lambda.body, formals, budget);
+            }
+            lambdas.emplace(f.get(), Inlinable { ok, Bindings(used.begin() + mark, used.end()) });
+            return ok;
+        }
+
+        bool pureBody(const ValuePtr& v, const Cells& formals, size_t& budget) {
+            if ( !Ops::isExpression(v) ) return pureCell(v, formals, budget);
+            const Cells& cells = std::get<ExpressionPtr>(v->var)->cells;
+            if ( cells.size() == 1 ) return pureCell(cells[0], formals, budget);
+            if ( cells.empty() ) return true;
+
+            const ValuePtr& head = cells[0];
+            if ( Ops::isSymbol(head, Symbols::If) ) {
+                if ( branches ) used.emplace_back(Symbols::If, ifBinding);
+                return branches && cells.size() == 4 && pureCell(cells[1], formals, budget)
+                       && pureBody(cells[2], formals, budget) && pureBody(cells[3], formals, budget);
+            }
+            if ( head->kind == Type::Symbol ) {
+                Symbol name = std::get<Symbol>(head->var);
+                if ( contains(formals, name) || !named(lookup(name), pure) ) return false;
+            }
+            else if ( !constant(head) ) return false;
+
+            for (size_t k = 1; k < cells.size(); k++) {
+                if ( !pureCell(cells[k], formals, budget) ) return false;
+            }
+            return true;
+        }
+
+        bool pureCell(const ValuePtr& v, const Cells& formals, size_t& budget) {
+            if ( budget-- == 0 ) return false;
+            switch ( v->kind ) {
+                case Type::Symbol:
+                    return !special(std::get<Symbol>(v->var));
+                case Type::SExpression:
+                    return pureBody(v, formals, budget);
+                case Type::QExpression: /* data, the formals can't be substituted in it. */
+                    for (const auto& c: std::get<ExpressionPtr>(v->var)->cells) {
+                        if ( c->kind == Type::Symbol && (special(std::get<Symbol>(c->var)) || contains(formals, std::get<Symbol>(c->var))) ) return false;
+                        if ( Ops::isExpression(c) && !pureCell(Ops::makeQExpression(std::get<ExpressionPtr>(c->var)), formals, budget) ) return false;
+                    }
+                    return true;
+                default:
+                    return constant(v);
+            }
+        }
+
+        /* Collect the names bound by def, =, defun & lambda in a form. */
+        void bindings(const ValuePtr& v) {
+            if ( !Ops::isExpression(v) ) return;
+
+            const Cells& cells = std::get<ExpressionPtr>(v->var)->cells;
+            for (size_t k = 0; k < cells.size(); k++) {
+                if ( cells[k]->kind == Type::Symbol && special(std::get<Symbol>(cells[k]->var))
+                     && !Ops::isSymbol(cells[k], Symbols::If) && k + 1 < cells.size() ) {
+                    symbols(cells[k + 1]);
+                }
+                bindings(cells[k]);
+            }
+        }
+
+        void symbols(const ValuePtr& v) {
+            if ( v->kind == Type::Symbol ) bound.insert(std::get<Symbol>(v->var));
+            else if ( Ops::isExpression(v) ) {
+                for (const auto& c: std::get<ExpressionPtr>(v->var)->cells) symbols(c);
+            }
+        }
+
+        /* The value bound to a name, nullptr if the name is unbound or may be rebound; the lookup is recorded in 'used'. */
+        ValuePtr lookup(Symbol name) {
+            if ( global == nullptr || bound.count(name) != 0 || global->isLocal(name) ) return nullptr;
+            ValuePtr value = env->lookup(name);
+            used.emplace_back(name, value);
+            return value;
+        }
+
+        typedef std::vector<std::pair<Symbol, ValuePtr>> Bindings;
+
+        static void depend(Bindings& dependencies, const std::pair<Symbol, ValuePtr>& binding) {
+            for (const auto& d: dependencies) {
+                if ( d.first == binding.first ) return;
+            }
+            dependencies.push_back(binding);
+        }
+
+        /* A rewritten cell, the value of its reduction if it has one; which it then depends on too. */
+        static ValuePtr reduced(const ValuePtr& v, Bindings& dependencies) {
+            if ( !Ops::isExpression(v) ) return v;
+            const ReductionPtr& reduction = std::get<ExpressionPtr>(v->var)->reduction;
+            if ( reduction == nullptr ) return v;
+            for (const auto& binding: reduction->bindings) depend(dependencies, binding);
+            return reduction->value;
+        }
+
+        /* A branch, or body, in place of an expression evaluated by eval. */
+        static ValuePtr evaluated(const ValuePtr& v) {
+            if ( v->kind != Type::QExpression ) return v;
+            return Ops::makeSExpression(std::get<ExpressionPtr>(v->var));
+        }
+
+        static bool constant(const ValuePtr& v) { return Ops::isNumeric(v) || v->kind == Type::String; }
+
+        static bool special(Symbol s) { return Symbols::isSpecialForm(s) || s == Symbols::Varargs; }
+
+        static bool contains(const Cells& formals, Symbol name) {
+            for (const auto& c: formals) {
+                if ( Ops::isSymbol(c, name) ) return true;
+            }
+            return false;
+        }
+
+        /* True if 'f' is one of the builtins named. */
+        template<size_t N>
+        static bool named(const ValuePtr& f, const char* const (&names)[N]) {
+            if ( f == nullptr ) return false;
+            const char* name = builtinName(f);
+            if ( name == nullptr ) return false;
+            for (const char* n: names) {
+                if ( std::strcmp(n, name) == 0 ) return true;
+            }
+            return false;
+        }
+
+        /* Builtins folded when their arguments are constant. */
+        static constexpr const char* foldable[] = { "+", "-", "*", "/", "min", "max", "<", "<=", ">", ">=", "==", "!=" };
+
+        /* Builtins that neither evaluate their arguments nor use the environment, which an inlined body may call. */
+        static constexpr const char* pure[] = { "+", "-", "*", "/", "min", "max", "<", "<=", ">", ">=", "==", "!=",
+                                                "list", "head", "tail", "join", "len", "drop", "error",
+                                                "vec", "vlist", "vsum", "vdot", "vmin", "vmax", "v+", "v*",
+                                                "map-get", "map-put", "map-del", "map-keys" };
+
+        /* The most values in the body of a lambda that is inlined. */
+        static constexpr size_t inlineLimit = 32;
+
+        struct Inlinable {
+            bool        ok;
+            Bindings    dependencies; /* the builtins its body calls. */
+        };
+
+        EnvironmentPtr                                  env;
+        const Environment*                              global;     /* env's, nullptr if it hasn't one.         */
+        std::unordered_set<Symbol, SymbolHash>          bound;      /* names the form may rebind.               */
+        ValuePtr                                        ifBinding;
+        bool                                            branches;   /* 'if' is the builtin, and isn't rebound.  */
+        std::unordered_map<const Value*, Inlinable>     lambdas;    /* lambdas known to be inlinable, or not.   */
+        Bindings                                        arguments;  /* formals of the lambda being inlined.     */
+        Bindings                                        used;       /* names looked up by the reductions being made. */
+    };
+
+
+    ValuePtr optimize(const EnvironmentPtr& env, const ValuePtr& form) {
+        Optimizer optimizer(env, form);
+        return optimizer.cell(form);
+    }
+
+    ValuePtr optimized(const ValuePtr& form) {
+        if ( !Ops::isExpression(form) ) return form;
+        ExpressionPtr xs = std::get<ExpressionPtr>(form->var);
+        if ( xs->reduction != nullptr ) return optimized(xs->reduction->value);
+
+        ExpressionPtr ys(new Expression());
+        bool changed = false;
+        for (const auto& c: xs->cells) {
+            ys->insert(optimized(c));
+            changed = changed || ys->cells.back() != c;
+        }
+        return changed ? std::make_shared<Value>(Value { form->kind, ys }) : form;
+    }
+
+    ValuePtr evalOptimized(EnvironmentPtr env, ValuePtr val) {
+        return eval(env, optimize(env, val));
+    }
+
+    ValuePtr executeOptimized(EnvironmentPtr env, ValuePtr val) {
+        return execute(env, optimize(env, val));
+    }
+
+}
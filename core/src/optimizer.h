@@ -0,0 +1,42 @@
+#pragma once
+
+#include "environment.h"
+#include "value.h"
+
+namespace Inky::Lisp {
+
+    /*
+     * An optional pass between parse and eval that rewrites a form, so that less of it is evaluated
+     * each time it runs:
+     *  i)   a call of an arithmetic or comparison builtin (+ - * / min max < <= > >= == !=) whose
+     *       arguments are all numbers is folded to its result, by calling the builtin.
+     *  ii)  'if' with a condition that is a number is replaced by the branch it takes.
+     *  iii) a call of a small lambda that isn't recursive, and whose body only calls builtins that
+     *       don't evaluate anything (arithmetic, comparisons, list and vector functions), is
+     *       replaced by its body with the arguments in place of the formals, if each argument is a
+     *       number, string or symbol.
+     *
+     * Lambda bodies and the branches of 'if' are rewritten too, so a function is optimized once, by
+     * the form defining it. Quoted lists that aren't bodies or branches are data, and left as they are.
+     *
+     * A rewrite depends on the global names it looked up, so it doesn't replace the expression: it is
+     * attached to it as a Reduction (value.h) holding the bindings it was made with. Both evaluators
+     * use the reduction while the global scope still binds each of those names to the same value,
+     * and evaluate the expression as it is once one has been redefined. So a function that inlined
+     * 'sq' calls the new 'sq' after it is redefined, as it would unoptimized.
+     *
+     * inky is dynamically scoped, a name may be rebound at runtime by the formals of any lambda on
+     * the stack. So a name is only folded or inlined if it isn't defined by the form, and no lambda
+     * of the global scope binds it in its frame (Environment::markLocal); a reduction stops holding
+     * if one later does.
+     */
+    ValuePtr optimize(const EnvironmentPtr& env, const ValuePtr& form);
+
+    /* An optimized form as it is evaluated while each of its reductions holds, e.g. to show it. */
+    ValuePtr optimized(const ValuePtr& form);
+
+    /* eval and execute, optimizing the form first. */
+    ValuePtr evalOptimized(EnvironmentPtr env, ValuePtr val);
+    ValuePtr executeOptimized(EnvironmentPtr env, ValuePtr val);
+
+}
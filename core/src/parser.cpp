@@ -1,9 +1,14 @@
+#include <charconv>
+#include <climits>
 #include <cmath>
+#include <cstdlib>
+#include <cstring>
 #include <iterator>
-#include <sstream>
 #include <string>
 
+#include "bigint.h"
 #include "either.h"
+#include "map.h"
 #include "value.h"
 #include "parser.h"
 
@@ -23,30 +28,52 @@ namespace Inky::Lisp {
 
        Either<ParseError,ValuePtr> parse() { return readExpressionType(Type::SExpression, '\0'); }
 
+       /*
+        * Parse every form of a source. A form is an S-Expression without its outer parentheses, as
+        * typed at the REPL, it ends at a newline unless the newline is within brackets; blank lines
+        * and comments are skipped. Returns a Q-Expression of the forms.
+        */
+       Either<ParseError,ValuePtr> parseForms() {
+           ExpressionPtr forms = std::make_shared<Expression>(Expression());
+           while ( i != input.end() ) {
+               auto form = readForm();
+               if ( !form ) return form.left();
+               if ( !Ops::isEmptyExpression(form.right()) ) forms->insert(form.right());
+           }
+           return Ops::makeQExpression(forms);
+       }
+
     private:
 
+        /* The current character, '\0' at the end of the input (which needn't be null terminated). */
+        char peek() const { return i != input.end() ? *i : '\0'; }
+
+        char peekNext() const { return i != input.end() && i + 1 != input.end() ? *(i+1) : '\0'; }
+
         /* Move one character along the input, provided we're not at the end of the input. */
         void advance() {
            if ( i != input.end() ) ++i;
         }
 
-        bool isNumeric() {
-            return (std::isdigit(*i)  || ( (*i == '+'|| *i=='-') && std::isdigit(*(i+1))));
+        bool isNumeric() const {
+            return (std::isdigit(peek())  || ( (peek() == '+'|| peek() == '-') && std::isdigit(peekNext())));
         }
 
-        bool isSymbol() {
-            return std::strchr( "abcdefghijklmnopqrstuvwxyz"
-                                "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
-                                "0123456789_+-*\\/=<>!&", *i);
+        static bool isSymbol(char c) {
+            return c != '\0' && std::strchr( "abcdefghijklmnopqrstuvwxyz"
+                                              "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+                                              "0123456789_+-*\\/=<>!&", c);
         }
 
-        void skipWhitespace() {
-            while (i != input.end() && *i != '\0' && std::isspace(*i))  {
-                if (*i == ';') {
-                    while (i != input.end() && *i != '\n' && *i != '\0') advance();
-                    return;
+        /* Skip whitespace and comments (from ';' to the end of the line), stopping at a newline if 'newlines' is false. */
+        void skipWhitespace(bool newlines = true) {
+            while ( i != input.end() ) {
+                if ( *i == ';' ) {
+                    while ( i != input.end() && *i != '\n' ) advance();
                 }
-                advance();
+                else if ( *i == '\n' && !newlines ) return;
+                else if ( std::isspace(*i) ) advance();
+                else return;
             }
         }
 
@@ -54,43 +81,40 @@ namespace Inky::Lisp {
             skipWhitespace();
 
             if (i == input.end()) {
-                size_t position = std::distance(input.begin(),i-1);
+                size_t position = input.empty() ? 0 : std::distance(input.begin(),i-1);
                 return ParseError {"expecting token but reach end of input.", ParseError::Location {position, 1}};
             }
 
-            Either<ParseError,ValuePtr> rtn(nullptr);
-
             if (*i == '(') {
                 advance();
-                rtn = readExpressionType(Type::SExpression,')');
+                return readExpressionType(Type::SExpression,')');
             }
             else if (*i =='[') {
                 advance();
-                rtn = readExpressionType(Type::QExpression,']');
+                return readExpressionType(Type::QExpression,']');
+            }
+            else if (*i == '{') {
+                advance();
+                return readMap();
             }
             else if (*i == '\"') {
                 advance();
-                rtn = readStringLiteral();
+                return readStringLiteral();
             }
             else if (isNumeric()) {
-                rtn = readNumericValue();
+                return readNumericValue();
             }
-            else if (isSymbol()) {
-                rtn = readSymbol();
-            }
-            else {
-                size_t position =  std::distance(input.begin(),i);
-                return ParseError {"mismatched expression.", ParseError::Location {position , 1}};
+            else if (isSymbol(*i)) {
+                return readSymbol();
             }
 
-            skipWhitespace();
-
-            return rtn;
+            size_t position =  std::distance(input.begin(),i);
+            return ParseError {"mismatched expression.", ParseError::Location {position , 1}};
         }
 
         Either<ParseError,ValuePtr> readExpressionType(Type kind, char end_ch) {
             ExpressionPtr expression = std::make_shared<Expression>(Expression());
-            while ( *i != end_ch) {
+            for (skipWhitespace(); peek() != end_ch; skipWhitespace()) {
                 auto j = readValue();
                 if (j) expression->insert(j.right()); else return j.left();
             }
@@ -99,56 +123,90 @@ namespace Inky::Lisp {
                 Ops::makeSExpression(expression) : Ops::makeQExpression(expression);
         }
 
-        Either<ParseError,ValuePtr> readSymbol() {
-            std::ostringstream os;
-            while (strchr( "abcdefghijklmnopqrstuvwxyz"
-                           "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
-                           "0123456789_+-*\\/=<>!&", *i) && *i != '\0') {
-                os << *i;
-                advance();
+        /* A map literal {k v ...}, the keys are strings, symbols or numbers; neither is evaluated. */
+        Either<ParseError,ValuePtr> readMap() {
+            HashMap map;
+            for (skipWhitespace(); peek() != '}'; skipWhitespace()) {
+                size_t position = std::distance(input.begin(), i);
+                auto key = readValue();
+                if (!key) return key.left();
+                if (!HashMap::isKey(key.right())) {
+                    return ParseError {"map key must be a string, symbol or number.", ParseError::Location {position, 1}};
+                }
+                skipWhitespace();
+                if (peek() == '}') {
+                    return ParseError {"map key without a value.", ParseError::Location {position, 1}};
+                }
+                auto value = readValue();
+                if (!value) return value.left();
+                map.put(key.right(), value.right());
+            }
+            advance();
+            return Ops::makeMap(std::move(map));
+        }
+
+        /* Read the values up to the end of the line (or input), the newline is consumed. */
+        Either<ParseError,ValuePtr> readForm() {
+            ExpressionPtr expression = std::make_shared<Expression>(Expression());
+            for (skipWhitespace(false); i != input.end() && *i != '\n'; skipWhitespace(false)) {
+                auto j = readValue();
+                if (j) expression->insert(j.right()); else return j.left();
             }
-            return Ops::makeSymbol(os.str());
+            advance();
+            return Ops::makeSExpression(expression);
         }
 
-        /* Read string literal. */
+        /*
+         * Symbols are interned straight from the input, the special forms (defun, lambda, if, ...)
+         * are interned first so they are tagged with their fixed ids.
+         */
+        Either<ParseError,ValuePtr> readSymbol() {
+            auto start = i;
+            while ( isSymbol(peek()) ) advance();
+            auto name = input.substr(std::distance(input.begin(), start), std::distance(start, i));
+            return Ops::makeSymbol(intern(name));
+        }
+
+        /* Read string literal, the characters are copied from the input once, into the value. */
         Either <ParseError,ValuePtr> readStringLiteral() {
-            std::string_view::const_iterator s = i;
-            std::ostringstream os;
-            while ( i!= input.end() && *i != '\"') {
-                if ( *i == '\0' ) {
-                    size_t start = std::distance(input.begin(), s);
-                    size_t distance = std::distance(input.begin(), i) - start;
-                    ParseError::Location l {start, distance };
-                    return ParseError {"string literal not terminated", l };
-                }
-                os << *i;
-                advance();
+            auto start = i;
+            while ( i != input.end() && *i != '\"' && *i != '\0' ) advance();
+            if ( peek() != '\"' ) {
+                size_t begin = std::distance(input.begin(), start);
+                ParseError::Location l {begin, (size_t) std::distance(start, i) };
+                return ParseError {"string literal not terminated", l };
             }
+            auto literal = input.substr(std::distance(input.begin(), start), std::distance(start, i));
             advance();
-            return Ops::makeString(os.str());
+            return Ops::makeString(std::string(literal));
         }
 
         /* Read an integer or double. */
         Either<ParseError,ValuePtr> readNumericValue() {
-            /* Simplistic, we should hold 'val' as an unsigned long until (or if) we reach '.' or exponent etc.. */
-            double sign = 1;
-            if ((*i == '+' || *i == '-')) {
-                sign = *i == '+' ? 1 : -1;
-                advance();
+            auto begin = i;
+            bool sign = peek() == '+' || peek() == '-';
+            if (sign) advance();
+            auto digits = i;
+            while (std::isdigit(peek())) advance();
+
+            if (peek() != '.') { /* an integer, exact whatever its size. */
+                std::string_view text(&*digits, std::distance(digits, i));
+                if (*begin == '-') text = std::string_view(&*begin, std::distance(begin, i));
+                long val = 0;
+                auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), val);
+                if (error == std::errc()) return Ops::makeInteger(val);
+                if (auto big = BigInteger::parse(text)) return Ops::makeBigInteger(std::move(*big));
+                size_t position = std::distance(input.begin(), begin);
+                return ParseError {"invalid number.", ParseError::Location {position, text.size()}};
             }
-            double val = 0.0;
-            double power = 0.0;
-
-            for (val = 0.0; std::isdigit(*i); advance()) val = 10.0 * val + (*i - '0');
-            if (*i == '.') advance();
-            for (power = 1.0; std::isdigit(*i); advance()) {
-                val = 10.0 * val + (*i - '0');
-                power *= 10.0;
-            }
-            val = sign * val / power;
+
+            advance();
+            while (std::isdigit(peek())) advance();
+            std::string text(begin, i);
+            double val = std::strtod(text.c_str(), nullptr);
             double n = 0;
             double frac = std::modf(val, &n);
-            if (frac == 0.0) { /* exactly zero => long. */
+            if (frac == 0.0 && val >= (double) LONG_MIN && val < (double) LONG_MAX) { /* exactly zero => long. */
                 return Ops::makeInteger((long) val);
             } else {
                 return Ops::makeDouble(val);
@@ -166,4 +224,9 @@ namespace Inky::Lisp {
         return p.parse();
     }
 
+    Either<ParseError,ValuePtr> parseForms(std::string_view input) {
+        Parser p(input);
+        return p.parseForms();
+    }
+
 }
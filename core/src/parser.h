@@ -10,4 +10,11 @@ namespace Inky::Lisp {
     /* Returns either an error or AST from the input string. */
     Either<ParseError,ValuePtr> parse(std::string_view in);
 
+    /*
+     * Returns either an error or a Q-Expression of the forms of a source (e.g. a file), one per
+     * line unless a form's brackets span lines. Symbols are interned from the input, it needn't
+     * outlive the result.
+     */
+    Either<ParseError,ValuePtr> parseForms(std::string_view in);
+
 }
\ No newline at end of file
@@ -0,0 +1,123 @@
+#include <cstdlib>
+
+#include "pool.h"
+
+namespace Inky::Lisp {
+
+    namespace {
+        /* The pool and queue of the current thread, if it is a worker. */
+        thread_local ThreadPool* currentPool = nullptr;
+        thread_local size_t currentQueue = 0;
+
+        std::mutex instanceLock;
+        std::unique_ptr<ThreadPool> sharedPool;
+        size_t configuredWorkers = 0;
+
+        size_t defaultWorkers() {
+            if ( configuredWorkers > 0 ) return configuredWorkers;
+            if ( const char* workers = std::getenv("INKY_WORKERS") ) {
+                long n = std::strtol(workers, nullptr, 10);
+                if ( n > 0 ) return n;
+            }
+            /* the thread running the tasks works too, so one fewer than the hardware threads. */
+            size_t n = std::thread::hardware_concurrency();
+            return n > 1 ? n - 1 : 1;
+        }
+    }
+
+    ThreadPool::ThreadPool(size_t workers) {
+        if ( workers == 0 ) workers = 1;
+        for (size_t k = 0; k <= workers; k++) queues.push_back(std::make_unique<Queue>());
+        for (size_t k = 0; k < workers; k++) threads.emplace_back([this, k]() { work(k); });
+    }
+
+    ThreadPool::~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> guard(sleep);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& t: threads) t.join();
+    }
+
+    void ThreadPool::run(std::vector<std::function<void()>>& tasks) {
+        if ( tasks.empty() ) return;
+
+        std::atomic<size_t> pending { tasks.size() };
+        size_t own = currentPool == this ? currentQueue : queues.size() - 1;
+        {
+            /* counted before they're queued, so the count is never less than the tasks queued. */
+            std::lock_guard<std::mutex> guard(sleep);
+            queued += tasks.size();
+        }
+        {
+            std::lock_guard<std::mutex> guard(queues[own]->lock);
+            for (auto& fn: tasks) queues[own]->tasks.push_back(Task { &fn, &pending });
+        }
+        wake.notify_all();
+
+        /* Help until this run's tasks have completed. */
+        Task task {};
+        while ( pending.load(std::memory_order_acquire) > 0 ) {
+            if ( take(own, task) ) execute(task);
+            else std::this_thread::yield();
+        }
+    }
+
+    void ThreadPool::work(size_t index) {
+        currentPool = this;
+        currentQueue = index;
+
+        Task task {};
+        while ( true ) {
+            if ( take(index, task) ) {
+                execute(task);
+                continue;
+            }
+            std::unique_lock<std::mutex> guard(sleep);
+            wake.wait(guard, [this]() { return stopping || queued > 0; });
+            if ( stopping ) return;
+        }
+    }
+
+    bool ThreadPool::take(size_t own, Task& task) {
+        {
+            Queue& q = *queues[own];
+            std::lock_guard<std::mutex> guard(q.lock);
+            if ( !q.tasks.empty() ) {
+                task = q.tasks.back();
+                q.tasks.pop_back();
+                queued--;
+                return true;
+            }
+        }
+        for (size_t k = 1; k < queues.size(); k++) {
+            Queue& q = *queues[(own + k) % queues.size()];
+            std::lock_guard<std::mutex> guard(q.lock);
+            if ( !q.tasks.empty() ) {
+                task = q.tasks.front();
+                q.tasks.pop_front();
+                queued--;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void ThreadPool::execute(const Task& task) {
+        (*task.fn)();
+        task.pending->fetch_sub(1, std::memory_order_release);
+    }
+
+    ThreadPool& ThreadPool::instance() {
+        std::lock_guard<std::mutex> guard(instanceLock);
+        if ( !sharedPool ) sharedPool = std::make_unique<ThreadPool>(defaultWorkers());
+        return *sharedPool;
+    }
+
+    void ThreadPool::setWorkers(size_t workers) {
+        std::lock_guard<std::mutex> guard(instanceLock);
+        configuredWorkers = workers;
+        if ( sharedPool && sharedPool->size() != workers ) sharedPool.reset();
+    }
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Inky::Lisp {
+
+    /*
+     * Work stealing thread pool, used by the parallel builtins (pmap, pfilter & preduce) to run
+     * fork-join tasks. Each worker has its own queue, it takes tasks from the back of its queue
+     * and, when that is empty, steals from the front of the others'. Tasks submitted by a thread
+     * that isn't a worker go to a shared queue that every worker steals from.
+     *
+     * A thread waiting for its tasks to complete runs queued tasks meanwhile, so a task may
+     * itself run tasks (a nested pmap) without the pool deadlocking.
+     */
+    class ThreadPool {
+    public:
+        explicit ThreadPool(size_t workers);
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        /* Run the tasks in parallel, returns once all of them have completed. */
+        void run(std::vector<std::function<void()>>& tasks);
+
+        /* Number of worker threads. */
+        size_t size() const { return threads.size(); }
+
+        /*
+         * The pool shared by the builtins, created on first use with the number of workers set by
+         * setWorkers, else the INKY_WORKERS environment variable, else one fewer than the number of
+         * hardware threads (the thread running the tasks also works).
+         */
+        static ThreadPool& instance();
+
+        /* Set the number of workers of the shared pool, it must not be running any tasks. */
+        static void setWorkers(size_t workers);
+
+    private:
+        struct Task {
+            std::function<void()>*  fn;
+            std::atomic<size_t>*    pending; /* tasks of the run that are yet to complete. */
+        };
+
+        struct Queue {
+            std::mutex          lock;
+            std::deque<Task>    tasks;
+        };
+
+        void work(size_t index);
+
+        /* Take a task, from the back of queue 'own' or else from the front of another queue. */
+        bool take(size_t own, Task& task);
+
+        void execute(const Task& task);
+
+        std::vector<std::unique_ptr<Queue>> queues;     /* one per worker, the last is the shared queue. */
+        std::vector<std::thread>            threads;
+
+        std::mutex                          sleep;
+        std::condition_variable             wake;
+        std::atomic<size_t>                 queued { 0 };
+        bool                                stopping = false;
+    };
+
+}
@@ -0,0 +1,197 @@
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <fmt/core.h>
+
+#include "builtin.h"
+#include "memo.h"
+#include "profiler.h"
+
+namespace Inky::Lisp::Profiler {
+
+    namespace {
+        typedef std::chrono::steady_clock Clock;
+
+        uint64_t nanoseconds(Clock::duration d) { return std::chrono::duration_cast<std::chrono::nanoseconds>(d).count(); }
+
+        std::atomic<uint64_t> sessions { 0 };
+    }
+
+    namespace detail {
+        /* The calls recorded by one thread. */
+        struct Recorder {
+            struct Node {
+                Symbol      name;
+                uint32_t    parent;
+                uint64_t    self = 0;
+                std::unordered_map<uint32_t, uint32_t> children; /* by name id. */
+            };
+
+            struct Stats {
+                uint64_t calls = 0;
+                uint64_t self = 0;
+                uint64_t inclusive = 0;
+            };
+
+            struct Active {
+                uint32_t            node;
+                Clock::time_point   start;
+                uint64_t            children;   /* time spent in the calls it made. */
+            };
+
+            explicit Recorder(std::thread::id thread) : thread(thread) { clear(); }
+
+            void clear() {
+                tree.clear();
+                tree.push_back(Node { Symbols::Lambda, 0, 0, {} }); /* the root, its name is unused. */
+                stack.clear();
+                stats.clear();
+                depth.clear();
+            }
+
+            const std::thread::id                   thread;
+            std::mutex                              lock;
+            std::vector<Node>                       tree;
+            std::vector<Active>                     stack;
+            std::unordered_map<Symbol, Stats, SymbolHash>       stats;
+            std::unordered_map<Symbol, uint32_t, SymbolHash>    depth; /* calls of each function in progress. */
+        };
+
+        Session global;
+
+        Recorder& recorder() {
+            /* the recorder last used by the thread, found again under the session's lock when it changes. */
+            thread_local uint64_t session = 0;
+            thread_local std::shared_ptr<Recorder> last;
+
+            Session& s = Profiler::session();
+            if ( session != s.id ) {
+                std::thread::id thread = std::this_thread::get_id();
+                std::lock_guard<std::mutex> guard(s.lock);
+                auto i = std::find_if(s.recorders.begin(), s.recorders.end(), [&](const auto& r) { return r->thread == thread; });
+                if ( i == s.recorders.end() ) i = s.recorders.insert(s.recorders.end(), std::make_shared<Recorder>(thread));
+                last = *i;
+                session = s.id;
+            }
+            return *last;
+        }
+    }
+
+    using detail::Recorder;
+    using detail::recorder;
+
+    Session::Session() : id(++sessions) {}
+
+    Session::~Session() = default;
+
+    void Session::setEnabled(bool on) {
+        if ( on ) {
+            std::lock_guard<std::mutex> guard(lock);
+            for (auto& r: recorders) {
+                std::lock_guard<std::mutex> recording(r->lock);
+                r->clear();
+            }
+        }
+        this->on.store(on);
+    }
+
+    void enter(Symbol name) {
+        Recorder& r = recorder();
+        std::lock_guard<std::mutex> guard(r.lock);
+
+        uint32_t parent = r.stack.empty() ? 0 : r.stack.back().node;
+        auto i = r.tree[parent].children.find(name.id);
+        uint32_t node;
+        if ( parent != 0 && r.tree[parent].name == name ) {
+            node = parent; /* direct recursion is folded into one frame, the tree stays shallow. */
+        } else if ( i != r.tree[parent].children.end() ) {
+            node = i->second;
+        } else {
+            node = r.tree.size();
+            r.tree[parent].children.emplace(name.id, node);
+            r.tree.push_back(Recorder::Node { name, parent, 0, {} });
+        }
+        r.depth[name]++;
+        r.stack.push_back(Recorder::Active { node, Clock::now(), 0 });
+    }
+
+    void exit() {
+        Clock::time_point now = Clock::now();
+        Recorder& r = recorder();
+        std::lock_guard<std::mutex> guard(r.lock);
+        if ( r.stack.empty() ) return; /* entered before the recording was cleared. */
+
+        Recorder::Active call = r.stack.back();
+        r.stack.pop_back();
+        uint64_t elapsed = nanoseconds(now - call.start);
+        uint64_t self = elapsed > call.children ? elapsed - call.children : 0;
+
+        Recorder::Node& node = r.tree[call.node];
+        node.self += self;
+        Recorder::Stats& stats = r.stats[node.name];
+        stats.calls++;
+        stats.self += self;
+        if ( --r.depth[node.name] == 0 ) stats.inclusive += elapsed;
+        if ( !r.stack.empty() ) r.stack.back().children += elapsed;
+    }
+
+    Symbol nameOf(const ValuePtr& f) {
+        static const Symbol builtin = intern("builtin");
+        if ( f->kind == Type::Function ) return std::get<LambdaPtr>(f->var)->name;
+        if ( MemoPtr memo = memoOf(f) ) return memo->name(); /* the cache lookup, a miss then calls the function itself. */
+        const char* name = builtinName(f);
+        return name ? intern(name) : builtin;
+    }
+
+    std::vector<FunctionStats> Session::report() const {
+        std::unordered_map<Symbol, Recorder::Stats, SymbolHash> totals;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            for (auto& r: recorders) {
+                std::lock_guard<std::mutex> recording(r->lock);
+                for (const auto& [name, stats]: r->stats) {
+                    Recorder::Stats& total = totals[name];
+                    total.calls += stats.calls;
+                    total.self += stats.self;
+                    total.inclusive += stats.inclusive;
+                }
+            }
+        }
+
+        std::vector<FunctionStats> result;
+        for (const auto& [name, stats]: totals) {
+            result.push_back(FunctionStats { std::string(symbolName(name)), stats.calls, stats.self * 1e-9, stats.inclusive * 1e-9 });
+        }
+        std::sort(result.begin(), result.end(), [](const auto& x, const auto& y) {
+            return x.self != y.self ? x.self > y.self : x.name < y.name;
+        });
+        return result;
+    }
+
+    std::string Session::folded() const {
+        std::map<std::string, uint64_t> paths; /* identical paths of different threads are merged. */
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            for (auto& r: recorders) {
+                std::lock_guard<std::mutex> recording(r->lock);
+                /* a node is added after its parent, so its parent's path is known. */
+                std::vector<std::string> path(r->tree.size());
+                for (size_t k = 1; k < r->tree.size(); k++) {
+                    const Recorder::Node& node = r->tree[k];
+                    path[k] = node.parent == 0 ? std::string(symbolName(node.name))
+                                               : path[node.parent] + ";" + std::string(symbolName(node.name));
+                    if ( node.self >= 1000 ) paths[path[k]] += node.self / 1000;
+                }
+            }
+        }
+
+        std::string result;
+        for (const auto& [path, micros]: paths) result += fmt::format("{} {}\n", path, micros);
+        return result;
+    }
+
+}
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "symbol.h"
+#include "value.h"
+
+namespace Inky::Lisp {
+
+    /*
+     * Function level profiler. When enabled both evaluators record each call of a lambda or builtin:
+     * the number of calls, self time (excluding the functions it called) and inclusive time (counted
+     * once for a recursive function, by its outermost call). A lambda is reported by the name it
+     * was bound to by defun or def, 'lambda' if it hasn't one.
+     *
+     * Calls are also recorded as a call tree, the self time of each path is written as folded
+     * stacks ("f;g;h 1234", microseconds) for flame graph tools. A tail call replaces its caller in
+     * the tree, as it does on the stack, and a directly recursive call is folded into its caller.
+     * Each thread has its own call stack, so a function run as a parallel task starts a new stack.
+     *
+     * Calls are recorded into the Session in use on the thread: the process wide one, or that of
+     * the Interpreter evaluating on it; the tasks of the parallel builtins record into the session
+     * of the thread that ran the builtin.
+     *
+     * When disabled the cost is a thread local and a relaxed atomic load per call.
+     */
+    namespace Profiler {
+
+        struct FunctionStats {
+            std::string name;
+            uint64_t    calls;
+            double      self;       /* seconds. */
+            double      inclusive;  /* seconds. */
+        };
+
+        namespace detail {
+            struct Recorder;
+
+            /* The recorder of the calling thread in the session in use. */
+            Recorder& recorder();
+        }
+
+        /* Whether calls are recorded, and the calls recorded by each thread. */
+        class Session {
+        public:
+            Session();
+            ~Session();
+
+            Session(const Session&) = delete;
+            Session& operator=(const Session&) = delete;
+
+            bool enabled() const { return on.load(std::memory_order_relaxed); }
+
+            /* Start (discarding what was recorded) or stop recording. */
+            void setEnabled(bool on);
+
+            /* Per function statistics, most self time first. */
+            std::vector<FunctionStats> report() const;
+
+            /* The call tree as folded stacks, one line per path. */
+            std::string folded() const;
+
+        private:
+            friend detail::Recorder& detail::recorder();
+
+            std::atomic<bool>   on { false };
+            uint64_t            id;         /* unique, a thread finds its recorder by it. */
+
+            mutable std::mutex  lock;
+            std::vector<std::shared_ptr<detail::Recorder>> recorders; /* one per thread. */
+        };
+
+        namespace detail {
+            extern Session global;
+
+            /* The session in use on the thread, nullptr for the process wide one. */
+            inline thread_local Session* current = nullptr;
+        }
+
+        /* The session in use on the calling thread. */
+        inline Session& session() { return detail::current != nullptr ? *detail::current : detail::global; }
+
+        inline bool enabled() { return session().enabled(); }
+
+        /* Use a session on the calling thread while in scope. */
+        class Use {
+        public:
+            explicit Use(Session* session) : previous(detail::current) { detail::current = session; }
+            ~Use() { detail::current = previous; }
+
+            Use(const Use&) = delete;
+            Use& operator=(const Use&) = delete;
+
+        private:
+            Session* previous;
+        };
+
+        /* As the Session functions, for the session in use on the calling thread. */
+        inline void setEnabled(bool on) { session().setEnabled(on); }
+        inline std::vector<FunctionStats> report() { return session().report(); }
+        inline std::string folded() { return session().folded(); }
+
+        /* Record entry to (exit from) a call of the function named 'name', in the session in use. */
+        void enter(Symbol name);
+        void exit();
+
+        /* The name a function value is profiled under. */
+        Symbol nameOf(const ValuePtr& f);
+
+        /*
+         * A call being profiled, exits the call when it goes out of scope. Entering another call
+         * exits the current one first, so a scope can follow a chain of tail calls.
+         */
+        class Scope {
+        public:
+            Scope() = default;
+            ~Scope() { exit(); }
+
+            Scope(const Scope&) = delete;
+            Scope& operator=(const Scope&) = delete;
+
+            void enter(const ValuePtr& f) {
+                exit();
+                if ( !enabled() ) return;
+                Profiler::enter(nameOf(f));
+                active = true;
+            }
+
+            void exit() {
+                if ( !active ) return;
+                Profiler::exit();
+                active = false;
+            }
+
+        private:
+            bool active = false;
+        };
+    }
+
+}
@@ -0,0 +1,76 @@
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <fmt/core.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define INKY_MMAP 1
+#endif
+
+#include "parser.h"
+#include "source.h"
+
+namespace Inky::Lisp {
+
+    SourceFile::SourceFile(const std::string& path) {
+#ifdef INKY_MMAP
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if ( fd < 0 ) return;
+        struct stat st {};
+        if ( ::fstat(fd, &st) == 0 && S_ISREG(st.st_mode) ) {
+            size = st.st_size;
+            open = true;
+            if ( size > 0 ) { /* mmap of an empty file fails. */
+                void* p = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if ( p != MAP_FAILED ) {
+                    data = static_cast<const char*>(p);
+                    mapped = true;
+                }
+                else open = false;
+            }
+        }
+        ::close(fd);
+#else
+        std::ifstream in(path, std::ios::binary);
+        if ( !in ) return;
+        contents.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        data = contents.data();
+        size = contents.size();
+        open = true;
+#endif
+    }
+
+    SourceFile::~SourceFile() {
+#ifdef INKY_MMAP
+        if ( mapped ) ::munmap(const_cast<char*>(data), size);
+#endif
+    }
+
+    ValuePtr loadFile(EnvironmentPtr env, const std::string& path, Evaluator evaluator) {
+        SourceFile file(path);
+        if ( !file.isOpen() ) return Ops::makeError(fmt::format("load, unable to read file {}.", path));
+
+        std::string_view text = file.text();
+        auto lineOf = [&](size_t offset) { return 1 + std::count(text.begin(), text.begin() + std::min(offset, text.size()), '\n'); };
+
+        auto forms = parseForms(text);
+        if ( !forms ) {
+            ParseError e = forms.left();
+            return Ops::makeError(fmt::format("{}:{}: {}", path, lineOf(e.location.begin), e.message));
+        }
+
+        ValuePtr result = Ops::makeSExpression();
+        for (const auto& form: std::get<ExpressionPtr>(forms.right()->var)->cells) {
+            result = evaluator(env, form);
+            if ( Ops::isError(result) ) {
+                return Ops::makeError(fmt::format("{}: {}", path, std::get<LispErrorPtr>(result->var)->message));
+            }
+        }
+        return result;
+    }
+
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+#include "environment.h"
+#include "eval.h"
+#include "value.h"
+
+namespace Inky::Lisp {
+
+    /*
+     * The text of a source file. On POSIX systems the file is memory mapped and the parser reads
+     * it in place, otherwise it is read into a string.
+     */
+    class SourceFile {
+    public:
+        explicit SourceFile(const std::string& path);
+        ~SourceFile();
+
+        SourceFile(const SourceFile&) = delete;
+        SourceFile& operator=(const SourceFile&) = delete;
+
+        /* False if the file couldn't be opened or read. */
+        bool isOpen() const { return open; }
+
+        std::string_view text() const { return { data, size }; }
+
+    private:
+        bool        open = false;
+        const char* data = nullptr;
+        size_t      size = 0;
+        bool        mapped = false;
+        std::string contents;   /* the text when not mapped. */
+    };
+
+    /*
+     * Parse a file and evaluate its forms in turn with 'evaluator' (eval or execute). Returns the
+     * result of the last form, or the first error prefixed with the file's name (and, for a parse
+     * error, the line).
+     */
+    ValuePtr loadFile(EnvironmentPtr env, const std::string& path, Evaluator evaluator);
+
+}
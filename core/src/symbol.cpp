@@ -0,0 +1,78 @@
+#include <atomic>
+#include <initializer_list>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+
+#include "symbol.h"
+
+
+namespace Inky::Lisp {
+
+    /*
+     * Global table of symbol names. Names are held in fixed size chunks that are never moved or
+     * freed, so a name can be read without a lock: a symbol is only seen by a thread after the
+     * chunk holding its name has been published. Interning a new name is serialised, each thread
+     * caches the names it has interned so that parsing on many threads at once doesn't contend.
+     */
+    class SymbolTable {
+    public:
+        SymbolTable() {
+            /* Order must match the ids defined in Symbols. */
+            for (auto name: {"defun", "lambda", "\\", "def", "define", "=", "if", "&", "defmemo"}) intern(name);
+        }
+
+        ~SymbolTable() = default; /* the chunks outlive the table, names are referred to by view. */
+
+        Symbol intern(std::string_view name) {
+            thread_local std::unordered_map<std::string_view, uint32_t> cache; /* views of names in the chunks. */
+            auto cached = cache.find(name);
+            if ( cached != cache.end() ) return Symbol { cached->second };
+
+            std::lock_guard<std::mutex> lock(mutex);
+            auto i = ids.find(name);
+            if ( i == ids.end() ) {
+                uint32_t id = count.load(std::memory_order_relaxed);
+                if ( (id >> chunkBits) >= maxChunks ) throw std::length_error("symbol table full.");
+                std::string* chunk = chunks[id >> chunkBits].load(std::memory_order_relaxed);
+                if ( chunk == nullptr ) {
+                    chunk = new std::string[chunkSize];
+                    chunks[id >> chunkBits].store(chunk, std::memory_order_release);
+                }
+                chunk[id & (chunkSize - 1)] = std::string(name);
+                count.store(id + 1, std::memory_order_release);
+                i = ids.emplace(chunk[id & (chunkSize - 1)], id).first;
+            }
+            cache.emplace(i->first, i->second);
+            return Symbol { i->second };
+        }
+
+        const std::string& name(Symbol s) {
+            return chunks[s.id >> chunkBits].load(std::memory_order_acquire)[s.id & (chunkSize - 1)];
+        }
+
+    private:
+        static constexpr uint32_t chunkBits = 10;
+        static constexpr uint32_t chunkSize = 1u << chunkBits;
+        static constexpr uint32_t maxChunks = 1u << 14;
+
+        std::mutex mutex; /* serialises interning. */
+        std::unordered_map<std::string_view, uint32_t> ids; /* views of the names held in chunks. */
+        std::atomic<uint32_t> count { 0 };
+        std::atomic<std::string*> chunks[maxChunks] {};
+    };
+
+    static SymbolTable& symbolTable() {
+        static SymbolTable table;
+        return table;
+    }
+
+    Symbol intern(std::string_view name) {
+        return symbolTable().intern(name);
+    }
+
+    const std::string& symbolName(Symbol s) {
+        return symbolTable().name(s);
+    }
+
+}
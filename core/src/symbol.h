@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace Inky::Lisp {
+
+    /*
+     * Symbol names are interned in a global table, a symbol holds the id of its name; so symbols,
+     * and the keys of an environment, are compared as integers rather than strings.
+     */
+    struct Symbol {
+        uint32_t id;
+
+        bool operator==(const Symbol& other) const { return id == other.id; }
+        bool operator!=(const Symbol& other) const { return id != other.id; }
+    };
+
+    struct SymbolHash {
+        size_t operator()(const Symbol& s) const { return s.id; }
+    };
+
+    /* The special forms (and '&') are interned when the table is created, so have fixed ids. */
+    namespace Symbols {
+        constexpr Symbol Defun      { 0 };
+        constexpr Symbol Lambda     { 1 };
+        constexpr Symbol Backslash  { 2 };  /* '\' short form of lambda. */
+        constexpr Symbol Def        { 3 };
+        constexpr Symbol Define     { 4 };
+        constexpr Symbol Assign     { 5 };  /* '=' local definition. */
+        constexpr Symbol If         { 6 };
+        constexpr Symbol Varargs    { 7 };  /* '&' in formals. */
+        constexpr Symbol Defmemo    { 8 };  /* defun of a memoized function. */
+
+        inline bool isSpecialForm(Symbol s) { return s.id <= If.id || s == Defmemo; }
+    }
+
+    /* Returns the symbol with the given name, interning the name if it is new. */
+    Symbol intern(std::string_view name);
+
+    /* Returns the name of an interned symbol. */
+    const std::string& symbolName(Symbol s);
+
+}
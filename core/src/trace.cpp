@@ -0,0 +1,62 @@
+#include <chrono>
+#include <sstream>
+#include <fmt/core.h>
+
+#include "trace.h"
+
+namespace Inky::Lisp::Trace {
+
+    namespace {
+        /* Forms are printed up to this length in a dump. */
+        constexpr size_t formWidth = 72;
+    }
+
+    Session& session() {
+        thread_local Session own;
+        if ( detail::current == nullptr ) detail::current = &own;
+        return *detail::current;
+    }
+
+    void Session::record(const ExpressionPtr& form, const Environment& env, Type result, bool tail) {
+        uint64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+        if ( ring.empty() ) ring.resize(capacity);
+        Step& step = ring[next++ % capacity];
+        step.form = form;
+        step.depth = env.depth();
+        step.result = result;
+        step.tail = tail;
+        step.time = now;
+    }
+
+    std::vector<Step> Session::steps() const {
+        uint64_t n = std::min<uint64_t>(next, capacity);
+        std::vector<Step> result;
+        result.reserve(n);
+        for (uint64_t k = next - n; k < next; k++) result.push_back(ring[k % capacity]);
+        return result;
+    }
+
+    void Session::clear() {
+        for (auto& step: ring) step.form = nullptr;
+        next = 0;
+    }
+
+    void Session::dump(std::ostream& os, size_t n) const {
+        std::vector<Step> xs = steps();
+        size_t first = xs.size() > n ? xs.size() - n : 0;
+        for (size_t k = first; k < xs.size(); k++) {
+            const Step& step = xs[k];
+            std::ostringstream form;
+            form << "(" << step.form << ")";
+            std::string text = form.str();
+            if ( text.size() > formWidth ) text = text.substr(0, formWidth - 3) + "...";
+
+            std::ostringstream result;
+            if ( step.tail ) result << "tail call";
+            else result << step.result;
+
+            os << fmt::format("{:>12.3f}us {:>3} {:<16} {}\n", (step.time - xs[first].time) * 1e-3, step.depth, result.str(), text);
+        }
+    }
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+#include "environment.h"
+#include "value.h"
+
+namespace Inky::Lisp {
+
+    /*
+     * Evaluation trace. When enabled the tree walking evaluator records each reduction step, the
+     * expression reduced, the depth of the environment it was reduced in, the kind of the result
+     * and when, in a fixed size ring buffer that holds the last 'capacity' steps. A step that
+     * continues into the body of a lambda (a tail call) is recorded as it does so.
+     *
+     * Steps are recorded into the Session in use on the thread: the thread's own, or that of the
+     * Interpreter evaluating on it. A session is used by one thread at a time, so recording takes
+     * no lock and memory is bounded; the trace is read by that thread, e.g. to show what led up to
+     * an error. The tasks of the parallel builtins aren't traced.
+     *
+     * When disabled the cost is a thread local load per step.
+     */
+    namespace Trace {
+
+        constexpr size_t capacity = 1024;
+
+        struct Step {
+            ExpressionPtr   form;       /* the expression reduced.                          */
+            uint32_t        depth;      /* scopes in its environment, 1 for the global one. */
+            Type            result;     /* kind of the result.                              */
+            bool            tail;       /* continued into a lambda body, result is unused.  */
+            uint64_t        time;       /* steady clock, nanoseconds.                       */
+        };
+
+        /* Whether steps are recorded, and the last steps recorded. */
+        class Session {
+        public:
+            bool enabled() const { return on; }
+            void setEnabled(bool on) { this->on = on; }
+
+            /* Record a step. */
+            void record(const ExpressionPtr& form, const Environment& env, Type result, bool tail);
+
+            /* The last steps recorded, oldest first. */
+            std::vector<Step> steps() const;
+
+            /* Forget the steps recorded. */
+            void clear();
+
+            /* Write the last 'n' steps, one per line, times relative to the first written. */
+            void dump(std::ostream& os, size_t n = capacity) const;
+
+        private:
+            bool                on = false;
+            std::vector<Step>   ring;       /* 'capacity' steps, allocated when first recorded. */
+            uint64_t            next = 0;   /* steps recorded, the next is written at next % capacity. */
+        };
+
+        namespace detail {
+            /* The session in use on the thread, nullptr if none is (or the thread's own is yet to be made). */
+            inline thread_local Session* current = nullptr;
+        }
+
+        /* The session in use on the calling thread, its own unless a Use is in scope. */
+        Session& session();
+
+        inline bool enabled() { Session* s = detail::current; return s != nullptr && s->enabled(); }
+
+        /* Use a session on the calling thread while in scope, nullptr records nothing. */
+        class Use {
+        public:
+            explicit Use(Session* session) : previous(detail::current) { detail::current = session; }
+            ~Use() { detail::current = previous; }
+
+            Use(const Use&) = delete;
+            Use& operator=(const Use&) = delete;
+
+        private:
+            Session* previous;
+        };
+
+        /* As the Session functions, for the session in use on the calling thread. */
+        inline void setEnabled(bool on) { session().setEnabled(on); }
+        inline void record(const ExpressionPtr& form, const Environment& env, Type result, bool tail) { session().record(form, env, result, tail); }
+        inline std::vector<Step> steps() { return session().steps(); }
+        inline void clear() { session().clear(); }
+        inline void dump(std::ostream& os, size_t n = capacity) { session().dump(os, n); }
+    }
+}
@@ -1,17 +1,164 @@
+#include <algorithm>
 #include <iterator>
 
+#include "bigint.h"
+#include "counters.h"
 #include "environment.h"
+#include "heap.h"
+#include "map.h"
 #include "value.h"
+#include "vector.h"
 
 
 namespace Inky::Lisp {
 
+    namespace {
+
+        template<typename V>
+        ValuePtr allocate(Type kind, V&& v) {
+            return Heap::allocate(Value { kind, std::forward<V>(v) });
+        }
+
+        /*
+         * Integers in this range are preallocated and shared, loop counters and the results of
+         * comparisons (0 and 1) are never allocated. Values are not modified once made, so sharing
+         * is safe. Each thread has its own table, so that threads don't contend for the reference
+         * counts of the same values; it is released when the thread exits, after which the
+         * thread's integers are allocated.
+         */
+        constexpr long smallIntegerMin = -128;
+        constexpr long smallIntegerMax = 1023;
+
+        struct SmallIntegers {
+            ValuePtr values[smallIntegerMax - smallIntegerMin + 1];
+
+            SmallIntegers() {
+                for (long l = smallIntegerMin; l <= smallIntegerMax; l++) {
+                    values[l - smallIntegerMin] = allocate(Type::Integer, l);
+                }
+            }
+        };
+
+        thread_local SmallIntegers* smallIntegers = nullptr;
+        thread_local bool smallIntegersReleased = false;
+
+        struct SmallIntegersOwner {
+            ~SmallIntegersOwner() {
+                delete smallIntegers;
+                smallIntegers = nullptr;
+                smallIntegersReleased = true;
+            }
+        };
+
+        thread_local SmallIntegersOwner smallIntegersOwner;
+
+        SmallIntegers* makeSmallIntegers() {
+            if ( smallIntegersReleased ) return nullptr;
+            (void) &smallIntegersOwner; /* register the owner on first use by this thread. */
+            return smallIntegers = new SmallIntegers();
+        }
+    }
+
+
+    Cells Cells::drop(size_t n) const {
+        Cells xs = *this;
+        xs.first = std::min(first + n, last);
+        return xs;
+    }
+
+    /*
+     * A buffer that isn't shared can only be extended by this list, a shared buffer is extended
+     * by the first list to claim the space.
+     */
+    bool Cells::claimBack(size_t n) {
+        if ( buffer == nullptr || last + n > buffer->capacity ) return false;
+        if ( buffer.use_count() == 1 ) {
+            if ( buffer->back != last ) return false;
+            buffer->back.store(last + n, std::memory_order_relaxed);
+            return true;
+        }
+        size_t expected = last;
+        return buffer->back.compare_exchange_strong(expected, last + n);
+    }
+
+    bool Cells::claimFront(size_t n) {
+        if ( buffer == nullptr || first < n ) return false;
+        if ( buffer.use_count() == 1 ) {
+            if ( buffer->front != first ) return false;
+            buffer->front.store(first - n, std::memory_order_relaxed);
+            return true;
+        }
+        size_t expected = first;
+        return buffer->front.compare_exchange_strong(expected, first - n);
+    }
+
+    void Cells::reserve(size_t n, size_t m) {
+        auto copy = std::make_shared<Buffer>(n + size() + m);
+        size_t k = n;
+        for (const auto& cell: *this) copy->cells[k++] = cell;
+        copy->front = n;
+        copy->back = k;
+        buffer = copy;
+        first = n;
+        last = k;
+    }
+
+    /* When a list is copied to grow, it gets room for as many cells again, so growth is amortised O(1) per cell. */
+    void Cells::push_back(ValuePtr value) {
+        if ( !claimBack(1) ) {
+            reserve(0, std::max<size_t>(size(), 4));
+            buffer->back = last + 1;
+        }
+        buffer->cells[last++] = std::move(value);
+    }
+
+    void Cells::push_front(ValuePtr value) {
+        if ( !claimFront(1) ) {
+            reserve(std::max<size_t>(size(), 4), 0);
+            buffer->front = first - 1;
+        }
+        buffer->cells[--first] = std::move(value);
+    }
+
+    void Cells::append(const Cells& xs) {
+        if ( xs.empty() ) return;
+        size_t n = xs.size();
+        if ( !claimBack(n) ) {
+            reserve(0, n + size());
+            buffer->back = last + n;
+        }
+        for (const auto& cell: xs) buffer->cells[last++] = cell;
+    }
+
+    void Cells::prepend(const Cells& xs) {
+        if ( xs.empty() ) return;
+        size_t n = xs.size();
+        if ( !claimFront(n) ) {
+            reserve(n + size(), 0);
+            buffer->front = first - n;
+        }
+        first -= n;
+        size_t k = first;
+        for (const auto& cell: xs) buffer->cells[k++] = cell;
+    }
+
+    Cells Cells::join(const Cells& xs, const Cells& ys) {
+        if ( xs.size() >= ys.size() ) {
+            Cells zs = xs;
+            zs.append(ys);
+            return zs;
+        }
+        Cells zs = ys;
+        zs.prepend(xs);
+        return zs;
+    }
 
     void Expression::insert(ValuePtr value) {
         cells.push_back(value);
     }
 
     ValuePtr Value::clone() {
+        Counters::Clone counted(false);
         switch (kind) {
             case Type::Function: {
                 LambdaPtr copy(new Lambda());
@@ -20,6 +167,8 @@ namespace Inky::Lisp {
                 copy->formals = lambda->formals->clone();
                 copy->body = lambda->body->clone();
                 copy->env = lambda->env->clone();
+                copy->code = lambda->code; /* the body is unchanged, so its bytecode can be shared. */
+                copy->name = lambda->name;
 
                 return Ops::makeFunction(copy);
             }
@@ -41,7 +190,10 @@ namespace Inky::Lisp {
             case Type::String:
             case Type::Symbol:
             case Type::BuiltinFunction:
-                return std::make_shared<Value>(Value{kind, var});
+            case Type::BigInteger:
+            case Type::Vector:
+            case Type::Map:
+                return allocate(kind, var);
         }
     }
 
@@ -53,11 +205,33 @@ namespace Inky::Lisp {
             case Type::Double:
                 os << std::get<double>(value->var);
                 break;
+            case Type::BigInteger:
+                os << std::get<BigIntegerPtr>(value->var)->toString();
+                break;
+            case Type::Vector: {
+                os << "#[";
+                std::visit([&os](const auto& xs) {
+                    for (size_t i = 0; i < xs.size(); i++) os << (i ? " " : "") << xs[i];
+                }, std::get<VectorPtr>(value->var)->elements);
+                os << "]";
+                break;
+            }
+            case Type::Map: {
+                os << "{";
+                const char* separator = "";
+                for (const auto& entry: std::get<MapPtr>(value->var)->entries()) {
+                    if ( !entry.key ) continue;
+                    os << separator << entry.key << " " << entry.value;
+                    separator = " ";
+                }
+                os << "}";
+                break;
+            }
             case Type::String:
                 os << '\"' << std::get<std::string>(value->var) << '\"';
                 break;
             case Type::Symbol:
-                os << std::get<std::string>(value->var);
+                os << symbolName(std::get<Symbol>(value->var));
                 break;
             case Type::BuiltinFunction:
                 os << "<builtin>";
@@ -81,6 +255,7 @@ namespace Inky::Lisp {
     std::ostream& operator<<(std::ostream& os, Type kind) {
         switch (kind) {
             case Type::Integer:
+            case Type::BigInteger:
                 os << "<integer>";
                 break;
             case Type::Double:
@@ -95,6 +270,12 @@ namespace Inky::Lisp {
             case Type::QExpression:
                 os << "<QExpression>";
                 break;
+            case Type::Vector:
+                os << "<vector>";
+                break;
+            case Type::Map:
+                os << "<map>";
+                break;
             case Type::BuiltinFunction:
                 os << "<builtin>";
                 break;
@@ -140,60 +321,83 @@ namespace Inky::Lisp {
     namespace Ops {
 
         ValuePtr makeInteger(const long& l) {
-            return std::make_shared<Value>(Value { Type::Integer, l});
+            if ( l >= smallIntegerMin && l <= smallIntegerMax ) {
+                SmallIntegers* table = smallIntegers != nullptr ? smallIntegers : makeSmallIntegers();
+                if ( table != nullptr ) return table->values[l - smallIntegerMin];
+            }
+            return allocate(Type::Integer, l);
         }
 
         ValuePtr makeDouble(const double& d) {
-            return std::make_shared<Value>(Value {Type::Double, d}) ;
+            return allocate(Type::Double, d);
+        }
+
+        ValuePtr makeBigInteger(BigInteger b) {
+            if ( b.fitsLong() ) return makeInteger(b.toLong());
+            return allocate(Type::BigInteger, std::make_shared<const BigInteger>(std::move(b)));
+        }
+
+        ValuePtr makeVector(Vector v) {
+            return allocate(Type::Vector, std::make_shared<const Vector>(std::move(v)));
         }
 
-        ValuePtr makeString(const std::string& s) {
-            return std::make_shared<Value>(Value { Type::String, s});
+        ValuePtr makeMap(HashMap m) {
+            return allocate(Type::Map, std::make_shared<const HashMap>(std::move(m)));
+        }
+
+        ValuePtr makeString(std::string s) {
+            return allocate(Type::String, std::move(s));
         }
 
         ValuePtr makeSymbol(const std::string& s) {
-            return std::make_shared<Value>(Value { Type::Symbol, s});
+            return allocate(Type::Symbol, intern(s));
+        }
+
+        ValuePtr makeSymbol(Symbol s) {
+            return allocate(Type::Symbol, s);
         }
 
         ValuePtr makeBuiltin(const BuiltinFunction& f) {
-            return std::make_shared<Value>(Value {Type::BuiltinFunction, f});
+            return allocate(Type::BuiltinFunction, f);
         }
 
         ValuePtr makeFunction(LambdaPtr lambda) {
-            return std::make_shared<Value>(Value {Type::Function, lambda});
+            return allocate(Type::Function, lambda);
         }
 
         ValuePtr makeSExpression(ExpressionPtr expression) {
-            return std::make_shared<Value>(Value { Type::SExpression, expression});
+            return allocate(Type::SExpression, expression);
         }
 
         ValuePtr makeSExpression() {
             ExpressionPtr expression = std::make_shared<Expression>(Expression());
-            return std::make_shared<Value>(Value { Type::SExpression, expression});
+            return allocate(Type::SExpression, expression);
         }
 
         ValuePtr makeQExpression(ExpressionPtr expression) {
-            return std::make_shared<Value>(Value { Type::QExpression, expression});
+            return allocate(Type::QExpression, expression);
         }
 
         ValuePtr makeQExpression() {
             ExpressionPtr expression = std::make_shared<Expression>(Expression());
-            return std::make_shared<Value>(Value { Type::QExpression, expression});
+            return allocate(Type::QExpression, expression);
         }
 
         ValuePtr makeError(const std::string& error)  {
             LispErrorPtr lispError = std::make_shared<LispError>(LispError());
             lispError->message = error;
-            return std::make_shared<Value>(Value { Type::Error, lispError });
+            return allocate(Type::Error, lispError );
         }
 
-        bool isError(ValuePtr a) { return a->kind == Type::Error; }
+        bool isError(const ValuePtr& a) { return a->kind == Type::Error; }
 
-        bool isNumeric(ValuePtr a) { return a->kind == Type::Integer || a->kind == Type::Double; }
+        bool isNumeric(const ValuePtr& a) {
+            return a->kind == Type::Integer || a->kind == Type::Double || a->kind == Type::BigInteger;
+        }
 
-        bool isExpression(ValuePtr a) { return a->kind == Type::SExpression || a->kind == Type::QExpression; }
+        bool isExpression(const ValuePtr& a) { return a->kind == Type::SExpression || a->kind == Type::QExpression; }
 
-        bool isEmptyExpression(ValuePtr a) {
+        bool isEmptyExpression(const ValuePtr& a) {
             if (a->kind == Type::SExpression || a->kind == Type::QExpression) {
                ExpressionPtr e = std::get<ExpressionPtr>(a->var);
                return e->cells.empty();
@@ -201,9 +405,13 @@ namespace Inky::Lisp {
             return false;
         }
 
-        bool hasSymbolName(ValuePtr a, std::string_view s) {
+        bool hasSymbolName(const ValuePtr& a, std::string_view s) {
             if ( a->kind != Type::Symbol ) return false;
-            else return std::get<std::string>(a->var) == s;
+            else return symbolName(std::get<Symbol>(a->var)) == s;
+        }
+
+        bool isSymbol(const ValuePtr& a, Symbol s) {
+            return a->kind == Type::Symbol && std::get<Symbol>(a->var) == s;
         }
 
     }
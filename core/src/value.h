@@ -1,7 +1,8 @@
 #pragma once
 
-#include <deque>
+#include <atomic>
 #include <functional>
+#include <iterator>
 #include <iostream>
 #include <memory>
 #include <utility>
@@ -9,13 +10,18 @@
 #include <variant>
 
 #include "either.h"
+#include "symbol.h"
 
 
 namespace Inky::Lisp {
 
     /* Forward declarations. */
+    class BigInteger;
+    class HashMap;
+    struct Code;
     struct Environment;
     struct Value;
+    struct Vector;
 
     struct ParseError {
         std::string message;
@@ -34,15 +40,129 @@ namespace Inky::Lisp {
     typedef std::shared_ptr<Environment> EnvironmentPtr;
     typedef std::shared_ptr<Value> ValuePtr;
     typedef std::shared_ptr<LispError> LispErrorPtr;
+    typedef std::shared_ptr<Code> CodePtr;
+    typedef std::shared_ptr<const BigInteger> BigIntegerPtr;
+    typedef std::shared_ptr<const Vector> VectorPtr;
+    typedef std::shared_ptr<const HashMap> MapPtr;
 
     /* Builtin function type. */
-    typedef std::function<ValuePtr(EnvironmentPtr, ValuePtr)> BuiltinFunction;
+    typedef std::function<ValuePtr(const EnvironmentPtr&, const ValuePtr&)> BuiltinFunction;
+
+    /*
+     * The cells of an expression, a persistent list. The cells are held in a buffer that may be shared
+     * by many lists, each list is a slice [first,last) of its buffer; so dropping the head of a list,
+     * or copying it, doesn't copy the cells.
+     *
+     * A cell is never changed once written to a buffer. A list grows by claiming the unused space of
+     * its buffer either side of its slice, if another list sharing the buffer already has then the
+     * list is copied to a new buffer. Claims are atomic, so lists sharing a buffer may be extended
+     * from different threads (a single Cells object is not safe to modify concurrently).
+     */
+    class Cells {
+    public:
+        typedef const ValuePtr* const_iterator;
+        typedef const_iterator iterator;
+
+        Cells() = default;
+
+        size_t size() const { return last - first; }
+        bool empty() const { return first == last; }
+
+        const ValuePtr& operator[](size_t i) const { return buffer->cells[first + i]; }
+        const ValuePtr& front() const { return buffer->cells[first]; }
+        const ValuePtr& back() const { return buffer->cells[last - 1]; }
+
+        const_iterator begin() const { return buffer ? buffer->cells.get() + first : nullptr; }
+        const_iterator end() const { return buffer ? buffer->cells.get() + last : nullptr; }
+
+        /* The list without its first n cells, sharing this list's buffer. */
+        Cells drop(size_t n) const;
+
+        void push_back(ValuePtr value);
+        void push_front(ValuePtr value);
+        void pop_front() { first++; }
+        void clear() { buffer.reset(); first = last = 0; }
+
+        template<typename Iterator>
+        void assign(Iterator begin, Iterator end) {
+            clear();
+            reserve(0, std::distance(begin, end));
+            for (auto i = begin; i != end; ++i) buffer->cells[last++] = *i;
+            buffer->back = last;
+        }
+
+        /* Add the cells of xs to the end (front) of this list. */
+        void append(const Cells& xs);
+        void prepend(const Cells& xs);
+
+        /* The cells of xs followed by those of ys, the longer of the two lists is extended in place if it can be. */
+        static Cells join(const Cells& xs, const Cells& ys);
+
+    private:
+        struct Buffer {
+            explicit Buffer(size_t capacity): cells(new ValuePtr[capacity]), capacity(capacity) {}
+
+            std::unique_ptr<ValuePtr[]> cells;
+            size_t                      capacity;
+            std::atomic<size_t>         front { 0 };    /* first cell used by any list.         */
+            std::atomic<size_t>         back { 0 };     /* one past the last cell used by any list. */
+        };
+
+        /* Claim n unused cells after (before) this list's slice, false if they're in use or don't exist. */
+        bool claimBack(size_t n);
+        bool claimFront(size_t n);
+
+        /* Copy this list into a new buffer, with room for n more cells before and m after. */
+        void reserve(size_t n, size_t m);
+
+        std::shared_ptr<Buffer> buffer;
+        size_t                  first = 0;
+        size_t                  last = 0;
+    };
+
+    /*
+     * The inline cache of a call site: the global binding that the name at its head was last
+     * found in, and the version of the global scope it was found in. A global scope's version
+     * changes with each insert into it, and versions are never reused, so the binding is valid for
+     * as long as the versions match. Call sites may be shared by threads, the cache is filled by
+     * one at a time and read without a lock.
+     */
+    class InlineCache {
+    public:
+        InlineCache() = default;
+        InlineCache(const InlineCache&) {} /* a copy starts empty. */
+        InlineCache& operator=(const InlineCache&) { return *this; }
+
+    private:
+        friend struct Environment;
+
+        static constexpr uint64_t Filling = ~uint64_t(0);
+
+        std::atomic<uint64_t>           version { 0 };  /* 0 if empty. */
+        std::atomic<const ValuePtr*>    binding { nullptr };
+    };
+
+    /*
+     * The optimized form of an expression (optimizer.h), the value it reduces to given the values
+     * bound to the global names it looked up. It is evaluated in place of the expression while each
+     * of those names has the same binding in the global scope, and can't be rebound by a lambda
+     * frame; otherwise the expression is evaluated as it is. The check is made once per version of
+     * the global scope.
+     */
+    struct Reduction {
+        ValuePtr                                    value;
+        std::vector<std::pair<Symbol, ValuePtr>>    bindings;       /* nullptr for a name that was unbound. */
+        mutable std::atomic<uint64_t>               checked { 0 };  /* version of the global scope << 1, | 1 if they held. */
+    };
+    typedef std::shared_ptr<const Reduction> ReductionPtr;
 
     struct Expression {
         /* Insert a value into this expression. */
         void insert(ValuePtr value);
 
-        std::deque<ValuePtr> cells; /* An S-Expression is a list of cells, that contain values. */
+        Cells           cells;      /* An S-Expression is a list of cells, that contain values. */
+        InlineCache     head;       /* the binding of the symbol in the first cell, when evaluated as a call. */
+        ReductionPtr    reduction;  /* set by the optimizer. */
     };
     typedef std::shared_ptr<Expression> ExpressionPtr;
 
@@ -51,6 +171,8 @@ namespace Inky::Lisp {
         ValuePtr        formals;    /* arguments of an expression.          */
         ValuePtr        body;       /* definition of the function itself.   */
         EnvironmentPtr  env;        /* environment of the lambda.           */
+        CodePtr         code;       /* compiled body, set by the bytecode compiler when first needed. */
+        Symbol          name = Symbols::Lambda; /* bound to by defun or def, for the profiler. */
     };
     typedef std::shared_ptr<Lambda> LambdaPtr;
 
@@ -64,7 +186,10 @@ namespace Inky::Lisp {
         BuiltinFunction,
         Function,
         SExpression,
-        QExpression
+        QExpression,
+        BigInteger, /* an integer that doesn't fit in a long. */
+        Vector,     /* a contiguous array of numbers, see vector.h. */
+        Map         /* a hash map, see map.h. */
     };
 
     /*
@@ -82,14 +207,18 @@ namespace Inky::Lisp {
         Type kind; /* Convenient flag for type checking. */
 
         /* The variant that the value can hold. */
-        std::variant<LispErrorPtr,long,double,std::string,BuiltinFunction,LambdaPtr,ExpressionPtr> var;
+        std::variant<LispErrorPtr,long,double,std::string,Symbol,BuiltinFunction,LambdaPtr,ExpressionPtr,BigIntegerPtr,VectorPtr,MapPtr> var;
     };
 
     namespace Ops { /* Define utilities for constructing Values. */
         ValuePtr makeInteger(const long& l);
         ValuePtr makeDouble(const double& d);
-        ValuePtr makeString(const std::string& s);
+        ValuePtr makeBigInteger(BigInteger b); /* an Integer if 'b' fits in a long. */
+        ValuePtr makeVector(Vector v);
+        ValuePtr makeMap(HashMap m);
+        ValuePtr makeString(std::string s);
         ValuePtr makeSymbol(const std::string& s);
+        ValuePtr makeSymbol(Symbol s);
         ValuePtr makeBuiltin(const BuiltinFunction& f);
         ValuePtr makeFunction(LambdaPtr lambda);
         ValuePtr makeSExpression(ExpressionPtr expression);
@@ -98,11 +227,12 @@ namespace Inky::Lisp {
         ValuePtr makeQExpression();
         ValuePtr makeError(const std::string& s);
 
-        bool isError(ValuePtr a);
-        bool isNumeric(ValuePtr a);
-        bool isExpression(ValuePtr a);
-        bool isEmptyExpression(ValuePtr a);
-        bool hasSymbolName(ValuePtr a, std::string_view s);
+        bool isError(const ValuePtr& a);
+        bool isNumeric(const ValuePtr& a);
+        bool isExpression(const ValuePtr& a);
+        bool isEmptyExpression(const ValuePtr& a);
+        bool hasSymbolName(const ValuePtr& a, std::string_view s);
+        bool isSymbol(const ValuePtr& a, Symbol s);
     }
 
     /* Output operators. */
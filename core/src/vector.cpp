@@ -0,0 +1,439 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+
+#include "bigint.h"
+#include "vector.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define INKY_SIMD_X86
+#include <immintrin.h>
+#endif
+
+namespace Inky::Lisp::Simd {
+
+    namespace {
+
+        struct Kernels {
+            double  (*sumDouble)(const double* x, size_t n);
+            double  (*dot)(const double* x, const double* y, size_t n);
+            double  (*minDouble)(const double* x, size_t n);
+            double  (*maxDouble)(const double* x, size_t n);
+            void    (*addDouble)(const double* x, const double* y, double* r, size_t n);
+            void    (*multiplyDouble)(const double* x, const double* y, double* r, size_t n);
+            LongSum (*sumLong)(const long* x, size_t n);
+            long    (*minLong)(const long* x, size_t n);
+            long    (*maxLong)(const long* x, size_t n);
+            bool    (*addLong)(const long* x, const long* y, long* r, size_t n);
+        };
+
+        /* Lanes are combined in this order at every level. */
+        double combine(const double lanes[4]) { return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]); }
+
+        /* As minpd/maxpd, the second operand if either is NaN. */
+        double minOf(double x, double y) { return x < y ? x : y; }
+        double maxOf(double x, double y) { return x > y ? x : y; }
+
+        double combineMin(const double lanes[4]) { return minOf(minOf(lanes[0], lanes[1]), minOf(lanes[2], lanes[3])); }
+        double combineMax(const double lanes[4]) { return maxOf(maxOf(lanes[0], lanes[1]), maxOf(lanes[2], lanes[3])); }
+
+        /* Scalar kernels, the reductions keep four lanes as the SIMD kernels do. */
+
+        double sumScalar(const double* x, size_t n) {
+            double lanes[4] = { 0, 0, 0, 0 };
+            size_t i = 0;
+            for (; i + 4 <= n; i += 4) {
+                for (int k = 0; k < 4; k++) lanes[k] += x[i + k];
+            }
+            double r = combine(lanes);
+            for (; i < n; i++) r += x[i];
+            return r;
+        }
+
+        double dotScalar(const double* x, const double* y, size_t n) {
+            double lanes[4] = { 0, 0, 0, 0 };
+            size_t i = 0;
+            for (; i + 4 <= n; i += 4) {
+                for (int k = 0; k < 4; k++) lanes[k] += x[i + k] * y[i + k];
+            }
+            double r = combine(lanes);
+            for (; i < n; i++) r += x[i] * y[i];
+            return r;
+        }
+
+        double minScalar(const double* x, size_t n) {
+            double lanes[4] = { x[0], x[0], x[0], x[0] };
+            size_t i = 0;
+            for (; i + 4 <= n; i += 4) {
+                for (int k = 0; k < 4; k++) lanes[k] = minOf(x[i + k], lanes[k]);
+            }
+            double r = combineMin(lanes);
+            for (; i < n; i++) r = minOf(x[i], r);
+            return r;
+        }
+
+        double maxScalar(const double* x, size_t n) {
+            double lanes[4] = { x[0], x[0], x[0], x[0] };
+            size_t i = 0;
+            for (; i + 4 <= n; i += 4) {
+                for (int k = 0; k < 4; k++) lanes[k] = maxOf(x[i + k], lanes[k]);
+            }
+            double r = combineMax(lanes);
+            for (; i < n; i++) r = maxOf(x[i], r);
+            return r;
+        }
+
+        void addScalar(const double* x, const double* y, double* r, size_t n) {
+            for (size_t i = 0; i < n; i++) r[i] = x[i] + y[i];
+        }
+
+        void multiplyScalar(const double* x, const double* y, double* r, size_t n) {
+            for (size_t i = 0; i < n; i++) r[i] = x[i] * y[i];
+        }
+
+        LongSum sumLongScalar(const long* x, size_t n) {
+            LongSum s { 0, 0 };
+            for (size_t i = 0; i < n; i++) {
+                s.high += x[i] >> 32;
+                s.low += x[i] & 0xffffffffL;
+            }
+            return s;
+        }
+
+        long minLongScalar(const long* x, size_t n) {
+            long r = x[0];
+            for (size_t i = 1; i < n; i++) r = x[i] < r ? x[i] : r;
+            return r;
+        }
+
+        long maxLongScalar(const long* x, size_t n) {
+            long r = x[0];
+            for (size_t i = 1; i < n; i++) r = x[i] > r ? x[i] : r;
+            return r;
+        }
+
+        /* Overflow if x and y have the same sign and the sum doesn't. */
+        bool addLongScalar(const long* x, const long* y, long* r, size_t n) {
+            uint64_t overflow = 0;
+            for (size_t i = 0; i < n; i++) {
+                uint64_t s = (uint64_t) x[i] + (uint64_t) y[i];
+                overflow |= (x[i] ^ s) & (y[i] ^ s);
+                r[i] = (long) s;
+            }
+            return (overflow >> 63) == 0;
+        }
+
+        constexpr Kernels scalarKernels = {
+            sumScalar, dotScalar, minScalar, maxScalar, addScalar, multiplyScalar,
+            sumLongScalar, minLongScalar, maxLongScalar, addLongScalar
+        };
+
+#ifdef INKY_SIMD_X86
+
+        /* SSE2, the baseline of x86-64; lanes 0,1 and 2,3 are held in two registers. */
+
+        double sumSSE2(const double* x, size_t n) {
+            __m128d a = _mm_setzero_pd(), b = _mm_setzero_pd();
+            size_t i = 0;
+            for (; i + 4 <= n; i += 4) {
+                a = _mm_add_pd(a, _mm_loadu_pd(x + i));
+                b = _mm_add_pd(b, _mm_loadu_pd(x + i + 2));
+            }
+            double lanes[4];
+            _mm_storeu_pd(lanes, a);
+            _mm_storeu_pd(lanes + 2, b);
+            double r = combine(lanes);
+            for (; i < n; i++) r += x[i];
+            return r;
+        }
+
+        double dotSSE2(const double* x, const double* y, size_t n) {
+            __m128d a = _mm_setzero_pd(), b = _mm_setzero_pd();
+            size_t i = 0;
+            for (; i + 4 <= n; i += 4) {
+                a = _mm_add_pd(a, _mm_mul_pd(_mm_loadu_pd(x + i), _mm_loadu_pd(y + i)));
+                b = _mm_add_pd(b, _mm_mul_pd(_mm_loadu_pd(x + i + 2), _mm_loadu_pd(y + i + 2)));
+            }
+            double lanes[4];
+            _mm_storeu_pd(lanes, a);
+            _mm_storeu_pd(lanes + 2, b);
+            double r = combine(lanes);
+            for (; i < n; i++) r += x[i] * y[i];
+            return r;
+        }
+
+        double minSSE2(const double* x, size_t n) {
+            __m128d a = _mm_set1_pd(x[0]), b = a;
+            size_t i = 0;
+            for (; i + 4 <= n; i += 4) {
+                a = _mm_min_pd(_mm_loadu_pd(x + i), a);
+                b = _mm_min_pd(_mm_loadu_pd(x + i + 2), b);
+            }
+            double lanes[4];
+            _mm_storeu_pd(lanes, a);
+            _mm_storeu_pd(lanes + 2, b);
+            double r = combineMin(lanes);
+            for (; i < n; i++) r = minOf(x[i], r);
+            return r;
+        }
+
+        double maxSSE2(const double* x, size_t n) {
+            __m128d a = _mm_set1_pd(x[0]), b = a;
+            size_t i = 0;
+            for (; i + 4 <= n; i += 4) {
+                a = _mm_max_pd(_mm_loadu_pd(x + i), a);
+                b = _mm_max_pd(_mm_loadu_pd(x + i + 2), b);
+            }
+            double lanes[4];
+            _mm_storeu_pd(lanes, a);
+            _mm_storeu_pd(lanes + 2, b);
+            double r = combineMax(lanes);
+            for (; i < n; i++) r = maxOf(x[i], r);
+            return r;
+        }
+
+        void addSSE2(const double* x, const double* y, double* r, size_t n) {
+            size_t i = 0;
+            for (; i + 2 <= n; i += 2) _mm_storeu_pd(r + i, _mm_add_pd(_mm_loadu_pd(x + i), _mm_loadu_pd(y + i)));
+            for (; i < n; i++) r[i] = x[i] + y[i];
+        }
+
+        void multiplySSE2(const double* x, const double* y, double* r, size_t n) {
+            size_t i = 0;
+            for (; i + 2 <= n; i += 2) _mm_storeu_pd(r + i, _mm_mul_pd(_mm_loadu_pd(x + i), _mm_loadu_pd(y + i)));
+            for (; i < n; i++) r[i] = x[i] * y[i];
+        }
+
+        /* There is no 64 bit arithmetic shift, the high half is sign extended with an xor & subtract. */
+        LongSum sumLongSSE2(const long* x, size_t n) {
+            const __m128i mask = _mm_set1_epi64x(0xffffffffL), bias = _mm_set1_epi64x(0x80000000L);
+            __m128i high = _mm_setzero_si128(), low = _mm_setzero_si128();
+            size_t i = 0;
+            for (; i + 2 <= n; i += 2) {
+                __m128i v = _mm_loadu_si128((const __m128i*) (x + i));
+                low = _mm_add_epi64(low, _mm_and_si128(v, mask));
+                high = _mm_add_epi64(high, _mm_sub_epi64(_mm_xor_si128(_mm_srli_epi64(v, 32), bias), bias));
+            }
+            long highs[2], lows[2];
+            _mm_storeu_si128((__m128i*) highs, high);
+            _mm_storeu_si128((__m128i*) lows, low);
+            LongSum s = sumLongScalar(x + i, n - i);
+            return LongSum { s.high + highs[0] + highs[1], s.low + lows[0] + lows[1] };
+        }
+
+        bool addLongSSE2(const long* x, const long* y, long* r, size_t n) {
+            __m128i overflow = _mm_setzero_si128();
+            size_t i = 0;
+            for (; i + 2 <= n; i += 2) {
+                __m128i a = _mm_loadu_si128((const __m128i*) (x + i));
+                __m128i b = _mm_loadu_si128((const __m128i*) (y + i));
+                __m128i s = _mm_add_epi64(a, b);
+                overflow = _mm_or_si128(overflow, _mm_and_si128(_mm_xor_si128(a, s), _mm_xor_si128(b, s)));
+                _mm_storeu_si128((__m128i*) (r + i), s);
+            }
+            return _mm_movemask_pd(_mm_castsi128_pd(overflow)) == 0 && addLongScalar(x + i, y + i, r + i, n - i);
+        }
+
+        /* SSE2 has no 64 bit compare, min/max of longs are scalar. */
+        constexpr Kernels sse2Kernels = {
+            sumSSE2, dotSSE2, minSSE2, maxSSE2, addSSE2, multiplySSE2,
+            sumLongSSE2, minLongScalar, maxLongScalar, addLongSSE2
+        };
+
+        /* AVX2, four lanes in one register. */
+
+#define INKY_AVX2 __attribute__((target("avx2")))
+
+        INKY_AVX2 double sumAVX2(const double* x, size_t n) {
+            __m256d a = _mm256_setzero_pd();
+            size_t i = 0;
+            for (; i + 4 <= n; i += 4) a = _mm256_add_pd(a, _mm256_loadu_pd(x + i));
+            double lanes[4];
+            _mm256_storeu_pd(lanes, a);
+            double r = combine(lanes);
+            for (; i < n; i++) r += x[i];
+            return r;
+        }
+
+        INKY_AVX2 double dotAVX2(const double* x, const double* y, size_t n) {
+            __m256d a = _mm256_setzero_pd();
+            size_t i = 0;
+            for (; i + 4 <= n; i += 4) a = _mm256_add_pd(a, _mm256_mul_pd(_mm256_loadu_pd(x + i), _mm256_loadu_pd(y + i)));
+            double lanes[4];
+            _mm256_storeu_pd(lanes, a);
+            double r = combine(lanes);
+            for (; i < n; i++) r += x[i] * y[i];
+            return r;
+        }
+
+        INKY_AVX2 double minAVX2(const double* x, size_t n) {
+            __m256d a = _mm256_set1_pd(x[0]);
+            size_t i = 0;
+            for (; i + 4 <= n; i += 4) a = _mm256_min_pd(_mm256_loadu_pd(x + i), a);
+            double lanes[4];
+            _mm256_storeu_pd(lanes, a);
+            double r = combineMin(lanes);
+            for (; i < n; i++) r = minOf(x[i], r);
+            return r;
+        }
+
+        INKY_AVX2 double maxAVX2(const double* x, size_t n) {
+            __m256d a = _mm256_set1_pd(x[0]);
+            size_t i = 0;
+            for (; i + 4 <= n; i += 4) a = _mm256_max_pd(_mm256_loadu_pd(x + i), a);
+            double lanes[4];
+            _mm256_storeu_pd(lanes, a);
+            double r = combineMax(lanes);
+            for (; i < n; i++) r = maxOf(x[i], r);
+            return r;
+        }
+
+        INKY_AVX2 void addAVX2(const double* x, const double* y, double* r, size_t n) {
+            size_t i = 0;
+            for (; i + 4 <= n; i += 4) _mm256_storeu_pd(r + i, _mm256_add_pd(_mm256_loadu_pd(x + i), _mm256_loadu_pd(y + i)));
+            for (; i < n; i++) r[i] = x[i] + y[i];
+        }
+
+        INKY_AVX2 void multiplyAVX2(const double* x, const double* y, double* r, size_t n) {
+            size_t i = 0;
+            for (; i + 4 <= n; i += 4) _mm256_storeu_pd(r + i, _mm256_mul_pd(_mm256_loadu_pd(x + i), _mm256_loadu_pd(y + i)));
+            for (; i < n; i++) r[i] = x[i] * y[i];
+        }
+
+        INKY_AVX2 LongSum sumLongAVX2(const long* x, size_t n) {
+            const __m256i mask = _mm256_set1_epi64x(0xffffffffL), bias = _mm256_set1_epi64x(0x80000000L);
+            __m256i high = _mm256_setzero_si256(), low = _mm256_setzero_si256();
+            size_t i = 0;
+            for (; i + 4 <= n; i += 4) {
+                __m256i v = _mm256_loadu_si256((const __m256i*) (x + i));
+                low = _mm256_add_epi64(low, _mm256_and_si256(v, mask));
+                high = _mm256_add_epi64(high, _mm256_sub_epi64(_mm256_xor_si256(_mm256_srli_epi64(v, 32), bias), bias));
+            }
+            long highs[4], lows[4];
+            _mm256_storeu_si256((__m256i*) highs, high);
+            _mm256_storeu_si256((__m256i*) lows, low);
+            LongSum s = sumLongScalar(x + i, n - i);
+            for (int k = 0; k < 4; k++) {
+                s.high += highs[k];
+                s.low += lows[k];
+            }
+            return s;
+        }
+
+        INKY_AVX2 long minLongAVX2(const long* x, size_t n) {
+            __m256i a = _mm256_set1_epi64x(x[0]);
+            size_t i = 0;
+            for (; i + 4 <= n; i += 4) {
+                __m256i v = _mm256_loadu_si256((const __m256i*) (x + i));
+                a = _mm256_blendv_epi8(a, v, _mm256_cmpgt_epi64(a, v));
+            }
+            long lanes[4];
+            _mm256_storeu_si256((__m256i*) lanes, a);
+            long r = minLongScalar(lanes, 4);
+            return i < n ? std::min(r, minLongScalar(x + i, n - i)) : r;
+        }
+
+        INKY_AVX2 long maxLongAVX2(const long* x, size_t n) {
+            __m256i a = _mm256_set1_epi64x(x[0]);
+            size_t i = 0;
+            for (; i + 4 <= n; i += 4) {
+                __m256i v = _mm256_loadu_si256((const __m256i*) (x + i));
+                a = _mm256_blendv_epi8(a, v, _mm256_cmpgt_epi64(v, a));
+            }
+            long lanes[4];
+            _mm256_storeu_si256((__m256i*) lanes, a);
+            long r = maxLongScalar(lanes, 4);
+            return i < n ? std::max(r, maxLongScalar(x + i, n - i)) : r;
+        }
+
+        INKY_AVX2 bool addLongAVX2(const long* x, const long* y, long* r, size_t n) {
+            __m256i overflow = _mm256_setzero_si256();
+            size_t i = 0;
+            for (; i + 4 <= n; i += 4) {
+                __m256i a = _mm256_loadu_si256((const __m256i*) (x + i));
+                __m256i b = _mm256_loadu_si256((const __m256i*) (y + i));
+                __m256i s = _mm256_add_epi64(a, b);
+                overflow = _mm256_or_si256(overflow, _mm256_and_si256(_mm256_xor_si256(a, s), _mm256_xor_si256(b, s)));
+                _mm256_storeu_si256((__m256i*) (r + i), s);
+            }
+            return _mm256_movemask_pd(_mm256_castsi256_pd(overflow)) == 0 && addLongScalar(x + i, y + i, r + i, n - i);
+        }
+
+#undef INKY_AVX2
+
+        constexpr Kernels avx2Kernels = {
+            sumAVX2, dotAVX2, minAVX2, maxAVX2, addAVX2, multiplyAVX2,
+            sumLongAVX2, minLongAVX2, maxLongAVX2, addLongAVX2
+        };
+
+        const Kernels* const kernelsByLevel[] = { &scalarKernels, &sse2Kernels, &avx2Kernels };
+#else
+        const Kernels* const kernelsByLevel[] = { &scalarKernels, &scalarKernels, &scalarKernels };
+#endif
+
+        Level best() {
+            if ( supported(Level::AVX2) ) return Level::AVX2;
+            if ( supported(Level::SSE2) ) return Level::SSE2;
+            return Level::Scalar;
+        }
+
+        std::atomic<Level>& selected() {
+            static std::atomic<Level> level(best());
+            return level;
+        }
+
+        const Kernels& kernels() { return *kernelsByLevel[(int) selected().load(std::memory_order_relaxed)]; }
+    }
+
+    Level level() { return selected().load(); }
+
+    bool supported(Level level) {
+        switch (level) {
+            case Level::Scalar:
+                return true;
+#ifdef INKY_SIMD_X86
+            case Level::SSE2:
+                return true;
+            case Level::AVX2:
+                return __builtin_cpu_supports("avx2");
+#endif
+            default:
+                return false;
+        }
+    }
+
+    bool setLevel(Level level) {
+        if ( !supported(level) ) return false;
+        selected().store(level);
+        return true;
+    }
+
+    const char* name(Level level) {
+        switch (level) {
+            case Level::Scalar: return "scalar";
+            case Level::SSE2:   return "sse2";
+            default:            return "avx2";
+        }
+    }
+
+    double sum(const double* x, size_t n) { return kernels().sumDouble(x, n); }
+    double dot(const double* x, const double* y, size_t n) { return kernels().dot(x, y, n); }
+    double min(const double* x, size_t n) { return kernels().minDouble(x, n); }
+    double max(const double* x, size_t n) { return kernels().maxDouble(x, n); }
+    void add(const double* x, const double* y, double* r, size_t n) { kernels().addDouble(x, y, r, n); }
+    void multiply(const double* x, const double* y, double* r, size_t n) { kernels().multiplyDouble(x, y, r, n); }
+
+    LongSum sum(const long* x, size_t n) { return kernels().sumLong(x, n); }
+    long min(const long* x, size_t n) { return kernels().minLong(x, n); }
+    long max(const long* x, size_t n) { return kernels().maxLong(x, n); }
+    bool add(const long* x, const long* y, long* r, size_t n) { return kernels().addLong(x, y, r, n); }
+
+    /* There is no 64 bit multiply below AVX-512, at every level this is a checked scalar loop. */
+    bool multiply(const long* x, const long* y, long* r, size_t n) {
+        for (size_t i = 0; i < n; i++) {
+            if ( !Checked::multiply(x[i], y[i], r[i]) ) return false;
+        }
+        return true;
+    }
+
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <variant>
+#include <vector>
+
+namespace Inky::Lisp {
+
+    /*
+     * A numeric vector, a contiguous array of either longs or doubles (never a mix, a vector made
+     * from integers and doubles holds doubles). The vector builtins (vsum, vdot, v+ ...) run over
+     * the array with the SIMD kernels below, rather than over a list of boxed values.
+     */
+    struct Vector {
+        std::variant<std::vector<long>, std::vector<double>> elements;
+
+        bool isDouble() const { return elements.index() == 1; }
+        size_t size() const { return std::visit([](const auto& xs) { return xs.size(); }, elements); }
+        const std::vector<long>& longs() const { return std::get<0>(elements); }
+        const std::vector<double>& doubles() const { return std::get<1>(elements); }
+    };
+
+    /*
+     * Vector kernels, each has a scalar version and SSE2/AVX2 versions on x86-64, the widest the CPU
+     * supports is selected at run time. Double sums and dot products accumulate in four lanes that
+     * are combined in the same order at every level, so the result doesn't depend on the level
+     * selected (it may differ in the last place from a sum taken strictly in order).
+     */
+    namespace Simd {
+        enum class Level { Scalar, SSE2, AVX2 };
+
+        Level level();                  /* the level in use.                            */
+        bool supported(Level level);    /* true if the CPU supports 'level'.            */
+        bool setLevel(Level level);     /* use 'level', false if it isn't supported.    */
+        const char* name(Level level);
+
+        double sum(const double* x, size_t n);
+        double dot(const double* x, const double* y, size_t n);
+        double min(const double* x, size_t n); /* n > 0. */
+        double max(const double* x, size_t n); /* n > 0. */
+        void add(const double* x, const double* y, double* r, size_t n);
+        void multiply(const double* x, const double* y, double* r, size_t n);
+
+        /*
+         * The sum of longs is exact, it is returned as two parts, high * 2^32 + low, that each fit in
+         * a long for any vector of fewer than 2^31 elements.
+         */
+        struct LongSum { long high; long low; };
+        LongSum sum(const long* x, size_t n);
+        long min(const long* x, size_t n); /* n > 0. */
+        long max(const long* x, size_t n); /* n > 0. */
+
+        /* Elementwise, false if an element overflows a long (r is then incomplete). */
+        bool add(const long* x, const long* y, long* r, size_t n);
+        bool multiply(const long* x, const long* y, long* r, size_t n);
+    }
+
+}
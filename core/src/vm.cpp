@@ -0,0 +1,322 @@
+#include <climits>
+#include <fmt/core.h>
+
+#include "bigint.h"
+#include "builtin.h"
+#include "compiler.h"
+#include "counters.h"
+#include "environment.h"
+#include "lambda.h"
+#include "memo.h"
+#include "profiler.h"
+#include "value.h"
+
+#include "eval.h"
+
+namespace Inky::Lisp {
+
+    /*
+     * Stack based virtual machine for the bytecode produced by the compiler. Lambda calls push
+     * a frame rather than recursing, builtins are called directly. As with the tree walking
+     * evaluator an error value terminates evaluation and is returned as the result.
+     */
+    class VirtualMachine {
+    public:
+
+        explicit VirtualMachine(EnvironmentPtr e): env(e) {}
+
+        ~VirtualMachine() {
+            /* an error leaves the frames of the calls in progress. */
+            for (auto i = frames.rbegin(); i != frames.rend(); ++i) {
+                if ( i->profiled ) Profiler::exit();
+            }
+        }
+
+        ValuePtr run(CodePtr code) {
+            frames.push_back(Frame { code, 0, env, 0, false });
+
+            while ( true ) {
+                Frame& frame = frames.back();
+                const Instruction& i = frame.code->instructions[frame.pc++];
+
+                switch (i.op) {
+                    case OpCode::Constant:
+                        stack.push_back(frame.code->constants[i.a]);
+                        break;
+
+                    case OpCode::Load: {
+                        Symbol key = std::get<Symbol>(frame.code->constants[i.a]->var);
+                        auto lookup = i.b != 0 ? frame.env->lookup(key, frame.code->caches[i.b - 1]) : frame.env->lookup(key);
+                        if ( !lookup ) return Ops::makeError(fmt::format("unbound symbol: {}", symbolName(key)));
+                        stack.push_back(lookup);
+                        break;
+                    }
+
+                    case OpCode::LoadLocal: {
+                        const ValuePtr& local = frame.env->slot(i.a);
+                        if ( local != nullptr ) {
+                            stack.push_back(local);
+                            break;
+                        }
+                        Symbol key = std::get<Symbol>(frame.code->constants[i.b]->var);
+                        auto lookup = frame.env->lookup(key);
+                        if ( !lookup ) return Ops::makeError(fmt::format("unbound symbol: {}", symbolName(key)));
+                        stack.push_back(lookup);
+                        break;
+                    }
+
+                    case OpCode::Define:
+                    case OpCode::Put: {
+                        ExpressionPtr symbols = std::get<ExpressionPtr>(frame.code->constants[i.b]->var);
+                        size_t first = stack.size() - i.a;
+                        for (size_t k = 0; k < i.a; k++) {
+                            Symbol key = std::get<Symbol>(symbols->cells[k]->var);
+                            ValuePtr value = nameFunction(stack[first + k], key);
+                            if ( i.op == OpCode::Define ) frame.env->insertGlobal(key, value);
+                            else frame.env->insert(key, value);
+                        }
+                        stack.resize(first);
+                        stack.push_back(Ops::makeSExpression());
+                        break;
+                    }
+
+                    case OpCode::Lambda:
+                        stack.push_back(instance(frame.code->constants[i.a], frame.env));
+                        break;
+
+                    case OpCode::Defun:
+                    case OpCode::Defmemo: {
+                        ValuePtr lambda = instance(frame.code->constants[i.a], frame.env);
+                        if ( i.op == OpCode::Defmemo ) lambda = memoize(lambda);
+                        frame.env->insert(std::get<Symbol>(frame.code->constants[i.b]->var), lambda);
+                        stack.push_back(lambda);
+                        break;
+                    }
+
+                    case OpCode::Optimized: {
+                        const Reduction& reduction = *std::get<ExpressionPtr>(frame.code->constants[i.a]->var)->reduction;
+                        if ( global == nullptr ) global = env->globalScope(); /* every frame's scope is nested in the same one. */
+                        if ( global == nullptr || !global->holds(reduction) ) frame.pc = i.b;
+                        break;
+                    }
+
+                    case OpCode::Jump:
+                        frame.pc = i.a;
+                        break;
+
+                    case OpCode::JumpIfFalse: {
+                        ValuePtr cond = stack.back();
+                        stack.pop_back();
+                        if ( cond->kind != Type::Integer ) return Ops::makeError("if condition must return true or false.");
+                        if ( std::get<long>(cond->var) == 0 ) frame.pc = i.a;
+                        break;
+                    }
+
+                    case OpCode::Apply: {
+                        ValuePtr result = apply(i.a);
+                        if ( result && Ops::isError(result) ) return result;
+                        break;
+                    }
+
+                    case OpCode::Add:
+                    case OpCode::Subtract:
+                    case OpCode::Multiply:
+                    case OpCode::Divide: {
+                        if ( !arithmetic(i.op, i.a) ) {
+                            ValuePtr result = apply(i.a);
+                            if ( result && Ops::isError(result) ) return result;
+                        }
+                        break;
+                    }
+
+                    case OpCode::Less:
+                    case OpCode::LessEqual:
+                    case OpCode::Greater:
+                    case OpCode::GreaterEqual:
+                    case OpCode::Equal:
+                    case OpCode::NotEqual: {
+                        if ( !compare(i.op, i.a) ) {
+                            ValuePtr result = apply(i.a);
+                            if ( result && Ops::isError(result) ) return result;
+                        }
+                        break;
+                    }
+
+                    case OpCode::Fail:
+                        return frame.code->constants[i.a];
+
+                    case OpCode::Return: {
+                        ValuePtr result = stack.back();
+                        stack.resize(frame.base);
+                        if ( frame.profiled ) Profiler::exit();
+                        frames.pop_back();
+                        if ( frames.empty() ) return result;
+                        stack.push_back(result);
+                        break;
+                    }
+                }
+            }
+        }
+
+    private:
+
+        struct Frame {
+            CodePtr         code;   /* code being executed.                         */
+            size_t          pc;     /* index of the next instruction.               */
+            EnvironmentPtr  env;    /* scope the code is executed in.               */
+            size_t          base;   /* size of the value stack when frame entered.  */
+            bool            profiled; /* the call was entered in the profiler.      */
+        };
+
+        /* Create a new lambda, with its own environment, from a compiled prototype made in 'env'. */
+        static ValuePtr instance(ValuePtr prototype, const EnvironmentPtr& env) {
+            LambdaPtr p = std::get<LambdaPtr>(prototype->var);
+            EnvironmentPtr e = p->env->shallowCopy();
+            env->markLocals(e->slotNames());
+            return Ops::makeFunction(std::make_shared<Lambda>(Lambda{ p->formals, p->body, e, p->code, p->name }));
+        }
+
+        /*
+         * Apply the top n values of the stack, the first being the head of the expression.
+         * The result is pushed on the stack, unless a lambda call frame has been entered, in
+         * which case nullptr is returned; an error result is returned so that the caller can stop.
+         */
+        ValuePtr apply(size_t n) {
+            size_t first = stack.size() - n;
+            ValuePtr head = stack[first];
+
+            if ( head->kind == Type::BuiltinFunction ) {
+                ExpressionPtr args(new Expression());
+                args->cells.assign(stack.begin() + first + 1, stack.end());
+                stack.resize(first);
+                Profiler::Scope profile;
+                profile.enter(head);
+                Counters::builtinCall();
+                ValuePtr result = std::get<BuiltinFunction>(head->var)(frames.back().env, Ops::makeSExpression(args));
+                stack.push_back(result);
+                return result;
+            }
+            else if ( head->kind == Type::Function ) {
+                return call(head, first + 1);
+            }
+
+            /* Make a list of the results, if one result return head. */
+            ExpressionPtr xs(new Expression());
+            for (size_t k = first; k < stack.size(); k++) {
+                if ( !Ops::isEmptyExpression(stack[k]) ) xs->insert(stack[k]);
+            }
+            stack.resize(first);
+            ValuePtr result = xs->cells.size() == 1 ? xs->cells[0] : Ops::makeQExpression(xs);
+            stack.push_back(result);
+            return result;
+        }
+
+        /*
+         * Call a lambda with the arguments held on the stack from 'first'. If all of the formals are
+         * supplied a frame is entered for the body and nullptr returned, otherwise the result (partial
+         * application or error) is pushed on the stack and returned.
+         *
+         * A call followed by Return is a tail call, the caller's frame is replaced by the callee's
+         * so that tail recursion runs in constant stack.
+         */
+        ValuePtr call(ValuePtr f, size_t first) {
+            EnvironmentPtr scope;
+            ValuePtr result = bindArguments(f, stack.begin() + first, stack.end(), scope);
+            stack.resize(first - 1);
+
+            if ( !result ) { /* Fully supplied args, enter the body. */
+                LambdaPtr fn = std::get<LambdaPtr>(f->var);
+                if ( !fn->code ) fn->code = compileLambda(fn);
+
+                Frame& caller = frames.back();
+                scope->setCallerScope(caller.env);
+                if ( caller.code->instructions[caller.pc].op == OpCode::Return ) {
+                    stack.resize(caller.base);
+                    if ( caller.profiled ) Profiler::exit();
+                    frames.pop_back();
+                }
+                bool profiled = Profiler::enabled();
+                if ( profiled ) Profiler::enter(Profiler::nameOf(f));
+                frames.push_back(Frame { fn->code, 0, scope, stack.size(), profiled });
+                return nullptr;
+            }
+
+            stack.push_back(result);
+            return result;
+        }
+
+        static bool allIntegers(std::vector<ValuePtr>::const_iterator i, std::vector<ValuePtr>::const_iterator end) {
+            for (; i != end; ++i) {
+                if ( (*i)->kind != Type::Integer ) return false;
+            }
+            return true;
+        }
+
+        /* Integer fast path for + - * /, returns false if the generic application is required. */
+        bool arithmetic(OpCode op, size_t n) {
+            static const Primitive primitives[] = { builtin_add, builtin_subtract, builtin_multiply, builtin_divide };
+
+            size_t first = stack.size() - n;
+            if ( n < 2 || !isBuiltin(stack[first], primitives[(int) op - (int) OpCode::Add]) ) return false;
+            if ( !allIntegers(stack.begin() + first + 1, stack.end()) ) return false;
+
+            long accumulator = std::get<long>(stack[first + 1]->var);
+            for (size_t k = first + 2; k < stack.size(); k++) {
+                long x = std::get<long>(stack[k]->var);
+                bool fits;
+                switch (op) { /* on overflow let the builtin promote the result to a BigInteger. */
+                    case OpCode::Add:       fits = Checked::add(accumulator, x, accumulator); break;
+                    case OpCode::Subtract:  fits = Checked::subtract(accumulator, x, accumulator); break;
+                    case OpCode::Multiply:  fits = Checked::multiply(accumulator, x, accumulator); break;
+                    default:
+                        /* let the builtin report the error. */
+                        fits = x != 0 && !(x == -1 && accumulator == LONG_MIN);
+                        if ( fits ) accumulator /= x;
+                        break;
+                }
+                if ( !fits ) return false;
+            }
+
+            stack.resize(first);
+            stack.push_back(Ops::makeInteger(accumulator));
+            return true;
+        }
+
+        /* Integer fast path for the comparison operators, returns false if the generic application is required. */
+        bool compare(OpCode op, size_t n) {
+            static const Primitive primitives[] = { builtin_lt, builtin_lte, builtin_gt, builtin_gte, builtin_eq, builtin_neq };
+
+            size_t first = stack.size() - n;
+            if ( n != 3 || !isBuiltin(stack[first], primitives[(int) op - (int) OpCode::Less]) ) return false;
+            if ( !allIntegers(stack.begin() + first + 1, stack.end()) ) return false;
+
+            long x = std::get<long>(stack[first + 1]->var);
+            long y = std::get<long>(stack[first + 2]->var);
+            bool result = false;
+            switch (op) {
+                case OpCode::Less:          result = x < y; break;
+                case OpCode::LessEqual:     result = x <= y; break;
+                case OpCode::Greater:       result = x > y; break;
+                case OpCode::GreaterEqual:  result = x >= y; break;
+                case OpCode::Equal:         result = x == y; break;
+                default:                    result = x != y; break;
+            }
+
+            stack.resize(first);
+            stack.push_back(Ops::makeInteger(result ? 1 : 0));
+            return true;
+        }
+
+    private:
+        EnvironmentPtr          env;    /* Global environment.  */
+        std::vector<Frame>      frames; /* Call stack.          */
+        std::vector<ValuePtr>   stack;  /* Value stack.         */
+        const Environment*      global = nullptr; /* the global scope env is nested in, found when first needed. */
+    };
+
+
+    ValuePtr execute(EnvironmentPtr env, ValuePtr val) {
+        VirtualMachine vm(env);
+        return vm.run(compile(val));
+    }
+}
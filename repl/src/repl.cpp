@@ -1,13 +1,22 @@
+#include <fstream>
 #include <iostream>
+#include <string>
 #include <fmt/core.h>
 #include <fmt/color.h>
 #include <fmt/ostream.h>
 
 #include "builtin.h"
+#include "counters.h"
 #include "either.h"
 #include "environment.h"
 #include "eval.h"
+#include "heap.h"
+#include "image.h"
+#include "optimizer.h"
 #include "parser.h"
+#include "profiler.h"
+#include "source.h"
+#include "trace.h"
 #include "repl.h"
 
 
@@ -22,12 +31,13 @@ namespace Inky::Lisp {
         void parseAndEvalInput(std::string_view input) {
             auto v = parse(input);
             if ( v) {
-                ValuePtr result = eval(env, v.right());
+                ValuePtr result = evaluator()(env, v.right());
                 bool isOk= !Ops::isError(result);
                 auto clr = isOk? fg(fmt::terminal_color::green) | (fmt::emphasis::bold)
                         : fg(fmt::terminal_color::red) | (fmt::emphasis::bold);
 
                 fmt::print(clr,"{}\n",result);
+                if ( !isOk ) dumpTrace(stdout, std::cout);
 
             } else {
                 ParseError e = v.left();
@@ -51,15 +61,177 @@ namespace Inky::Lisp {
 
             if (input == ":t") {
                 ctx.flags ^= FLAG_DEBUG;
+                Trace::setEnabled(ctx.flags & FLAG_DEBUG);
+                Trace::clear();
                 printf("debug trace", FLAG_DEBUG);
             }
+            else if (input.substr(0,6) == ":trace") {
+                /* ':trace n' prints the last n steps of the trace, ':trace' all of those held. */
+                size_t n = Trace::capacity;
+                auto count = input.substr(6);
+                if ( count.find_first_not_of(' ') != std::string_view::npos ) {
+                    try {
+                        n = std::stoul(std::string(count));
+                    } catch (const std::exception&) {
+                        fmt::print(fg(fmt::terminal_color::red) | (fmt::emphasis::bold), "usage: :trace [steps]\n");
+                        return;
+                    }
+                }
+                Trace::dump(std::cout, n);
+            }
+            else if (input == ":c") {
+                ctx.flags ^= FLAG_COMPILE;
+                printf("bytecode compilation", FLAG_COMPILE);
+            }
+            else if (input == ":o") {
+                ctx.flags ^= FLAG_OPTIMIZE;
+                printf("optimizer", FLAG_OPTIMIZE);
+            }
+            else if (input.substr(0,3) == ":gc") {
+                /* ':gc' release the free blocks held for reuse, ':gc n' also sets the number held. */
+                auto limit = input.substr(3);
+                if ( limit.find_first_not_of(' ') != std::string_view::npos ) {
+                    try {
+                        Heap::setLimit(std::stoul(std::string(limit)));
+                    } catch (const std::exception&) {
+                        fmt::print(fg(fmt::terminal_color::red) | (fmt::emphasis::bold), "usage: :gc [free block limit]\n");
+                        return;
+                    }
+                }
+                auto released = Heap::collect();
+                auto stats = Heap::stats();
+                fmt::print(fg(fmt::terminal_color::green) | (fmt::emphasis::bold),
+                           "heap::live {} allocated {} freed {} reused {} released {} (limit {}, collections {})\n",
+                           stats.allocated - stats.freed, stats.allocated, stats.freed, stats.reused,
+                           released, stats.limit, stats.collections);
+            }
+            else if (input.substr(0,5) == ":prof") {
+                runProfilerCommand(input.substr(5));
+            }
+            else if (input.substr(0,6) == ":stats") {
+                runStatsCommand(input.substr(6));
+            }
         }
 
-        void run() {
+        /* ':stats on|off' starts or stops the runtime counters, ':stats reset' zeroes them and ':stats' prints them. */
+        static void runStatsCommand(std::string_view arguments) {
+            auto ok = fg(fmt::terminal_color::green) | (fmt::emphasis::bold);
+
+            size_t start = arguments.find_first_not_of(' ');
+            std::string_view command = start == std::string_view::npos ? "" : arguments.substr(start);
+            if ( command == "on" || command == "off" ) {
+                Counters::setEnabled(command == "on");
+            }
+            else if ( command == "reset" ) {
+                Counters::reset();
+            }
+            else if ( !command.empty() ) {
+                fmt::print(fg(fmt::terminal_color::red) | (fmt::emphasis::bold), "usage: :stats [on|off|reset]\n");
+                return;
+            }
+
+            Counters::Stats stats = Counters::stats();
+            fmt::print(ok, "stats::{}\n", Counters::enabled() ? "enabled" : "disabled");
+
+            std::string values;
+            for (size_t k = 0; k < Counters::types; k++) {
+                if ( stats.values[k] ) values += fmt::format(" {} {}", Counters::typeName((Type) k), stats.values[k]);
+            }
+            fmt::print("values allocated:{}\n", values.empty() ? " none" : values);
+            fmt::print("deep clones: {} copying {} values and {} environments\n",
+                       stats.clones, stats.cloned, stats.environmentClones);
+            fmt::print("environments created: {}\n", stats.environments);
+
+            std::string lookups;
+            for (size_t k = 0; k < Counters::depths; k++) {
+                if ( stats.lookups[k] ) lookups += fmt::format(" {}{}:{}", k + 1, k + 1 == Counters::depths ? "+" : "", stats.lookups[k]);
+            }
+            fmt::print("lookups by scopes searched:{} unbound:{}\n", lookups, stats.unbound);
+            fmt::print("builtin calls: {}\n", stats.builtinCalls);
+        }
+
+        /* ':prof on|off' starts or stops the profiler, ':prof report' and ':prof folded file' show what it recorded. */
+        static void runProfilerCommand(std::string_view arguments) {
+            auto ok = fg(fmt::terminal_color::green) | (fmt::emphasis::bold);
+            auto failed = fg(fmt::terminal_color::red) | (fmt::emphasis::bold);
+
+            size_t start = arguments.find_first_not_of(' ');
+            std::string_view command = start == std::string_view::npos ? "" : arguments.substr(start);
+            std::string_view file;
+            if ( size_t space = command.find(' '); space != std::string_view::npos ) {
+                size_t name = command.find_first_not_of(' ', space);
+                if ( name != std::string_view::npos ) file = command.substr(name);
+                command = command.substr(0, space);
+            }
 
+            if ( command == "on" || command == "off" ) {
+                Profiler::setEnabled(command == "on");
+                fmt::print(ok, "profiler::{}\n", command == "on" ? "enabled" : "disabled");
+            }
+            else if ( command == "report" ) {
+                fmt::print(ok, "{:<24} {:>10} {:>12} {:>12}\n", "function", "calls", "self ms", "total ms");
+                for (const auto& f: Profiler::report()) {
+                    fmt::print("{:<24} {:>10} {:>12.3f} {:>12.3f}\n", f.name, f.calls, f.self * 1e3, f.inclusive * 1e3);
+                }
+            }
+            else if ( command == "folded" && !file.empty() ) {
+                std::ofstream out{std::string(file)};
+                out << Profiler::folded();
+                if ( out ) fmt::print(ok, "profiler::folded stacks written to {}\n", file);
+                else fmt::print(failed, "profiler::unable to write {}\n", file);
+            }
+            else {
+                fmt::print(failed, "usage: :prof on|off|report|folded <file>\n");
+            }
+        }
+
+        /* The evaluator selected by the flags. */
+        Evaluator evaluator() const {
+            if ( ctx.flags & FLAG_OPTIMIZE ) return (ctx.flags & FLAG_COMPILE) ? executeOptimized : evalOptimized;
+            return (ctx.flags & FLAG_COMPILE) ? execute : eval;
+        }
+
+        /* Print the error, if the result is one; returns false for an error. */
+        static bool check(ValuePtr result) {
+            if ( !Ops::isError(result) ) return true;
+            fmt::print(stderr, fg(fmt::terminal_color::red) | (fmt::emphasis::bold), "{}\n",
+                       std::get<LispErrorPtr>(result->var)->message);
+            dumpTrace(stderr, std::cerr);
+            return false;
+        }
+
+        /* The steps that led up to an error, if the trace is being recorded. */
+        static void dumpTrace(std::FILE* file, std::ostream& os) {
+            if ( !Trace::enabled() ) return;
+            fmt::print(file, fg(fmt::terminal_color::yellow), "last steps:\n");
+            Trace::dump(os, errorSteps);
+        }
+
+        static constexpr size_t errorSteps = 16;
+
+        /* The prelude, or an image of an initialised environment (which includes the prelude). */
+        bool initialise() {
             addBuiltinFunctions(env);
+            Trace::setEnabled(ctx.flags & FLAG_DEBUG);
 
-            /* TODO; load the prelude. */
+            if ( !ctx.image.empty() ) return check(loadImage(env, ctx.image));
+            if ( ctx.prelude.empty() ) return true;
+            if ( !SourceFile(ctx.prelude).isOpen() ) {
+                fmt::print(stderr, fg(fmt::terminal_color::yellow), "prelude {} not found, not loaded.\n", ctx.prelude);
+                return true;
+            }
+            return check(loadFile(env, ctx.prelude, evaluator()));
+        }
+
+        int run() {
+            if ( !initialise() ) return 1;
+
+            /* Load the scripts, stops at the first that fails. */
+            for (const auto& script: ctx.scripts) {
+                if ( !check(loadFile(env, script, evaluator())) ) return 1;
+            }
+            if ( !ctx.saveImage.empty() && !check(saveImage(env, ctx.saveImage)) ) return 1;
+            if ( (!ctx.scripts.empty() || !ctx.saveImage.empty()) && !(ctx.flags & FLAG_INTERACTIVE) ) return 0;
 
             while (true) {
                 fmt::print("λ> ");
@@ -71,6 +243,7 @@ namespace Inky::Lisp {
                 else if (input[0] == ';') { /* ignore, first character is comment, so skip entire line. */ }
                 else parseAndEvalInput(input);
             }
+            return 0;
         }
 
     private:
@@ -79,9 +252,9 @@ namespace Inky::Lisp {
     };
 
 
-    void repl(ReplContext & ctx) {
+    int repl(ReplContext & ctx) {
         Repl r(ctx);
-        r.run();
+        return r.run();
     }
 
 
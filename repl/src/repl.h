@@ -1,13 +1,29 @@
 #pragma once
 
+#include <string>
+#include <vector>
+
 namespace Inky::Lisp {
 
     /* Define any flags for REPL commands. */
-    constexpr int FLAG_DEBUG= 0x1;
+    constexpr int FLAG_DEBUG= 0x1; /* record the evaluation trace, shown on an error, see trace.h. */
+    constexpr int FLAG_COMPILE= 0x2; /* evaluate input with the bytecode VM. */
+    constexpr int FLAG_INTERACTIVE= 0x4; /* run the REPL after loading the scripts (or saving an image). */
+    constexpr int FLAG_OPTIMIZE= 0x8; /* optimize input before evaluating it, see optimizer.h. */
 
     /* Context holds the stat of the flags, etc. */
-    struct ReplContext { int flags = 0; };
+    struct ReplContext {
+        int flags = 0;
+        std::string prelude;                /* loaded first, unless an image is.                        */
+        std::string image;                  /* image of an environment to start from, see image.h.      */
+        std::vector<std::string> scripts;   /* files loaded, in order, before the REPL runs.            */
+        std::string saveImage;              /* save the environment, once the scripts are loaded.       */
+    };
 
-    void repl(ReplContext & ctx); /* Run the REPL. */
+    /*
+     * Run the REPL, or if there are scripts (or an image to save) load them, save the image and then
+     * run the REPL if interactive; returns the exit status.
+     */
+    int repl(ReplContext & ctx);
 
 }
\ No newline at end of file
@@ -1,13 +1,41 @@
+#include <string>
+#include <fmt/core.h>
+
 #include "repl.h"
 
 
+/*
+ * inky-repl [-c] [-i] [-t] [-O] [--prelude file] [--image file] [--save-image file] [script ...]
+ *
+ * Loads the prelude, or restores an image, then loads the scripts in order. With no scripts (or
+ * with -i) the REPL is run, -c evaluates with the bytecode VM, -t records the evaluation trace, -O optimizes each form before evaluating it. --save-image writes an image of
+ * the environment once the scripts are loaded; restoring it skips evaluating them again.
+ */
 int main(int argc, char** argv) {
 
     using namespace Inky::Lisp;
 
     ReplContext context;
-    repl(context);
+#ifdef INKY_PRELUDE
+    context.prelude = INKY_PRELUDE;
+#endif
 
+    for (int k = 1; k < argc; k++) {
+        std::string arg = argv[k];
+        bool hasValue = k + 1 < argc;
+        if ( arg == "-c" ) context.flags |= FLAG_COMPILE;
+        else if ( arg == "-i" ) context.flags |= FLAG_INTERACTIVE;
+        else if ( arg == "-t" ) context.flags |= FLAG_DEBUG;
+        else if ( arg == "-O" ) context.flags |= FLAG_OPTIMIZE;
+        else if ( arg == "--prelude" && hasValue ) context.prelude = argv[++k];
+        else if ( arg == "--image" && hasValue ) context.image = argv[++k];
+        else if ( arg == "--save-image" && hasValue ) context.saveImage = argv[++k];
+        else if ( arg[0] == '-' ) {
+            fmt::print(stderr, "usage: inky-repl [-c] [-i] [-t] [-O] [--prelude file] [--image file] [--save-image file] [script ...]\n");
+            return 2;
+        }
+        else context.scripts.push_back(arg);
+    }
 
-    return 0;
+    return repl(context);
 }
@@ -0,0 +1,62 @@
+#include <catch2/catch.hpp>
+
+#include "builtin.h"
+#include "counters.h"
+#include "environment.h"
+#include "eval.h"
+#include "parser.h"
+#include "value.h"
+
+
+TEST_CASE("the runtime counters count allocations, clones, environments, lookups and builtin calls","[counters-1]") {
+    using namespace Inky::Lisp;
+
+    EnvironmentPtr e(new Environment());
+    addBuiltinFunctions(e);
+    eval(e, parse("defun (add x y) (+ x y)").right());
+    ValuePtr list = parse("[1 [2 3] (add 4 5)]").right();
+
+    auto lookups = [](const Counters::Stats& s) {
+        size_t n = 0;
+        for (auto l: s.lookups) n += l;
+        return n;
+    };
+
+    /* nothing is counted while disabled. */
+    Counters::reset();
+    eval(e, parse("add 1 2").right());
+    list->clone();
+    Counters::Stats idle = Counters::stats();
+    REQUIRE(idle.builtinCalls == 0);
+    REQUIRE(idle.environments == 0);
+    REQUIRE(idle.clones == 0);
+    REQUIRE(lookups(idle) == 0);
+
+    Counters::setEnabled(true);
+    for (auto evaluator: { eval, execute }) {
+        Counters::reset();
+        REQUIRE(std::get<long>(evaluator(e, parse("add 1000 2000").right())->var) == 3000);
+        REQUIRE(Ops::isError(evaluator(e, parse("add undefined 1").right())));
+        REQUIRE(std::get<long>(evaluator(e, parse("len [1 2]").right())->var) == 2);
+        Counters::Stats s = Counters::stats();
+        REQUIRE(s.builtinCalls >= 1); /* len, the arithmetic may be inlined. */
+        REQUIRE(s.environments >= 1);  /* the frame of the call. */
+        REQUIRE(s.values[(size_t) Type::Integer] >= 1); /* 3000 isn't a shared small integer. */
+        REQUIRE(s.unbound == 1);
+        REQUIRE(lookups(s) >= 1);
+    }
+
+    Counters::reset();
+    list->clone();
+    Counters::Stats s = Counters::stats();
+    REQUIRE(s.clones == 1);
+    REQUIRE(s.cloned == 10); /* the parsed expression, the list, its 3 elements and the 5 within them. */
+
+    /* a function's environment is copied with it. */
+    Counters::reset();
+    e->lookup("add")->clone();
+    s = Counters::stats();
+    REQUIRE(s.clones == 1);
+    REQUIRE(s.environmentClones == 1);
+    Counters::setEnabled(false);
+}
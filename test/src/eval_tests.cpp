@@ -1,8 +1,11 @@
 #include <initializer_list>
+#include <sstream>
 #include <catch2/catch.hpp>
 
 #include "builtin.h"
 #include "environment.h"
+#include "eval.h"
+#include "parser.h"
 #include "value.h"
 #include "test_util.h"
 
@@ -41,4 +44,241 @@ TEST_CASE("min/max on numeric s-expressions.","[basic-eval-2]") {
     };
 
     verifyTestCases(e,tests);
-}
\ No newline at end of file
+}
+TEST_CASE("evaluation does not modify lambdas or bound expressions.","[basic-eval-3]") {
+    using namespace Inky::Lisp;
+
+    EnvironmentPtr e(new Environment());
+    addBuiltinFunctions(e);
+
+    auto run = [&](std::string_view input) { return eval(e, parse(input).right()); };
+
+    REQUIRE(!Ops::isError(run("def xs [ (+ 1 1) (+ 2 2) (+ 3 3) ]")));
+    REQUIRE(!Ops::isError(run("defun (sum x y) (if (< x y) (+ x y) [(- x y)])")));
+    auto before = show(run("sum"));
+
+    std::initializer_list<TestCase> tests  = {
+            { "sum 1 2", Type::Integer, 3L },
+            { "sum 3 2", Type::Integer, 1L },
+            { "sum 1 2", Type::Integer, 3L },
+            { "eval (head (tail xs))", Type::Integer, 4L },
+            { "eval (head xs)", Type::Integer, 2L }
+    };
+    verifyTestCases(e,tests);
+
+    REQUIRE(show(run("sum")) == before);
+    REQUIRE(show(run("xs")) == "[(+ 1 1) (+ 2 2) (+ 3 3)]");
+
+    /* an arithmetic builtin leaves the arguments it is passed as they are. */
+    for (const char* args: { "1 2", "1 2.5", "1 99999999999999999999" }) {
+        ValuePtr xs = parse(args).right();
+        for (const char* name: { "+", "-", "*" }) {
+            std::get<BuiltinFunction>(run(name)->var)(e, xs);
+            REQUIRE(show(xs) == "(" + std::string(args) + ")");
+        }
+    }
+}
+
+TEST_CASE("symbols are interned, special forms have fixed ids.","[basic-eval-4]") {
+    using namespace Inky::Lisp;
+
+    auto parsed = parse("defun foo if foo \\ bar");
+    REQUIRE(parsed.isRight());
+    auto cells = std::get<ExpressionPtr>(parsed.right()->var)->cells;
+    REQUIRE(cells.size() == 6);
+
+    REQUIRE(Ops::isSymbol(cells[0], Symbols::Defun));
+    REQUIRE(Ops::isSymbol(cells[2], Symbols::If));
+    REQUIRE(Ops::isSymbol(cells[4], Symbols::Backslash));
+    REQUIRE(std::get<Symbol>(cells[1]->var) == std::get<Symbol>(cells[3]->var));
+    REQUIRE(std::get<Symbol>(cells[1]->var) != std::get<Symbol>(cells[5]->var));
+    REQUIRE(symbolName(std::get<Symbol>(cells[5]->var)) == "bar");
+    REQUIRE(!Symbols::isSpecialForm(std::get<Symbol>(cells[1]->var)));
+}
+
+TEST_CASE("small integers are shared, arithmetic is exact either side of the shared range.","[basic-eval-5]") {
+    using namespace Inky::Lisp;
+
+    REQUIRE(Ops::makeInteger(1) == Ops::makeInteger(1));
+    REQUIRE(Ops::makeInteger(-128) == Ops::makeInteger(-128));
+    REQUIRE(std::get<long>(Ops::makeInteger(100000)->var) == 100000L);
+
+    EnvironmentPtr e(new Environment());
+    addBuiltinFunctions(e);
+
+    std::initializer_list<TestCase> tests  = {
+            { "(+ 1000 23)", Type::Integer, 1023L },
+            { "(+ 1000 24)", Type::Integer, 1024L },
+            { "(- 0 128)", Type::Integer, -128L },
+            { "(- 0 129)", Type::Integer, -129L },
+            { "(* 1000 1000)", Type::Integer, 1000000L },
+            { "(- (* 1000 1000) 999999)", Type::Integer, 1L },
+            { "(+ 0.5 1023)", Type::Double, 1023.5 },
+            { "(< 1 2)", Type::Integer, 1L }
+    };
+    verifyTestCases(e,tests);
+}
+
+TEST_CASE("tail calls run in constant stack, callers remain visible to the callee.","[basic-eval-6]") {
+    using namespace Inky::Lisp;
+
+    for (auto evaluator: { eval, execute }) {
+        EnvironmentPtr e(new Environment());
+        addBuiltinFunctions(e);
+
+        for (const auto& definition: {
+                "defun (loop n acc) (if (== n 0) (acc) (loop (- n 1) (+ acc 1)))",
+                "defun (even n) (if (== n 0) (1) (odd (- n 1)))",
+                "defun (odd n) (if (== n 0) (0) (even (- n 1)))",
+                "defun (outer x) (inner 1)",
+                "defun (inner y) (+ x y)" }) {
+            REQUIRE(!Ops::isError(evaluator(e, parse(definition).right())));
+        }
+
+        std::initializer_list<TestCase> tests  = {
+                { "loop 200000 0", Type::Integer, 200000L },
+                { "even 100001", Type::Integer, 0L },
+                { "outer 5", Type::Integer, 6L }
+        };
+        verifyTestCases(e, tests, evaluator);
+    }
+}
+
+TEST_CASE("arithmetic kernels agree across argument counts and types, errors are values.","[basic-eval-7]") {
+    using namespace Inky::Lisp;
+
+    EnvironmentPtr e(new Environment());
+    addBuiltinFunctions(e);
+
+    /* long enough to span several blocks of the integer reduction. */
+    std::string sum = "+", product = "*";
+    for (int k = 1; k <= 200; k++) sum += " " + std::to_string(k);
+    for (int k = 1; k <= 160; k++) product += k % 10 == 0 ? " -1" : " 1";
+
+    std::initializer_list<TestCase> tests  = {
+            { sum, Type::Integer, 20100L },
+            { product, Type::Integer, 1L },
+            { "(- 10 1 2 3)", Type::Integer, 4L },
+            { "(/ 100 2 5)", Type::Integer, 10L },
+            { "(/ 7 2)", Type::Integer, 3L },
+            { "(- 1 2.5)", Type::Double, -1.5 },
+            { "(* 2 2.5 2)", Type::Double, 10.0 },
+            { "(max -1 -2)", Type::Integer, -1L },
+            { "(min 3)", Type::Integer, 3L },
+            { "(< 1 2.5)", Type::Integer, 1L },
+            { "(>= 2.5 3)", Type::Integer, 0L },
+            { "(<= 2 2)", Type::Integer, 1L }
+    };
+    verifyTestCases(e, tests);
+    verifyTestCases(e, tests, execute);
+
+    for (const auto& input: { "(/ 10 0)", "(/ 10.5 0)", "(/ 10 2 0)", "(+ 1 [2])", "(< 1)", "(< 1 \"2\")" }) {
+        INFO(input);
+        REQUIRE(Ops::isError(eval(e, parse(input).right())));
+        REQUIRE(Ops::isError(execute(e, parse(input).right())));
+    }
+}
+
+TEST_CASE("integer arithmetic that overflows a long is exact, the result held as a long when it fits.","[basic-eval-8]") {
+    using namespace Inky::Lisp;
+
+    EnvironmentPtr e(new Environment());
+    addBuiltinFunctions(e);
+
+    struct { const char* expression; Type kind; const char* result; } tests[] = {
+            { "(+ 9223372036854775807 1)", Type::BigInteger, "9223372036854775808" },
+            { "(- -9223372036854775808 1)", Type::BigInteger, "-9223372036854775809" },
+            { "(* 4294967296 4294967296 4294967296)", Type::BigInteger, "79228162514264337593543950336" },
+            { "(/ -9223372036854775808 -1)", Type::BigInteger, "9223372036854775808" },
+            { "123456789012345678901234567890", Type::BigInteger, "123456789012345678901234567890" },
+            { "-123456789012345678901234567890", Type::BigInteger, "-123456789012345678901234567890" },
+            { "(- (+ 9223372036854775807 10) 10)", Type::Integer, "9223372036854775807" },
+            { "(/ 123456789012345678901234567890 123456789012345678901234567890)", Type::Integer, "1" },
+            { "(/ 79228162514264337593543950336 -3)", Type::BigInteger, "-26409387504754779197847983445" },
+            { "(+ 1 2 9223372036854775807 -9223372036854775807)", Type::Integer, "3" },
+            { "(max 1 123456789012345678901234567890 2)", Type::BigInteger, "123456789012345678901234567890" },
+            { "(< 9223372036854775807 9223372036854775808)", Type::Integer, "1" },
+            { "(> -9223372036854775809 -9223372036854775808)", Type::Integer, "0" },
+            { "(== (* 4294967296 4294967296) 18446744073709551616)", Type::Integer, "1" },
+            { "(!= (* 4294967296 4294967296) 18446744073709551617)", Type::Integer, "1" },
+            { "(+ 9223372036854775808 0.5)", Type::Double, "9.22337e+18" }
+    };
+
+    for (auto evaluator: { eval, execute }) {
+        for (const auto& test: tests) {
+            INFO(test.expression);
+            ValuePtr result = evaluator(e, parse(test.expression).right());
+            REQUIRE(result->kind == test.kind);
+            std::ostringstream os;
+            os << result;
+            REQUIRE(os.str() == test.result);
+        }
+    }
+
+    for (const auto& input: { "(/ 123456789012345678901234567890 0)", "(/ 10 (- 10 10) 123456789012345678901234567890)" }) {
+        INFO(input);
+        REQUIRE(Ops::isError(eval(e, parse(input).right())));
+        REQUIRE(Ops::isError(execute(e, parse(input).right())));
+    }
+}
+
+TEST_CASE("memoized functions cache results by the same arguments, with LRU eviction.","[basic-eval-9]") {
+    using namespace Inky::Lisp;
+
+    for (auto evaluator: { eval, execute }) {
+        EnvironmentPtr e(new Environment());
+        addBuiltinFunctions(e);
+        auto run = [&](std::string_view input) { return evaluator(e, parse(input).right()); };
+
+        /* exponential if the recursive calls weren't cached. */
+        REQUIRE(!Ops::isError(run("defmemo (fib n) (if (< n 2) (n) (+ (fib (- n 1)) (fib (- n 2))))")));
+        REQUIRE(show(run("fib 90")) == "2880067194370816120");
+        REQUIRE(show(run("memo-stats fib")) == "[88 91 91 10000]");
+
+        REQUIRE(!Ops::isError(run("def (sq) (memoize (\\ (xs) (* (len xs) (len xs))) 2)")));
+        for (auto input: { "sq [1 2]", "sq [3]", "sq [1 2]", "sq [4 5 6]", "sq [3]" }) run(input);
+        REQUIRE(show(run("memo-stats sq")) == "[1 4 2 2]"); /* [1 2] hit, [3] was evicted. */
+
+        /* numbers of different kinds aren't the same argument, (* 1.5 2) is the double 3. */
+        REQUIRE(!Ops::isError(run("defmemo (h x) (/ x 2)")));
+        REQUIRE(show(run("h 3")) == "1");
+        REQUIRE(show(run("h (* 1.5 2)")) == "1.5");
+        REQUIRE(show(run("h 3")) == "1");
+        REQUIRE(show(run("memo-stats h")) == "[1 2 2 10000]");
+
+        /* partial applications are the same only if they hold the same arguments. */
+        REQUIRE(!Ops::isError(run("defun (add x y) (+ x y)")));
+        REQUIRE(!Ops::isError(run("defmemo (app f x) (f x)")));
+        REQUIRE(show(run("app (add 1) 0")) == "1");
+        REQUIRE(show(run("app (add 2) 0")) == "2");
+        REQUIRE(show(run("app (add 1) 0")) == "1");
+        REQUIRE(show(run("app (add 0.5) 0")) == "0.5");
+        REQUIRE(show(run("memo-stats app")) == "[1 3 3 10000]");
+
+        /* errors aren't cached. */
+        REQUIRE(!Ops::isError(run("def (inv) (memoize (\\ (x) (/ 1 x)))")));
+        REQUIRE(Ops::isError(run("inv 0")));
+        REQUIRE(Ops::isError(run("inv 0")));
+        REQUIRE(show(run("memo-stats inv")) == "[0 2 0 10000]");
+
+        for (auto input: { "memoize 1", "memoize fib 0", "memo-stats len" }) {
+            INFO(input);
+            REQUIRE(Ops::isError(run(input)));
+        }
+    }
+
+    /* equal values hash alike. */
+    for (auto [x, y]: { std::pair{ "1", "1.0" }, { "[1 [2 \"a\"]]", "[1.0 [2 \"a\"]]" }, { "vec 1 2", "vec 1.0 2" },
+                        { "123456789012345678901234567890", "123456789012345678901234567890" } }) {
+        INFO(x << " " << y);
+        EnvironmentPtr e(new Environment());
+        addBuiltinFunctions(e);
+        ValuePtr a = eval(e, parse(x).right()), b = eval(e, parse(y).right());
+        REQUIRE(equals(a, b));
+        REQUIRE(hash(a) == hash(b));
+    }
+
+    EnvironmentPtr e(new Environment());
+    addBuiltinFunctions(e);
+    REQUIRE(!equals(eval(e, parse("[1 2]").right()), eval(e, parse("[1 3]").right())));
+}
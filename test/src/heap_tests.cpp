@@ -0,0 +1,66 @@
+#include <catch2/catch.hpp>
+
+#include "builtin.h"
+#include "environment.h"
+#include "eval.h"
+#include "heap.h"
+#include "parser.h"
+#include "value.h"
+
+
+TEST_CASE("values are freed once unreachable, closures and partial applications don't leak","[heap-1]") {
+    using namespace Inky::Lisp;
+
+    auto live = []() { auto stats = Heap::stats(); return stats.allocated - stats.freed; };
+
+    Ops::makeInteger(0); /* the shared small integers are allocated on first use. */
+    auto before = live();
+
+    for (auto evaluator: { eval, execute }) {
+        EnvironmentPtr e(new Environment());
+        addBuiltinFunctions(e);
+
+        for (const auto& input: {
+                "defun (add x y) (+ x y)",
+                "def (plusOne) (add 1)",
+                "plusOne 2000",
+                "defun (adder n) (add n)",
+                "(lambda (x y) (* x y)) 3000 2",
+                "def (f) (adder 10)",
+                "f 5",
+                "defun (keep x) ((= g (add x)) (g x))",
+                "keep 3000",
+                "def (f) (adder 20)",
+                "def xs [ (+ 1000 1) (+ 2000 2) ]",
+                "join xs (tail xs)",
+                "defun (fib n)  (if (< n 2) (n) ((+ (fib (- n 2)) (fib (- n 1)))))",
+                "fib 12" }) {
+            auto result = evaluator(e, parse(input).right());
+            INFO(input);
+            REQUIRE(!Ops::isError(result));
+        }
+    }
+
+    REQUIRE(live() == before);
+}
+
+TEST_CASE("collect returns the free blocks to the system","[heap-2]") {
+    using namespace Inky::Lisp;
+
+    {
+        EnvironmentPtr e(new Environment());
+        addBuiltinFunctions(e);
+        eval(e, parse("(+ 100000 (* 2000 2000))").right());
+    }
+    REQUIRE(Heap::stats().pooled > 0);
+
+    auto collections = Heap::stats().collections;
+    Heap::collect();
+    REQUIRE(Heap::stats().pooled == 0);
+    REQUIRE(Heap::stats().collections == collections + 1);
+
+    Heap::setLimit(0);
+    eval(EnvironmentPtr(new Environment()), parse("[1 2 3]").right());
+    REQUIRE(Heap::stats().pooled == 0);
+    Heap::setLimit(4096);
+}
@@ -0,0 +1,89 @@
+#include <catch2/catch.hpp>
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+
+#include "builtin.h"
+#include "environment.h"
+#include "eval.h"
+#include "image.h"
+#include "parser.h"
+#include "value.h"
+#include "test_util.h"
+
+
+TEST_CASE("an environment restored from an image evaluates as the original","[image-1]") {
+    using namespace Inky::Lisp;
+
+    auto path = (std::filesystem::temp_directory_path() / "inky-image-1.img").string();
+
+    EnvironmentPtr original(new Environment());
+    addBuiltinFunctions(original);
+    for (const auto& definition: {
+            "def (nil) []",
+            "defun (add x y) (+ x y)",
+            "def (inc) (add 1)",
+            "defun (compose f g x) (f (g x))",
+            "def (inc2) (compose inc inc)",
+            "defun (sum & xs) (foldl add 0 xs)",
+            "defun (fact n) (if (== n 0) (1) (* n (fact (- n 1))))",
+            "def (xs ys) [1 2.5 \"three\" (four 4)] (list 1 2 3)",
+            "def (e) (error \"saved error\")",
+            "def (local) ((\\ (x) (= (y) (* x 2)) (add y)) 10)",
+            "defmemo (fib n) (if (< n 2) (n) (+ (fib (- n 1)) (fib (- n 2))))",
+            "def (big v) 123456789012345678901234567890 (vec 1.5 2 3)",
+            "def (mp) {\"a\" 1 2 [x y] b \"c\"}" }) {
+        eval(original, parse(definition).right());
+    }
+    REQUIRE(!Ops::isError(saveImage(original, path)));
+
+    EnvironmentPtr restored(new Environment());
+    REQUIRE(!Ops::isError(loadImage(restored, path)));
+
+    for (auto evaluator: { eval, execute }) {
+        for (const auto& input: { "inc2 5", "map inc xs", "xs", "ys", "sum 1 2 3 4", "fact 10", "e", "local 1",
+                                  "head xs", "(compose inc2 (add 10)) 1", "if (== (len ys) 3) (inc 1) (0)",
+                                  "fib 60", "big", "v", "mp", "map-get mp 2" }) {
+            INFO(input);
+            REQUIRE(show(evaluator(restored, parse(input).right())) == show(evaluator(original, parse(input).right())));
+        }
+    }
+
+    /* builtins are re-linked, so the VM recognises the primitives. */
+    REQUIRE(isBuiltin(restored->lookup("+"), builtin_add));
+    /* and functions keep the names the profiler reports them by. */
+    REQUIRE(std::get<LambdaPtr>(restored->lookup("fact")->var)->name == intern("fact"));
+
+    /* a truncated image is an error, never a crash. */
+    std::ifstream in(path, std::ios::binary);
+    std::string image((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    in.close();
+    for (size_t n: { size_t(0), size_t(4), size_t(12), image.size() / 3, image.size() / 2, image.size() - 1 }) {
+        std::ofstream(path, std::ios::binary | std::ios::trunc).write(image.data(), n);
+        EnvironmentPtr e(new Environment());
+        e->insert("add", Ops::makeInteger(42));
+        REQUIRE(Ops::isError(loadImage(e, path)));
+        /* and leaves the environment as it was. */
+        REQUIRE(std::get<long>(e->lookup("add")->var) == 42);
+        REQUIRE(e->lookup("fact") == nullptr);
+    }
+
+    std::remove(path.c_str());
+    REQUIRE(Ops::isError(loadImage(restored, path)));
+
+    /* a builtin that isn't registered by name can't be re-linked. */
+    original->insert("anonymous", Ops::makeBuiltin([](const EnvironmentPtr&, const ValuePtr& v) { return v; }));
+    REQUIRE(Ops::isError(saveImage(original, path)));
+    std::remove(path.c_str());
+
+    /* nor a lambda with more formals than its frame has slots, its arguments would be bound out of bounds. */
+    EnvironmentPtr crafted(new Environment());
+    auto lambda = std::make_shared<Lambda>(Lambda{ parse("x y").right(), parse("+ x y").right(), makeFrame(parse("x").right()), nullptr });
+    crafted->insert("f", Ops::makeFunction(lambda));
+    REQUIRE(!Ops::isError(saveImage(crafted, path)));
+    EnvironmentPtr e(new Environment());
+    REQUIRE(Ops::isError(loadImage(e, path)));
+    REQUIRE(e->lookup("f") == nullptr);
+    std::remove(path.c_str());
+}
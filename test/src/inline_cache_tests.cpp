@@ -0,0 +1,118 @@
+#include <catch2/catch.hpp>
+
+#include "builtin.h"
+#include "environment.h"
+#include "eval.h"
+#include "parser.h"
+#include "value.h"
+#include "test_util.h"
+
+
+TEST_CASE("an inline cache holds a global binding until the global scope changes","[inline-cache-1]") {
+    using namespace Inky::Lisp;
+
+    EnvironmentPtr e(new Environment());
+    Symbol name = intern("cached-name");
+    InlineCache cache;
+
+    REQUIRE(e->lookup(name, cache) == nullptr);
+    e->insert(name, Ops::makeInteger(1));
+    REQUIRE(std::get<long>(e->lookup(name, cache)->var) == 1);
+    REQUIRE(std::get<long>(e->lookup(name, cache)->var) == 1);
+
+    e->insert(intern("another-name"), Ops::makeInteger(2));
+    e->insert(name, Ops::makeInteger(3));
+    REQUIRE(std::get<long>(e->lookup(name, cache)->var) == 3);
+
+    /* a frame between the call site and the global scope is skipped. */
+    EnvironmentPtr frame = makeFrame(parse("(cached-x)").right());
+    frame->setOuterScope(e);
+    REQUIRE(std::get<long>(frame->lookup(name, cache)->var) == 3);
+
+    /* the same cache used with another global scope. */
+    EnvironmentPtr other(new Environment());
+    other->insert(name, Ops::makeInteger(4));
+    REQUIRE(std::get<long>(other->lookup(name, cache)->var) == 4);
+    REQUIRE(std::get<long>(e->lookup(name, cache)->var) == 3);
+}
+
+TEST_CASE("call sites see functions redefined, and rebound by the formals of a caller","[inline-cache-2]") {
+    using namespace Inky::Lisp;
+
+    for (auto evaluator: { eval, execute }) {
+        EnvironmentPtr e(new Environment());
+        addBuiltinFunctions(e);
+        auto run = [&](const char* input) { return show(evaluator(e, parse(input).right())); };
+
+        run("defun (k x) (+ x 1)");
+        run("defun (call-k x) (k x)");
+        REQUIRE(run("call-k 1") == "2");
+        REQUIRE(run("call-k 2") == "3");
+
+        /* redefining k changes the global scope, call-k's cached binding is stale. */
+        run("defun (k x) (* x 10)");
+        REQUIRE(run("call-k 2") == "20");
+        run("def [k] (\\ (x) (- x 1))");
+        REQUIRE(run("call-k 2") == "1");
+
+        /* inky is dynamically scoped, k bound by the formals of a caller is seen by call-k. */
+        run("defun (shadow k) (call-k 5)");
+        REQUIRE(run("shadow (\\ (y) (* y 100))") == "500");
+        REQUIRE(run("call-k 5") == "4");
+
+        /* an unbound name is reported at the call site as before. */
+        run("defun (call-missing x) (missing x)");
+        ValuePtr missing = evaluator(e, parse("call-missing 1").right());
+        REQUIRE(Ops::isError(missing));
+        REQUIRE(std::get<LispErrorPtr>(missing->var)->message == "unbound symbol: missing");
+        run("defun (missing x) (+ x 7)");
+        REQUIRE(run("call-missing 1") == "8");
+    }
+}
+
+TEST_CASE("a form evaluated in two environments uses the bindings of each","[inline-cache-3]") {
+    using namespace Inky::Lisp;
+
+    ValuePtr form = parse("f 2").right();
+    for (auto evaluator: { eval, execute }) {
+        EnvironmentPtr a(new Environment());
+        EnvironmentPtr b(new Environment());
+        addBuiltinFunctions(a);
+        addBuiltinFunctions(b);
+        eval(a, parse("defun (f x) (+ x 1)").right());
+        eval(b, parse("defun (f x) (* x 3)").right());
+
+        for (int k = 0; k < 3; k++) {
+            REQUIRE(std::get<long>(evaluator(a, form)->var) == 3);
+            REQUIRE(std::get<long>(evaluator(b, form)->var) == 6);
+        }
+    }
+}
+
+TEST_CASE("a call site keeps its cache when a lambda of another environment binds the name","[inline-cache-4]") {
+    using namespace Inky::Lisp;
+
+    Symbol name = intern("cached-f");
+    EnvironmentPtr a(new Environment());
+    EnvironmentPtr b(new Environment());
+    addBuiltinFunctions(a);
+    addBuiltinFunctions(b);
+    a->insert(name, Ops::makeInteger(1));
+
+    /* a frame that binds the name without marking it, so the cached path is seen by skipping it. */
+    EnvironmentPtr frame = makeFrame(parse("cached-f").right());
+    frame->setSlot(0, Ops::makeInteger(2));
+    frame->setOuterScope(a);
+    InlineCache cache;
+    REQUIRE(std::get<long>(frame->lookup(name, cache)->var) == 1);
+
+    /* an unrelated lambda binds the name, in another environment. */
+    eval(b, parse("defun (unrelated cached-f) (+ cached-f 1)").right());
+    execute(b, parse("\\ (x) (= [cached-f] x)").right());
+    REQUIRE(std::get<long>(eval(b, parse("unrelated 4").right())->var) == 5);
+    REQUIRE(std::get<long>(frame->lookup(name, cache)->var) == 1);
+
+    /* a lambda of the same environment may rebind it dynamically, so the frames are searched. */
+    REQUIRE(eval(a, parse("\\ [cached-f] [cached-f]").right())->kind == Type::Function);
+    REQUIRE(std::get<long>(frame->lookup(name, cache)->var) == 2);
+}
@@ -0,0 +1,141 @@
+#include <catch2/catch.hpp>
+
+#include <string>
+#include <thread>
+#include <vector>
+#include <fmt/core.h>
+
+#include "interpreter.h"
+#include "value.h"
+#include "test_util.h"
+
+
+namespace {
+    /* Exercises symbols, small and big integers, lists, strings, maps, vectors, closures and memoization. */
+    std::string script(int task) {
+        return fmt::format(
+                "defun (fact n) (if (== n 0) [1] [* n (fact (- n 1))])\n"
+                "defmemo (fib n) (if (< n 2) [n] [+ (fib (- n 1)) (fib (- n 2))])\n"
+                "defun (add x y) (+ x y)\n"
+                "def [task-{0}] {0}\n"
+                "def [m] (map-put {{\"a\" 1 key-{0} 2}} \"task\" task-{0})\n"
+                "def [xs] (map (add task-{0}) [1 2 3 4 5 6 7 8 9 10])\n"
+                "def [v] (vec xs)\n"
+                "list (fact 25) (fib 60) (foldl add 0 xs) (vsum v) (map-get m \"task\") (join \"t\" \"{0}\")",
+                task);
+    }
+}
+
+TEST_CASE("interpreters on different threads share no definitions","[interpreter-1]") {
+    using namespace Inky::Lisp;
+
+    constexpr int threads = 8;
+    constexpr int rounds = 25;
+
+    /* the results expected, computed on this thread. */
+    std::vector<std::string> expected;
+    for (int t = 0; t < threads; t++) {
+        Interpreter interpreter;
+        expected.push_back(show(interpreter.evaluate(script(t))));
+        REQUIRE(!Ops::isError(interpreter.evaluate(script(t))));
+    }
+    REQUIRE(expected[3].find("15511210043330985984000000") != std::string::npos);
+
+    std::vector<std::string> failures[threads];
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++) {
+        workers.emplace_back([t, &expected, &failures]() {
+            for (int r = 0; r < rounds; r++) {
+                Interpreter interpreter(t % 2 ? execute : eval);
+                std::string result = show(interpreter.evaluate(script(t)));
+                if ( result != expected[t] ) failures[t].push_back(result);
+
+                /* each interpreter sees only its own definitions. */
+                if ( interpreter.lookup(fmt::format("task-{}", (t + 1) % threads)) != nullptr ) failures[t].push_back("leaked definition");
+                interpreter.define("own", Ops::makeInteger(t));
+                if ( show(interpreter.evaluate("+ own 1")) != std::to_string(t + 1) ) failures[t].push_back("define");
+            }
+        });
+    }
+    for (auto& w: workers) w.join();
+
+    for (int t = 0; t < threads; t++) {
+        INFO("thread " << t);
+        REQUIRE(failures[t].empty());
+    }
+
+    Interpreter interpreter;
+    REQUIRE(Ops::isError(interpreter.evaluate("(+ 1")));
+    REQUIRE(Ops::isError(interpreter.evaluate("undefined-symbol")));
+    REQUIRE(Ops::isError(interpreter.load("/nonexistent/file.inky")));
+}
+
+TEST_CASE("an interpreter's trace and profile record only its own evaluations","[interpreter-2]") {
+    using namespace Inky::Lisp;
+
+    auto calls = [](const Profiler::Session& profile, const std::string& name) {
+        for (const auto& f: profile.report()) {
+            if ( f.name == name ) return f.calls;
+        }
+        return (uint64_t) 0;
+    };
+
+    const std::string program =
+            "defun (sq x) (* x x)\n"
+            "foldl + 0 (pmap sq [1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 17 18 19 20 21 22 23 24])";
+
+    /* on one thread. */
+    Interpreter a, b;
+    a.trace().setEnabled(true);
+    a.profile().setEnabled(true);
+    REQUIRE(show(b.evaluate(program)) == "4900");
+    REQUIRE(a.trace().steps().empty());
+    REQUIRE(a.profile().report().empty());
+    REQUIRE(!Trace::enabled());
+    REQUIRE(!Profiler::enabled());
+
+    REQUIRE(show(a.evaluate(program)) == "4900");
+    REQUIRE(!a.trace().steps().empty());
+    REQUIRE(calls(a.profile(), "sq") == 24); /* including the calls made by the tasks of pmap. */
+    REQUIRE(b.trace().steps().empty());
+    REQUIRE(b.profile().report().empty());
+    REQUIRE(calls(Profiler::session(), "sq") == 0);
+
+    /* on many, one interpreter toggling its trace and profile while the others evaluate. */
+    constexpr int threads = 8;
+    constexpr int rounds = 25;
+
+    std::vector<std::string> failures[threads];
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++) {
+        workers.emplace_back([t, &program, &calls, &failures]() {
+            Interpreter interpreter(t % 2 ? execute : eval);
+            for (int r = 0; r < rounds; r++) {
+                bool toggling = t == 0;
+                interpreter.trace().setEnabled(toggling);
+                interpreter.profile().setEnabled(toggling);
+
+                if ( show(interpreter.evaluate(program)) != "4900" ) failures[t].push_back("result");
+
+                if ( toggling ) {
+                    if ( interpreter.trace().steps().empty() ) failures[t].push_back("not traced");
+                    if ( calls(interpreter.profile(), "sq") != 24 ) failures[t].push_back("not profiled");
+                    interpreter.trace().setEnabled(false);
+                    interpreter.trace().clear();
+                    interpreter.profile().setEnabled(false);
+                } else {
+                    if ( !interpreter.trace().steps().empty() ) failures[t].push_back("traced");
+                    if ( !interpreter.profile().report().empty() ) failures[t].push_back("profiled");
+                }
+                if ( Trace::enabled() || Profiler::enabled() ) failures[t].push_back("thread's own trace or profile enabled");
+            }
+        });
+    }
+    for (auto& w: workers) w.join();
+
+    for (int t = 0; t < threads; t++) {
+        INFO("thread " << t);
+        REQUIRE(failures[t].empty());
+    }
+    REQUIRE(calls(Profiler::session(), "sq") == 0);
+}
@@ -10,6 +10,8 @@
 
 #include "test_util.h"
 #include "builtin.h"
+#include "parser.h"
+#include "pool.h"
 
 TEST_CASE("builtin list primitives","[basic-list-1]") {
     using namespace Inky::Lisp;
@@ -25,4 +27,163 @@ TEST_CASE("builtin list primitives","[basic-list-1]") {
     };
 
     verifyTestCases(e, tests);
-}
\ No newline at end of file
+}
+TEST_CASE("lists share their cells, tail and join don't copy","[basic-list-2]") {
+    using namespace Inky::Lisp;
+
+    Cells xs;
+    for (long k = 1; k <= 3; k++) xs.push_back(Ops::makeInteger(k));
+
+    /* tail shares the buffer. */
+    Cells ys = xs.drop(1);
+    REQUIRE(ys.size() == 2);
+    REQUIRE(ys.begin() == xs.begin() + 1);
+
+    /* the first list to grow into the unused space of a buffer extends it in place, others copy. */
+    Cells zs = xs;
+    zs.push_back(Ops::makeInteger(4));
+    REQUIRE(zs.begin() == xs.begin());
+    Cells ws = xs;
+    ws.push_back(Ops::makeInteger(5));
+    REQUIRE(ws.begin() != xs.begin());
+    REQUIRE(xs.size() == 3);
+    REQUIRE(std::get<long>(zs[3]->var) == 4L);
+    REQUIRE(std::get<long>(ws[3]->var) == 5L);
+
+    /* joining a short list onto the front of a longer one shares the longer list's cells. */
+    Cells one;
+    one.push_back(Ops::makeInteger(0));
+    Cells rest;
+    for (long k = 3; k >= 1; k--) rest.push_front(Ops::makeInteger(k));
+    Cells joined = Cells::join(one, rest);
+    REQUIRE(joined.size() == 4);
+    REQUIRE(joined.begin() + 1 == rest.begin());
+    REQUIRE(std::get<long>(joined[0]->var) == 0L);
+    REQUIRE(std::get<long>(joined[1]->var) == 1L);
+    REQUIRE(std::get<long>(rest[0]->var) == 1L);
+
+    EnvironmentPtr e(new Environment());
+    addBuiltinFunctions(e);
+
+    for (const auto& definition: {
+            "def (nil) []",
+            "defun (fst xs) ( eval (head xs) )",
+            "defun (range n acc) (if (== n 0) (acc) (range (- n 1) (join (list n) acc)))",
+            "defun (map f xs) ( (if (== xs nil) (nil) (join (list (f (fst xs))) (map f (tail xs)))))",
+            "defun (sum xs acc) (if (== xs nil) (acc) (sum (tail xs) (+ acc (fst xs))))",
+            "def (xs) (range 20000 nil)" }) {
+        REQUIRE(!Ops::isError(execute(e, parse(definition).right())));
+    }
+
+    std::initializer_list<TestCase> tests  = {
+            { "sum xs 0", Type::Integer, 200010000L },
+            { "sum (map (\\ (x) (* 2 x)) xs) 0", Type::Integer, 400020000L },
+            { "sum (join xs xs) 0", Type::Integer, 400020000L },
+            { "sum xs 0", Type::Integer, 200010000L }
+    };
+
+    verifyTestCases(e, tests, execute);
+}
+
+TEST_CASE("native list functions agree with the prelude definitions","[basic-list-3]") {
+    using namespace Inky::Lisp;
+
+    EnvironmentPtr e(new Environment());
+    addBuiltinFunctions(e);
+
+    for (const auto& definition: {
+            "def (nil) []",
+            "defun (plen xs) (if (== xs nil) (0) (+ 1 (plen (tail xs))))",
+            "defun (pfst xs) ( eval (head xs) )",
+            "defun (pdrop n xs) ( if (== n 0) (xs) (pdrop (- n 1) (tail xs)))",
+            "defun (pfoldl f z xs) (if (== xs nil) [z] (pfoldl f (f z (pfst xs)) (tail xs)))",
+            "defun (pmap f xs) ( (if (== xs nil) (nil) (join (list (f (pfst xs))) (pmap f (tail xs)))))",
+            "defun (pfilter f xs) (if (== xs nil) (nil) (join (if (f (pfst xs)) (head xs) (nil)) (pfilter f (tail xs))))",
+            "defun (add x y) (+ x y)",
+            "defun (odd x) (== (- x (* 2 (/ x 2))) 1)",
+            "def xs [1 2 3 4 5 (+ 3 3)]" }) {
+        REQUIRE(!Ops::isError(eval(e, parse(definition).right())));
+    }
+
+    for (const auto& [native, lisp]: std::initializer_list<std::pair<const char*, const char*>> {
+            { "len xs", "plen xs" },
+            { "len nil", "plen nil" },
+            { "fst xs", "pfst xs" },
+            { "drop 2 xs", "pdrop 2 xs" },
+            { "drop 6 xs", "pdrop 6 xs" },
+            { "foldl add 0 xs", "pfoldl add 0 xs" },
+            { "foldl + 0.5 xs", "pfoldl + 0.5 xs" },
+            { "foldl add 0 nil", "pfoldl add 0 nil" },
+            { "map (add 10) xs", "pmap (add 10) xs" },
+            { "map add xs", "pmap add xs" },
+            { "map (add 1) nil", "pmap (add 1) nil" },
+            { "filter odd xs", "pfilter odd xs" },
+            { "filter (\\ (x) (> x 10)) xs", "pfilter (\\ (x) (> x 10)) xs" },
+            { "map (\\ (x) (x)) [1 [2 3] 4]", "pmap (\\ (x) (x)) [1 [2 3] 4]" } }) {
+        INFO(native);
+        REQUIRE(show(eval(e, parse(native).right())) == show(eval(e, parse(lisp).right())));
+        REQUIRE(show(execute(e, parse(native).right())) == show(eval(e, parse(lisp).right())));
+    }
+
+    REQUIRE(Ops::isError(eval(e, parse("fst nil").right())));
+    REQUIRE(Ops::isError(eval(e, parse("drop 7 xs").right())));
+    REQUIRE(Ops::isError(eval(e, parse("map 1 xs").right())));
+    REQUIRE(Ops::isError(eval(e, parse("map (\\ (x) (error \"fail\")) xs").right())));
+    REQUIRE(Ops::isError(eval(e, parse("filter add xs").right())));
+
+    /* no recursion, so the tree walking evaluator handles long lists. */
+    REQUIRE(!Ops::isError(eval(e, parse("defun (range n acc) (if (== n 0) (acc) (range (- n 1) (join (list n) acc)))").right())));
+    std::initializer_list<TestCase> tests  = {
+            { "len (map (add 1) (range 20000 nil))", Type::Integer, 20000L },
+            { "foldl add 0 (filter odd (range 20000 nil))", Type::Integer, 100000000L }
+    };
+    verifyTestCases(e, tests);
+}
+
+TEST_CASE("parallel list functions agree with map, filter & foldl","[basic-list-4]") {
+    using namespace Inky::Lisp;
+
+    ThreadPool::setWorkers(3);
+    EnvironmentPtr e(new Environment());
+    addBuiltinFunctions(e);
+
+    for (const auto& definition: {
+            "def (nil) []",
+            "defun (add x y) (+ x y)",
+            "defun (odd x) (== (- x (* 2 (/ x 2))) 1)",
+            "defun (range n acc) (if (== n 0) (acc) (range (- n 1) (join (list n) acc)))",
+            "def xs [1 2 3 4 5 (+ 3 3)]",
+            "def ys (range 2000 nil)" }) {
+        REQUIRE(!Ops::isError(eval(e, parse(definition).right())));
+    }
+
+    for (const auto& [parallel, sequential]: std::initializer_list<std::pair<const char*, const char*>> {
+            { "pmap (add 10) xs", "map (add 10) xs" },
+            { "pmap (add 1) nil", "map (add 1) nil" },
+            { "pmap (\\ (x) (* x x)) ys", "map (\\ (x) (* x x)) ys" },
+            { "pfilter odd xs", "filter odd xs" },
+            { "pfilter odd ys", "filter odd ys" },
+            { "pfilter odd nil", "filter odd nil" },
+            { "preduce add 0 xs", "foldl add 0 xs" },
+            { "preduce add 0 ys", "foldl add 0 ys" },
+            { "preduce + 0.5 xs", "foldl + 0.5 xs" },
+            { "preduce add 7 nil", "foldl add 7 nil" },
+            { "pmap (\\ (x) (preduce add 0 (range x nil))) [10 20 30 40 50]",
+              "map (\\ (x) (foldl add 0 (range x nil))) [10 20 30 40 50]" } }) {
+        INFO(parallel);
+        REQUIRE(show(eval(e, parse(parallel).right())) == show(eval(e, parse(sequential).right())));
+        REQUIRE(show(execute(e, parse(parallel).right())) == show(eval(e, parse(sequential).right())));
+    }
+
+    REQUIRE(Ops::isError(eval(e, parse("pmap 1 xs").right())));
+    REQUIRE(Ops::isError(eval(e, parse("pfilter add xs").right())));
+    REQUIRE(Ops::isError(eval(e, parse("preduce add xs").right())));
+
+    /* the error reported is that of the first failing element. */
+    ValuePtr error = eval(e, parse("pmap (\\ (x) (if (== x 1001) (error \"first\") (if (> x 1001) (error \"later\") (x)))) ys").right());
+    REQUIRE(Ops::isError(error));
+    REQUIRE(show(error) == show(Ops::makeError("first")));
+
+    ThreadPool::setWorkers(0); /* back to the default. */
+    REQUIRE(show(eval(e, parse("pmap (add 1) xs").right())) == show(eval(e, parse("map (add 1) xs").right())));
+}
@@ -0,0 +1,77 @@
+#include <catch2/catch.hpp>
+
+#include <unordered_map>
+
+#include "builtin.h"
+#include "environment.h"
+#include "eval.h"
+#include "map.h"
+#include "parser.h"
+#include "value.h"
+#include "test_util.h"
+
+
+TEST_CASE("map literals and builtins, keys compare as == compares them","[map-1]") {
+    using namespace Inky::Lisp;
+
+    EnvironmentPtr e(new Environment());
+    addBuiltinFunctions(e);
+    eval(e, parse("def [m] {\"b\" 2 \"a\" (+ 1 0) 3 three}").right());
+
+    struct { const char* expression; const char* result; } tests[] = {
+            { "m", "{\"b\" 2 \"a\" (+ 1 0) 3 three}" },
+            { "{}", "{}" },
+            { "map-get m \"b\"", "2" },
+            { "map-get m 3.0", "three" },
+            { "map-get m \"c\" 0", "0" },
+            { "map-keys m", "[\"b\" \"a\" 3]" },
+            { "map-put m \"c\" (* 2 3) \"b\" 20", "{\"b\" 20 \"a\" (+ 1 0) 3 three \"c\" 6}" },
+            { "map-del m \"b\" \"missing\"", "{\"a\" (+ 1 0) 3 three}" },
+            { "m", "{\"b\" 2 \"a\" (+ 1 0) 3 three}" },
+            { "map-keys (map-put (map-del m \"a\") \"a\" 1)", "[\"b\" 3 \"a\"]" },
+            { "== {1 \"x\" 2 \"y\"} {2.0 \"y\" 1 \"x\"}", "1" },
+            { "== {1 \"x\"} {1 \"y\"}", "0" }
+    };
+
+    for (auto evaluator: { eval, execute }) {
+        for (const auto& test: tests) {
+            INFO(test.expression);
+            REQUIRE(show(evaluator(e, parse(test.expression).right())) == test.result);
+        }
+    }
+
+    for (const auto& input: { "map-get m \"c\"", "map-get [1] 1", "map-put m \"c\"", "map-put m [1] 1", "map-keys m 1" }) {
+        INFO(input);
+        REQUIRE(Ops::isError(eval(e, parse(input).right())));
+        REQUIRE(Ops::isError(execute(e, parse(input).right())));
+    }
+
+    for (const auto& input: { "{[x] 1}", "{\"a\"}", "{\"a\" 1" }) {
+        INFO(input);
+        REQUIRE(!parse(input));
+    }
+}
+
+TEST_CASE("the hash map agrees with std::unordered_map through puts and deletes","[map-2]") {
+    using namespace Inky::Lisp;
+
+    HashMap m;
+    std::unordered_map<long, long> expected;
+    for (long k = 0; k < 20000; k++) {
+        long key = (k * 7919) % 5003;
+        if ( k % 3 == 2 ) {
+            REQUIRE(m.erase(Ops::makeInteger(key)) == (expected.erase(key) == 1));
+        } else {
+            m.put(Ops::makeInteger(key), Ops::makeInteger(k));
+            expected[key] = k;
+        }
+        REQUIRE(m.size() == expected.size());
+    }
+
+    for (long key = 0; key < 5003; key++) {
+        ValuePtr v = m.find(Ops::makeDouble(key)); /* 1.0 finds 1. */
+        auto i = expected.find(key);
+        REQUIRE((v != nullptr) == (i != expected.end()));
+        if ( v ) REQUIRE(std::get<long>(v->var) == i->second);
+    }
+}
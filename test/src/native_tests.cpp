@@ -0,0 +1,68 @@
+#include <catch2/catch.hpp>
+
+#include <algorithm>
+#include <string>
+
+#include "interpreter.h"
+#include "native.h"
+#include "value.h"
+#include "test_util.h"
+
+
+TEST_CASE("native functions convert their arguments and results by signature","[native-1]") {
+    using namespace Inky::Lisp;
+
+    for (auto evaluator: { eval, execute }) {
+        Interpreter lisp(evaluator);
+        int called = 0;
+        lisp.registerNative("clamp", +[](double x, double lo, double hi) { return std::min(std::max(x, lo), hi); });
+        lisp.registerNative("repeat", [](const std::string& s, int n) {
+            std::string r;
+            for (int k = 0; k < n; k++) r += s;
+            return r;
+        });
+        lisp.registerNative("even", [](long n) { return n % 2 == 0; });
+        lisp.registerNative("count", [&called](long n) { called += n; });
+        lisp.registerNative("name-of", [](Symbol s) { return symbolName(s); });
+        lisp.registerNative("identity", [](ValuePtr v) { return v; });
+        lisp.registerNative("checked", [](long n) { return n < 0 ? Ops::makeError("negative.") : Ops::makeInteger(n); });
+
+        struct { const char* expression; const char* result; } tests[] = {
+                { "clamp 15 0 10", "10" },
+                { "clamp 0.5 0 1", "0.5" },
+                { "repeat \"ab\" 3", "\"ababab\"" },
+                { "even 4", "1" },
+                { "map even [1 2 3]", "[0 1 0]" },
+                { "identity [1 2]", "[1 2]" },
+                { "checked 2", "2" }
+        };
+        for (const auto& test: tests) {
+            INFO(test.expression);
+            REQUIRE(show(lisp.evaluate(test.expression)) == test.result);
+        }
+
+        /* a symbol argument, as a builtin called from C++ receives it. */
+        ExpressionPtr args(new Expression());
+        args->insert(Ops::makeSymbol("x"));
+        ValuePtr name = std::get<BuiltinFunction>(lisp.lookup("name-of")->var)(lisp.environment(), Ops::makeSExpression(args));
+        REQUIRE(show(name) == "\"x\"");
+
+        REQUIRE(Ops::isEmptyExpression(lisp.evaluate("count 2")));
+        REQUIRE(Ops::isEmptyExpression(lisp.evaluate("count 3")));
+        REQUIRE(called == 5);
+
+        struct { const char* expression; const char* error; } errors[] = {
+                { "clamp 1 2", "clamp, expects 3 arguments, received 2." },
+                { "clamp 1 \"a\" 2", "clamp, argument 2 must be <double>, received <string>." },
+                { "repeat \"a\" 3000000000", "repeat, argument 2 must be <integer>, received <integer>." },
+                { "even 1.5", "even, argument 1 must be <integer>, received <double>." },
+                { "checked -1", "negative." }
+        };
+        for (const auto& test: errors) {
+            INFO(test.expression);
+            ValuePtr result = lisp.evaluate(test.expression);
+            REQUIRE(Ops::isError(result));
+            REQUIRE(std::get<LispErrorPtr>(result->var)->message == test.error);
+        }
+    }
+}
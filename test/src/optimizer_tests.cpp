@@ -0,0 +1,139 @@
+#include <catch2/catch.hpp>
+
+#include "builtin.h"
+#include "environment.h"
+#include "eval.h"
+#include "interpreter.h"
+#include "optimizer.h"
+#include "parser.h"
+#include "value.h"
+#include "test_util.h"
+
+
+TEST_CASE("the optimizer folds constants, removes branches and inlines small lambdas","[optimizer-1]") {
+    using namespace Inky::Lisp;
+
+    EnvironmentPtr e(new Environment());
+    addBuiltinFunctions(e);
+    eval(e, parse("defun (sq x) (* x x)").right());
+    eval(e, parse("defun (limit x) (if (> x (* 60 60 24)) [* 60 60 24] [x])").right());
+    eval(e, parse("defun (fact n) (if (== n 0) [1] [* n (fact (- n 1))])").right());
+    eval(e, parse("defun (twice x) (sq (sq x))").right());
+
+    auto optimizedForm = [&](const char* input) { return show(optimized(optimize(e, parse(input).right()))); };
+
+    struct { const char* input; const char* optimized; } tests[] = {
+            { "* 60 60 24", "86400" },
+            { "(+ 1 (* 2 3))", "7" },
+            { "< 1.5 2", "1" },
+            { "min 3 (max 1 2)", "2" },
+            { "if (> 2 1) [+ x 1] [y]", "(+ x 1)" },
+            { "if (< 2 1) [+ x 1] [y]", "y" },
+            { "if (== x 1) [* 2 2] [+ 1 1]", "(if (== x 1) 4 2)" },
+            { "sq 7", "49" },
+            { "sq y", "(* y y)" },
+            { "+ 1 (sq 3)", "10" },
+            { "limit y", "(if (> y 86400) 86400 y)" },
+            { "/ 1 0", "(/ 1 0)" },                             /* an error is left to happen when evaluated. */
+            { "fact 5", "(fact 5)" },                           /* recursive. */
+            { "twice 2", "(twice 2)" },                         /* calls a lambda. */
+            { "sq (+ y 1)", "(sq (+ y 1))" },                   /* the argument would be evaluated twice. */
+            { "list [+ 1 2]", "(list [+ 1 2])" },               /* data. */
+            { "\\ (+) (+ 1 2)", "(\\ (+) (+ 1 2))" },           /* rebinds a builtin. */
+            { "(defun (sq x) (+ x x)) (sq 2)", "((defun (sq x) (+ x x)) (sq 2))" }
+    };
+
+    for (const auto& test: tests) {
+        INFO(test.input);
+        REQUIRE(optimizedForm(test.input) == test.optimized);
+    }
+
+    /* a body is optimized when its lambda is defined. */
+    auto f = eval(e, optimize(e, parse("\\ (y) (if (> 2 1) [+ y (sq 3)] [0])").right()));
+    REQUIRE(show(optimized(std::get<LambdaPtr>(f->var)->body)) == "(+ y 9)");
+
+    /* names that may be rebound by the formals of a lambda, dynamically, are left alone. */
+    eval(e, parse("defun (apply-f f x) (f x)").right());
+    eval(e, parse("defun (f x) (* x 2)").right());
+    REQUIRE(optimizedForm("f 3") == "(f 3)");
+
+    /* a builtin is folded by the function it is bound to. */
+    eval(e, parse("def [min] max").right());
+    REQUIRE(optimizedForm("min 1 2") == "2");
+}
+
+TEST_CASE("optimized forms evaluate as they would unoptimized","[optimizer-2]") {
+    using namespace Inky::Lisp;
+
+    const char* forms[] = {
+            "defun (sq x) (* x x)",
+            "defun (seconds d) (* d 60 60 24)",
+            "defun (rule x) (if (> x (seconds 1)) [- x (* 60 60 24)] [+ x (/ (* 24 60) 4)])",
+            "defun (fact n) (if (== n 0) [1] [* n (fact (- n 1))])",
+            "defun (add x y) (+ x y)",
+            "def [xs] (list 1 2 3 (* 2 2) 5)",
+            "def [k] (if (< 1 2) [100000] [0])",
+            "foldl (\\ (acc x) (+ acc (rule (* x k)))) 0 xs",
+            "map sq xs",
+            "map (add (sq 3)) [1 2 3]",
+            "list (fact 20) (sq 1.5) (sq k) (add (sq 2) (* 3 3))",
+            "list [+ 1 2] (head [(* 2 3) 4]) (eval (head [(* 2 3) 4]))",
+            "if (> (sq 2) 3) [\"yes\"] [\"no\"]",
+            "sq unbound",
+            "/ 10 (- 5 5)",
+            "= [sq] (\\ (x) (+ x x))",
+            "sq 4",
+            "def [+] -",
+            "+ 10 4"
+    };
+
+    for (auto evaluator: { eval, execute }) {
+        Interpreter plain(evaluator);
+        Interpreter optimizing(evaluator == eval ? evalOptimized : executeOptimized);
+        for (const char* form: forms) {
+            INFO(form);
+            ValuePtr expected = plain.evaluate(form);
+            ValuePtr result = optimizing.evaluate(form);
+            if ( expected->kind == Type::Function ) REQUIRE(result->kind == Type::Function); /* its body is optimized. */
+            else REQUIRE(show(result) == show(expected));
+        }
+    }
+}
+
+TEST_CASE("an optimized function sees the functions it inlined redefined","[optimizer-3]") {
+    using namespace Inky::Lisp;
+
+    for (auto evaluator: { evalOptimized, executeOptimized }) {
+        EnvironmentPtr e(new Environment());
+        addBuiltinFunctions(e);
+        auto run = [&](const char* input) { return show(evaluator(e, parse(input).right())); };
+
+        run("defun (sq x) (* x x)");
+        run("defun (f y) (sq y)");
+        REQUIRE(show(optimized(std::get<LambdaPtr>(e->lookup("f")->var)->body)) == "(* y y)");
+        REQUIRE(run("f 3") == "9");
+        run("defun (sq x) (+ x x)");
+        REQUIRE(run("f 3") == "6");
+
+        /* a builtin that was folded. */
+        run("defun (g x) (+ x (* 2 3))");
+        REQUIRE(run("g 1") == "7");
+        run("def [*] +");
+        REQUIRE(run("g 1") == "6");
+        run("def [*] (\\ (x y) 0)");
+        REQUIRE(run("g 1") == "1");
+
+        /* redefined part way through evaluating a form. */
+        run("defun (h x) (+ x x)");
+        run("defun (redefine-h x) (def [h] (\\ (y) (- y 1)))");
+        REQUIRE(run("list (h 3) (redefine-h 0) (h 3)") == "[6 () 2]");
+
+        /* rebound by the formals of a lambda defined later, inky is dynamically scoped. */
+        run("defun (k x) (- x 1)");
+        run("defun (call-k y) (k y)");
+        REQUIRE(run("call-k 5") == "4");
+        run("defun (shadow k) (call-k 5)");
+        REQUIRE(run("shadow (\\ (y) (+ y 100))") == "105");
+        REQUIRE(run("call-k 5") == "4");
+    }
+}
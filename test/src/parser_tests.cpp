@@ -0,0 +1,86 @@
+#include <catch2/catch.hpp>
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+
+#include "builtin.h"
+#include "environment.h"
+#include "eval.h"
+#include "parser.h"
+#include "source.h"
+#include "value.h"
+#include "test_util.h"
+
+
+TEST_CASE("a source is parsed into its forms, one per line unless brackets span lines","[parser-1]") {
+    using namespace Inky::Lisp;
+
+    auto forms = parseForms("; comment\n"
+                            "def (x) 1\n"
+                            "\n"
+                            "  (defun (f a b)   ; trailing comment\n"
+                            "     (+ a b))\n"
+                            "def (s) \"a ; b\" [1\n"
+                            "2]");
+    REQUIRE(forms.isRight());
+    ExpressionPtr xs = std::get<ExpressionPtr>(forms.right()->var);
+    REQUIRE(xs->cells.size() == 3);
+    REQUIRE(show(xs->cells[0]) == "(def (x) 1)");
+    REQUIRE(show(xs->cells[1]) == "((defun (f a b) (+ a b)))");
+    REQUIRE(show(xs->cells[2]) == "(def (s) \"a ; b\" [1 2])");
+
+    /* the input needn't be null terminated. */
+    std::string_view text = "def (y) 12345";
+    REQUIRE(show(parse(text.substr(0, 10)).right()) == "(def (y) 12)");
+    REQUIRE(show(parseForms(text.substr(0, 9)).right()) == "[(def (y) 1)]");
+
+    REQUIRE(parseForms("").isRight());
+    REQUIRE(parseForms("def (x) (1\n2").isLeft());
+    REQUIRE(parseForms("def (x) \"abc").isLeft());
+    REQUIRE(parse("\"abc").isLeft());
+}
+
+TEST_CASE("load evaluates the forms of a file","[parser-2]") {
+    using namespace Inky::Lisp;
+
+    auto path = (std::filesystem::temp_directory_path() / "inky-parser-2.lsp").string();
+    {
+        std::ofstream out(path);
+        out << "def (nil) []\n"
+               "(defun (sq x)\n"
+               "    (* x x))\n"
+               "def (ys) (map sq [1 2 3])\n"
+               "foldl + 0 ys\n";
+    }
+
+    for (auto evaluator: { eval, execute }) {
+        EnvironmentPtr e(new Environment());
+        addBuiltinFunctions(e);
+
+        ValuePtr result = loadFile(e, path, evaluator);
+        REQUIRE(result->kind == Type::Integer);
+        REQUIRE(std::get<long>(result->var) == 14);
+        REQUIRE(e->lookup("sq") != nullptr);
+
+        result = evaluator(e, parse("load \"" + path + "\"").right());
+        REQUIRE(result->kind == Type::Integer);
+        REQUIRE(std::get<long>(result->var) == 14);
+
+        REQUIRE(Ops::isError(evaluator(e, parse("load \"/nonexistent/inky.lsp\"").right())));
+        REQUIRE(Ops::isError(evaluator(e, parse("load 1").right())));
+    }
+
+    {
+        std::ofstream out(path);
+        out << "def (a) 1\n"
+               "def (b) (+ a\n";
+    }
+    EnvironmentPtr e(new Environment());
+    addBuiltinFunctions(e);
+    ValuePtr error = loadFile(e, path, eval);
+    REQUIRE(Ops::isError(error));
+    REQUIRE(std::get<LispErrorPtr>(error->var)->message.find(path + ":2:") == 0);
+
+    std::remove(path.c_str());
+}
@@ -0,0 +1,63 @@
+#include <catch2/catch.hpp>
+
+#include <string>
+
+#include "builtin.h"
+#include "environment.h"
+#include "eval.h"
+#include "parser.h"
+#include "profiler.h"
+#include "value.h"
+
+
+TEST_CASE("the profiler counts calls of named functions, and their paths","[profiler-1]") {
+    using namespace Inky::Lisp;
+
+    auto calls = [](const std::string& name) {
+        for (const auto& f: Profiler::report()) {
+            if ( f.name == name ) return f.calls;
+        }
+        return (uint64_t) 0;
+    };
+
+    EnvironmentPtr e(new Environment());
+    addBuiltinFunctions(e);
+    eval(e, parse("defun (g x) (+ x 1)").right());
+    eval(e, parse("defun (f n) (if (== n 0) [0] [+ (g n) (f (- n 1))])").right());
+    eval(e, parse("def [h] (lambda [x] [g x])").right());
+    eval(e, parse("defun (loop n) (if (== n 0) [0] [loop (- n 1)])").right());
+
+    for (auto evaluator: { eval, execute }) {
+        Profiler::setEnabled(true);
+        REQUIRE(std::get<long>(evaluator(e, parse("f 10").right())->var) == 65);
+        REQUIRE(std::get<long>(evaluator(e, parse("h 1").right())->var) == 2);
+        REQUIRE(std::get<long>(evaluator(e, parse("loop 1000").right())->var) == 0);
+        REQUIRE(Ops::isError(evaluator(e, parse("f [x]").right())));
+        Profiler::setEnabled(false);
+
+        REQUIRE(calls("f") == 12);
+        REQUIRE(calls("g") == 12); /* f [x] fails in g. */
+        REQUIRE(calls("h") == 1);
+        REQUIRE(calls("loop") == 1001);
+
+        /* time is recorded in microseconds, so a path may be too fast to appear, but not a wrong one. */
+        std::string folded = Profiler::folded();
+        REQUIRE(folded.find("f;f") == std::string::npos);
+        REQUIRE(folded.find("g;f") == std::string::npos);
+    }
+
+    /* a memoized function is profiled as the cache lookup, and the calls it misses. */
+    eval(e, parse("defmemo (m x) (+ x 1)").right());
+    Profiler::setEnabled(true);
+    eval(e, parse("list (m 1) (m 1) (m 2)").right());
+    Profiler::setEnabled(false);
+    REQUIRE(calls("m (memoized)") == 3);
+    REQUIRE(calls("m") == 2);
+
+    /* nothing is recorded while disabled. */
+    eval(e, parse("f 10").right());
+    REQUIRE(calls("f") == 0);
+    Profiler::setEnabled(true);
+    Profiler::setEnabled(false);
+    REQUIRE(Profiler::report().empty());
+}
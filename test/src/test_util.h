@@ -1,10 +1,12 @@
 #pragma once
 
 #include <initializer_list>
+#include <string>
 #include <variant>
 
 #include "value.h"
 #include "environment.h"
+#include "eval.h"
 
 using namespace Inky::Lisp;
 
@@ -14,4 +16,10 @@ using namespace Inky::Lisp;
         std::variant<long, double> result;   /* variant holding the expected result. */
     };
 
-    void verifyTestCases(EnvironmentPtr e, std::initializer_list<TestCase> &tests);
+    /* Evaluation entry point under test, eval (tree walking) or execute (bytecode VM). */
+    typedef ValuePtr (*Evaluator)(EnvironmentPtr, ValuePtr);
+
+    void verifyTestCases(EnvironmentPtr e, std::initializer_list<TestCase> &tests, Evaluator evaluator = eval);
+
+    /* A value as it is printed. */
+    std::string show(ValuePtr v);
@@ -1,3 +1,4 @@
+#include <sstream>
 #include <catch2/catch.hpp>
 #include "test_util.h"
 
@@ -7,10 +8,10 @@
 using namespace Inky::Lisp;
 
 
-void verifyTestCases(Inky::Lisp::EnvironmentPtr e, std::initializer_list<TestCase> &tests) {
+void verifyTestCases(Inky::Lisp::EnvironmentPtr e, std::initializer_list<TestCase> &tests, Evaluator evaluator) {
     for (const auto &test: tests) {
         REQUIRE(parse(test.expression).isRight());
-        auto result = eval(e, parse(test.expression).right());
+        auto result = evaluator(e, parse(test.expression).right());
         REQUIRE(!Ops::isError(result));
             REQUIRE(Ops::isNumeric(result));
             REQUIRE(result->kind == test.kind);
@@ -22,3 +23,8 @@ void verifyTestCases(Inky::Lisp::EnvironmentPtr e, std::initializer_list<TestCas
     }
 }
 
+std::string show(ValuePtr v) {
+    std::ostringstream os;
+    os << v;
+    return os.str();
+}
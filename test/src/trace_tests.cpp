@@ -0,0 +1,68 @@
+#include <catch2/catch.hpp>
+
+#include <algorithm>
+#include <sstream>
+
+#include "builtin.h"
+#include "environment.h"
+#include "eval.h"
+#include "parser.h"
+#include "trace.h"
+#include "value.h"
+
+
+TEST_CASE("the trace holds the last steps of an evaluation, in order","[trace-1]") {
+    using namespace Inky::Lisp;
+
+    auto show = [](const ExpressionPtr& form) { std::ostringstream os; os << "(" << form << ")"; return os.str(); };
+
+    EnvironmentPtr e(new Environment());
+    addBuiltinFunctions(e);
+    eval(e, parse("defun (f n) (if (== n 0) [undefined] [f (- n 1)])").right());
+
+    Trace::clear();
+    eval(e, parse("f 1").right());
+    REQUIRE(Trace::steps().empty()); /* disabled. */
+
+    Trace::setEnabled(true);
+    REQUIRE(Ops::isError(eval(e, parse("f 1").right())));
+    std::vector<Trace::Step> steps = Trace::steps();
+    REQUIRE(steps.size() == 6);
+    REQUIRE(show(steps[0].form) == "(f 1)");
+    REQUIRE(steps[0].tail);
+    REQUIRE(show(steps[1].form) == "(== n 0)");
+    REQUIRE(steps[1].result == Type::Integer);
+    REQUIRE(steps[1].depth == 2);  /* the frame of f and the global scope. */
+    REQUIRE(show(steps[3].form) == "(f (- n 1))");
+    REQUIRE(steps[3].tail);
+    REQUIRE(show(steps[5].form) == "(f 1)");
+    REQUIRE(steps[5].result == Type::Error);
+    REQUIRE(steps[5].depth == 1);
+
+    /* callers that aren't shadowed stay on the chain, each adds a scope. */
+    eval(e, parse("defun (g x) (h 1)").right());
+    eval(e, parse("defun (h y) (+ (* x y) 1)").right());
+    eval(e, parse("g 1").right());
+    std::vector<Trace::Step> nested = Trace::steps();
+    auto product = std::find_if(nested.begin(), nested.end(), [&](const auto& step) { return show(step.form) == "(* x y)"; });
+    REQUIRE(product != nested.end());
+    REQUIRE(product->depth == 3);
+    for (size_t k = 1; k < steps.size(); k++) REQUIRE(steps[k].time >= steps[k-1].time);
+
+    /* the ring holds the last 'capacity' steps. */
+    eval(e, parse("f 2000").right());
+    steps = Trace::steps();
+    REQUIRE(steps.size() == Trace::capacity);
+    REQUIRE(show(steps.back().form) == "(f 2000)");
+    REQUIRE(steps.back().result == Type::Error);
+
+    std::ostringstream dump;
+    Trace::dump(dump, 2);
+    std::string text = dump.str();
+    REQUIRE(text.find("(f 2000)") != std::string::npos);
+    REQUIRE(std::count(text.begin(), text.end(), '\n') == 2);
+
+    Trace::setEnabled(false);
+    Trace::clear();
+    REQUIRE(Trace::steps().empty());
+}
@@ -0,0 +1,115 @@
+#include <catch2/catch.hpp>
+
+#include <vector>
+
+#include "builtin.h"
+#include "environment.h"
+#include "eval.h"
+#include "parser.h"
+#include "value.h"
+#include "vector.h"
+#include "test_util.h"
+
+
+TEST_CASE("vector builtins, results agree with the list builtins and errors are values","[vector-1]") {
+    using namespace Inky::Lisp;
+
+    EnvironmentPtr e(new Environment());
+    addBuiltinFunctions(e);
+    eval(e, parse("def [xs] (vec 1 2 3 4 5 6 7 8 9 10 11)").right());
+    eval(e, parse("def [ys] (vec [0.5 1.5 -2 4 1 1 1 1 1 1 1])").right());
+
+    struct { const char* expression; const char* result; } tests[] = {
+            { "xs", "#[1 2 3 4 5 6 7 8 9 10 11]" },
+            { "vsum xs", "66" },
+            { "vsum ys", "11" },
+            { "vsum (vec [])", "0" },
+            { "vsum (vec 9223372036854775807 9223372036854775807 -1)", "18446744073709551613" },
+            { "vsum (vec -9223372036854775808 -9223372036854775808 -9223372036854775808 -9223372036854775808 -1)", "-36893488147419103233" },
+            { "vdot xs xs", "506" },
+            { "vdot xs ys", "69.5" },
+            { "vdot (vec 4294967296 1) (vec 4294967296 1)", "18446744073709551617" },
+            { "vmin ys", "-2" },
+            { "vmax xs", "11" },
+            { "vmin (vec 5 4 3 2 1 0 -1 -2 -3)", "-3" },
+            { "v+ xs xs", "#[2 4 6 8 10 12 14 16 18 20 22]" },
+            { "v* (vec 1 2 3) (vec 0.5 0.5 0.5)", "#[0.5 1 1.5]" },
+            { "vmap (\\ [x] [* 2 x]) (vec 1 2 3)", "#[2 4 6]" },
+            { "vmap min (vec 1 2 3)", "#[1 2 3]" },
+            { "vmap (\\ [x] [* x 0.5]) (vec 1 2 3)", "#[0.5 1 1.5]" },
+            { "vlist (vec 1 2.5)", "[1 2.5]" },
+            { "== (vec 1 2) (vec 1.0 2.0)", "1" },
+            { "== (vec 1 2) (vec 1 2 3)", "0" }
+    };
+
+    for (auto evaluator: { eval, execute }) {
+        for (const auto& test: tests) {
+            INFO(test.expression);
+            REQUIRE(show(evaluator(e, parse(test.expression).right())) == test.result);
+        }
+    }
+
+    for (const auto& input: { "vec 1 [2]", "vsum [1 2]", "vdot xs (vec 1)", "vmin (vec [])", "v+ (vec 9223372036854775807) (vec 1)",
+                              "v* (vec 4294967296) (vec 4294967296)", "vmap (\\ [x] [list x]) xs" }) {
+        INFO(input);
+        REQUIRE(Ops::isError(eval(e, parse(input).right())));
+        REQUIRE(Ops::isError(execute(e, parse(input).right())));
+    }
+}
+
+TEST_CASE("the vector kernels give the same results at each level","[vector-2]") {
+    using namespace Inky::Lisp;
+
+    std::vector<double> x, y;
+    std::vector<long> u, v;
+    for (long k = 0; k < 1003; k++) {
+        x.push_back(1.0 / (k + 1));
+        y.push_back(k % 7 - 3.25);
+        u.push_back(k * 2654435761L * (k % 2 ? 1 : -1));
+        v.push_back(k - 500);
+    }
+
+    Simd::Level original = Simd::level();
+    std::vector<Simd::Level> levels;
+    for (auto level: { Simd::Level::Scalar, Simd::Level::SSE2, Simd::Level::AVX2 }) {
+        if ( Simd::supported(level) ) levels.push_back(level);
+    }
+
+    /* every length up to a few blocks, for the remainders. */
+    for (size_t n = 1; n < 20; n++) {
+        REQUIRE(Simd::setLevel(Simd::Level::Scalar));
+        double sum = Simd::sum(x.data(), n), dot = Simd::dot(x.data(), y.data(), n);
+        double lo = Simd::min(y.data(), n), hi = Simd::max(y.data(), n);
+        Simd::LongSum total = Simd::sum(u.data(), n);
+        long lmin = Simd::min(u.data(), n), lmax = Simd::max(u.data(), n);
+        std::vector<double> r1(n), r2(n);
+        std::vector<long> s1(n), s2(n);
+        Simd::add(x.data(), y.data(), r1.data(), n);
+        REQUIRE(Simd::add(u.data(), v.data(), s1.data(), n));
+
+        for (auto level: levels) {
+            INFO(Simd::name(level) << " " << n);
+            REQUIRE(Simd::setLevel(level));
+            REQUIRE(Simd::sum(x.data(), n) == sum);
+            REQUIRE(Simd::dot(x.data(), y.data(), n) == dot);
+            REQUIRE(Simd::min(y.data(), n) == lo);
+            REQUIRE(Simd::max(y.data(), n) == hi);
+            Simd::LongSum s = Simd::sum(u.data(), n);
+            REQUIRE((s.high == total.high && s.low == total.low));
+            REQUIRE(Simd::min(u.data(), n) == lmin);
+            REQUIRE(Simd::max(u.data(), n) == lmax);
+            Simd::add(x.data(), y.data(), r2.data(), n);
+            REQUIRE(r1 == r2);
+            REQUIRE(Simd::add(u.data(), v.data(), s2.data(), n));
+            REQUIRE(s1 == s2);
+        }
+    }
+
+    /* the exact sum of the longs. */
+    Simd::LongSum s = Simd::sum(u.data(), u.size());
+    __int128 expected = 0;
+    for (long k: u) expected += k;
+    REQUIRE((__int128) s.high * ((__int128) 1 << 32) + s.low == expected);
+
+    Simd::setLevel(original);
+}
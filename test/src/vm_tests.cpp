@@ -0,0 +1,115 @@
+#include <initializer_list>
+#include <catch2/catch.hpp>
+
+#include "builtin.h"
+#include "environment.h"
+#include "eval.h"
+#include "parser.h"
+#include "value.h"
+#include "test_util.h"
+
+
+TEST_CASE("compiled numerical expressions","[vm-1]") {
+    using namespace Inky::Lisp;
+
+    EnvironmentPtr e(new Environment());
+    addBuiltinFunctions(e);
+
+    std::initializer_list<TestCase> tests  = {
+            { "486", Type::Integer, 486L },
+            { "(+ 137 349)", Type::Integer, 486L},
+            { "(* 5 99)", Type::Integer, 495L},
+            { "(/ 10 2)", Type::Integer, 5L},
+            { "(+ 2.7 10)", Type::Double, 12.7},
+            { "(* 25 4 12)", Type::Integer, 1200L},
+            { "(+ 21 35 12  7)", Type::Integer, 75L},
+            { "(+ (* 3 (+ (* 2 4) (+ 3 5))) (+ (- 10 7) 6))", Type::Integer, 57},
+            { "if (< 1 2) (+ 1 1) (- 1 1)", Type::Integer, 2},
+            { "(lambda(x) (+ x (+ 2 3)) ) (+ 1 2)", Type::Integer, 8},
+            { "eval (head (tail [1 2 3 4]))", Type::Integer, 2}
+    };
+
+    verifyTestCases(e, tests, execute);
+}
+
+TEST_CASE("compiled lambdas, partial application and recursion","[vm-2]") {
+    using namespace Inky::Lisp;
+
+    EnvironmentPtr e(new Environment());
+    addBuiltinFunctions(e);
+
+    for (const auto& definition: {
+            "def (nil) []",
+            "defun (len xs) (if (== xs nil) (0) (+ 1 (len (tail xs))))",
+            "defun (fst xs) ( eval (head xs) )",
+            "defun (foldl f z xs) (if (== xs nil) [z] (foldl f (f z (fst xs)) (tail xs)))",
+            "defun (add x y) (+ x y)",
+            "def (plusOne) (add 1)",
+            "defun (count x & xs) (+ x (len xs))",
+            "defun (bar x) ( (= y 1) (+ x y))",
+            "defun (fib n)  (if (== n 0) (0) (if (== n 1) (1) ((+ (fib (- n 2)) (fib (- n 1))))))" }) {
+        auto result = execute(e, parse(definition).right());
+        REQUIRE(!Ops::isError(result));
+    }
+
+    std::initializer_list<TestCase> tests  = {
+            { "len [1 2 3 4 5]", Type::Integer, 5L },
+            { "foldl * 1 [2 2 2]", Type::Integer, 8L },
+            { "foldl + 0.5 [1 2 3]", Type::Double, 6.5 },
+            { "plusOne 2", Type::Integer, 3L },
+            { "count 10 1 2 3", Type::Integer, 13L },
+            { "count 10", Type::Integer, 10L },
+            { "bar 10", Type::Integer, 11L },
+            { "fib 15", Type::Integer, 610L }
+    };
+
+    verifyTestCases(e, tests, execute);
+
+    /* local definitions should not leak into the global scope. */
+    REQUIRE(Ops::isError(execute(e, parse("y").right())));
+}
+
+TEST_CASE("compiled and tree walking evaluation agree","[vm-3]") {
+    using namespace Inky::Lisp;
+
+    EnvironmentPtr treeEnv(new Environment());
+    EnvironmentPtr vmEnv(new Environment());
+    addBuiltinFunctions(treeEnv);
+    addBuiltinFunctions(vmEnv);
+
+    for (const auto& input: {
+            "def xs [ (+ 1 1) (+ 2 2) (+ 3 3) ]",
+            "tail xs",
+            "eval (tail xs)",
+            "xs",
+            "(+ 2 2) (+ 4 4)",
+            "join [1 2] [3] xs",
+            "xs",
+            "defun (add x y) (+ x y)",
+            "add 2",
+            "add",
+            "(== [1 2] [1 2])",
+            "(/ 10 0)",
+            "(+ 1 [2])",
+            "unknown 1 2",
+            "add 1 2 3",
+            "if 1 (2)",
+            "error \"failed\"",
+            "(lambda (x y) (* x y))",
+            "list 1 2 (+ 1 2)",
+            "defun (shadow x) ((= x 5) (+ x 1))",
+            "shadow 1",
+            "defun (three a b c) (list a b c)",
+            "def (p) (three 1)",
+            "p 2 3",
+            "(p 2) 3",
+            "defun (rest x & xs) (join xs (list x))",
+            "def (r) (rest 1)",
+            "r 2 3",
+            "r" }) {
+        auto expected = show(eval(treeEnv, parse(input).right()));
+        auto actual = show(execute(vmEnv, parse(input).right()));
+        INFO(input);
+        REQUIRE(expected == actual);
+    }
+}